@@ -0,0 +1,923 @@
+#include "AdvectionKernels.hpp"
+#include "HalfFloat.hpp"
+
+#include <cmath>
+
+#ifdef GLOO_SIMD_X86
+#include <immintrin.h>
+#endif
+
+namespace GLOO {
+namespace {
+// Cells [i, n) of a row, one at a time. Inlined into the vector kernels so
+// the tail is encoded like the rest of the kernel.
+template <typename Real>
+#ifdef GLOO_SIMD_X86
+__attribute__((always_inline))
+#endif
+inline void AdvectRowTail(const Real* const* fields, Real* const* outs,
+                          int count, const Real* u_y, const Real* u_x,
+                          int y, int x0, int i, int n, int cells_y,
+                          int cells_x, float dt) {
+  const Real y_max = static_cast<Real>(cells_y) - 2.0f;
+  const Real x_max = static_cast<Real>(cells_x) - 2.0f;
+  const int row = y * cells_x + x0;
+  for (; i < n; i++) {
+    Real py = (static_cast<Real>(y) + 0.5f) - dt * u_y[row + i];
+    Real px = (static_cast<Real>(x0 + i) + 0.5f) - dt * u_x[row + i];
+    py = std::fmax(1.0f, std::fmin(y_max, py)) - 0.5f;
+    px = std::fmax(1.0f, std::fmin(x_max, px)) - 0.5f;
+
+    Real fy = std::floor(py);
+    Real fx = std::floor(px);
+    Real ty = py - fy;
+    Real tx = px - fx;
+    const int tap = static_cast<int>(fy) * cells_x + static_cast<int>(fx);
+
+    for (int f = 0; f < count; f++) {
+      const Real* t = fields[f] + tap;
+      Real vl = (1.0f - ty) * t[0] + ty * t[cells_x];
+      Real vr = (1.0f - ty) * t[1] + ty * t[cells_x + 1];
+      outs[f][row + i] = (1.0f - tx) * vl + tx * vr;
+    }
+  }
+}
+
+template <typename Real>
+void AdvectRowScalar(const Real* const* fields, Real* const* outs,
+                     int count, const Real* u_y, const Real* u_x, int y,
+                     int x0, int n, int cells_y, int cells_x, float dt) {
+  AdvectRowTail(fields, outs, count, u_y, u_x, y, x0, 0, n, cells_y, cells_x,
+                dt);
+}
+
+// AdvectRowScalar on a periodic grid: the departure point wraps around the
+// interior instead of being clamped to it, and the taps that land on the
+// ghost ring read the periodic images stored there.
+template <typename Real>
+void AdvectPeriodicRowScalar(const Real* const* fields, Real* const* outs,
+                             int count, const Real* u_y, const Real* u_x,
+                             int y, int x0, int n, int cells_y, int cells_x,
+                             float dt) {
+  const Real span_y = static_cast<Real>(cells_y) - 2.0f;
+  const Real span_x = static_cast<Real>(cells_x) - 2.0f;
+  const int row = y * cells_x + x0;
+  for (int i = 0; i < n; i++) {
+    // offsets from the first interior cell centre, wrapped into the span
+    Real py = (static_cast<Real>(y) - 0.5f) - dt * u_y[row + i];
+    Real px = (static_cast<Real>(x0 + i) - 0.5f) - dt * u_x[row + i];
+    py = py - span_y * std::floor(py / span_y) + 0.5f;
+    px = px - span_x * std::floor(px / span_x) + 0.5f;
+
+    Real fy = std::floor(py);
+    Real fx = std::floor(px);
+    Real ty = py - fy;
+    Real tx = px - fx;
+    const int tap = static_cast<int>(fy) * cells_x + static_cast<int>(fx);
+
+    for (int f = 0; f < count; f++) {
+      const Real* t = fields[f] + tap;
+      Real vl = (1.0f - ty) * t[0] + ty * t[cells_x];
+      Real vr = (1.0f - ty) * t[1] + ty * t[cells_x + 1];
+      outs[f][row + i] = (1.0f - tx) * vl + tx * vr;
+    }
+  }
+}
+
+// Catmull-Rom weights of the taps at -1, 0, 1 and 2 for a sample at t in
+// [0, 1).
+template <typename Real>
+#ifdef GLOO_SIMD_X86
+__attribute__((always_inline))
+#endif
+inline void CatmullRomWeights(Real t, Real* w) {
+  const Real t2 = t * t;
+  const Real t3 = t2 * t;
+  w[0] = 0.5f * (2.0f * t2 - t3 - t);
+  w[1] = 0.5f * (3.0f * t3 - 5.0f * t2 + 2.0f);
+  w[2] = 0.5f * (4.0f * t2 - 3.0f * t3 + t);
+  w[3] = 0.5f * (t3 - t2);
+}
+
+// Cubic counterpart of AdvectRowTail. The departure point is traced and
+// clamped the same way, so fy + 2 and fx + 2 stay inside the grid and only
+// the taps at -1 can fall off, onto row or column 0, where they are
+// clamped.
+template <typename Real>
+#ifdef GLOO_SIMD_X86
+__attribute__((always_inline))
+#endif
+inline void AdvectCubicRowTail(const Real* const* fields,
+                               Real* const* outs, int count,
+                               const Real* u_y, const Real* u_x, int y,
+                               int x0, int i, int n, int cells_y, int cells_x,
+                               float dt) {
+  const Real y_max = static_cast<Real>(cells_y) - 2.0f;
+  const Real x_max = static_cast<Real>(cells_x) - 2.0f;
+  const int row = y * cells_x + x0;
+  const int s = cells_x;
+  for (; i < n; i++) {
+    Real py = (static_cast<Real>(y) + 0.5f) - dt * u_y[row + i];
+    Real px = (static_cast<Real>(x0 + i) + 0.5f) - dt * u_x[row + i];
+    py = std::fmax(1.0f, std::fmin(y_max, py)) - 0.5f;
+    px = std::fmax(1.0f, std::fmin(x_max, px)) - 0.5f;
+
+    Real fy = std::floor(py);
+    Real fx = std::floor(px);
+    Real wy[4];
+    Real wx[4];
+    CatmullRomWeights(py - fy, wy);
+    CatmullRomWeights(px - fx, wx);
+    const int iy = static_cast<int>(fy);
+    const int ix = static_cast<int>(fx);
+    const int tap = iy * s + ix;
+    const int up = iy > 0 ? s : 0;
+    const int left = ix > 0 ? 1 : 0;
+    const int rows[4] = {tap - up, tap, tap + s, tap + 2 * s};
+
+    for (int f = 0; f < count; f++) {
+      const Real* field = fields[f];
+      Real v = 0.f;
+      for (int k = 0; k < 4; k++) {
+        const Real* t = field + rows[k];
+        Real h = wx[0] * t[-left] + wx[1] * t[0] + wx[2] * t[1] + wx[3] * t[2];
+        v += wy[k] * h;
+      }
+      // the cubic can overshoot; clamping to the bilinear taps keeps the
+      // result monotone
+      const Real* t = field + tap;
+      Real lo = std::fmin(std::fmin(t[0], t[1]), std::fmin(t[s], t[s + 1]));
+      Real hi = std::fmax(std::fmax(t[0], t[1]), std::fmax(t[s], t[s + 1]));
+      outs[f][row + i] = std::fmax(lo, std::fmin(hi, v));
+    }
+  }
+}
+
+template <typename Real>
+void AdvectCubicRowScalar(const Real* const* fields, Real* const* outs,
+                          int count, const Real* u_y, const Real* u_x,
+                          int y, int x0, int n, int cells_y, int cells_x,
+                          float dt) {
+  AdvectCubicRowTail(fields, outs, count, u_y, u_x, y, x0, 0, n, cells_y,
+                     cells_x, dt);
+}
+
+// AdvectRowTail for one packed field, decoding with Decode and encoding
+// with Encode.
+template <typename Real, float (*Decode)(uint16_t), uint16_t (*Encode)(float)>
+#ifdef GLOO_SIMD_X86
+__attribute__((always_inline))
+#endif
+inline void AdvectPackedRowTail(const uint16_t* field, uint16_t* out,
+                                const Real* u_y, const Real* u_x, int y,
+                                int x0, int i, int n, int cells_y,
+                                int cells_x, float dt, float scale) {
+  const Real y_max = static_cast<Real>(cells_y) - 2.0f;
+  const Real x_max = static_cast<Real>(cells_x) - 2.0f;
+  const int row = y * cells_x + x0;
+  for (; i < n; i++) {
+    Real py = (static_cast<Real>(y) + 0.5f) - dt * u_y[row + i];
+    Real px = (static_cast<Real>(x0 + i) + 0.5f) - dt * u_x[row + i];
+    py = std::fmax(1.0f, std::fmin(y_max, py)) - 0.5f;
+    px = std::fmax(1.0f, std::fmin(x_max, px)) - 0.5f;
+
+    Real fy = std::floor(py);
+    Real fx = std::floor(px);
+    Real ty = py - fy;
+    Real tx = px - fx;
+    const uint16_t* t =
+        field + static_cast<int>(fy) * cells_x + static_cast<int>(fx);
+
+    Real vl = (1.0f - ty) * Decode(t[0]) + ty * Decode(t[cells_x]);
+    Real vr = (1.0f - ty) * Decode(t[1]) + ty * Decode(t[cells_x + 1]);
+    out[row + i] = Encode(((1.0f - tx) * vl + tx * vr) * scale);
+  }
+}
+
+template <typename Real>
+void AdvectHalfRowScalar(const uint16_t* field, uint16_t* out,
+                         const Real* u_y, const Real* u_x, int y, int x0,
+                         int n, int cells_y, int cells_x, float dt,
+                         float scale) {
+  AdvectPackedRowTail<Real, HalfToFloat, FloatToHalf>(
+      field, out, u_y, u_x, y, x0, 0, n, cells_y, cells_x, dt, scale);
+}
+
+template <typename Real>
+void AdvectBFloat16RowScalar(const uint16_t* field, uint16_t* out,
+                             const Real* u_y, const Real* u_x, int y,
+                             int x0, int n, int cells_y, int cells_x,
+                             float dt, float scale) {
+  AdvectPackedRowTail<Real, BFloat16ToFloat, FloatToBFloat16>(
+      field, out, u_y, u_x, y, x0, 0, n, cells_y, cells_x, dt, scale);
+}
+
+#ifdef GLOO_SIMD_X86
+// Most unmasked AVX-512 intrinsics pass an undefined vector through to the
+// masked builtin, which GCC then warns may be used uninitialized. The
+// AVX-512 kernels use the masked forms with every lane on and an explicit
+// zero source instead; they compile to the same instructions.
+const __mmask16 kAll16 = 0xFFFF;
+const __mmask8 kAll8 = 0xFF;
+
+// SSE has no gather, so the four taps are reassembled from the rows with
+// scalar loads.
+__attribute__((target("sse4.2"))) void AdvectRowSse42(
+    const float* const* fields, float* const* outs, int count,
+    const float* u_y, const float* u_x, int y, int x0, int n, int cells_y,
+    int cells_x, float dt) {
+  const __m128 vdt = _mm_set1_ps(dt);
+  const __m128 vone = _mm_set1_ps(1.0f);
+  const __m128 vhalf = _mm_set1_ps(0.5f);
+  const __m128 vy_max = _mm_set1_ps(static_cast<float>(cells_y) - 2.0f);
+  const __m128 vx_max = _mm_set1_ps(static_cast<float>(cells_x) - 2.0f);
+  const __m128 vy = _mm_set1_ps(static_cast<float>(y) + 0.5f);
+  const __m128i lanes = _mm_setr_epi32(0, 1, 2, 3);
+  const __m128i vstride = _mm_set1_epi32(cells_x);
+  const int row = y * cells_x + x0;
+  const int s = cells_x;
+  alignas(16) int index[4];
+  int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m128 vx = _mm_add_ps(
+        _mm_cvtepi32_ps(_mm_add_epi32(_mm_set1_epi32(x0 + i), lanes)), vhalf);
+    __m128 py = _mm_sub_ps(vy, _mm_mul_ps(vdt, _mm_loadu_ps(u_y + row + i)));
+    __m128 px = _mm_sub_ps(vx, _mm_mul_ps(vdt, _mm_loadu_ps(u_x + row + i)));
+    py = _mm_sub_ps(_mm_max_ps(vone, _mm_min_ps(py, vy_max)), vhalf);
+    px = _mm_sub_ps(_mm_max_ps(vone, _mm_min_ps(px, vx_max)), vhalf);
+
+    __m128 fy = _mm_floor_ps(py);
+    __m128 fx = _mm_floor_ps(px);
+    __m128 ty = _mm_sub_ps(py, fy);
+    __m128 tx = _mm_sub_ps(px, fx);
+    __m128 wy = _mm_sub_ps(vone, ty);
+    __m128 wx = _mm_sub_ps(vone, tx);
+    __m128i tap_row = _mm_mullo_epi32(_mm_cvttps_epi32(fy), vstride);
+    _mm_store_si128(reinterpret_cast<__m128i*>(index),
+                    _mm_add_epi32(tap_row, _mm_cvttps_epi32(fx)));
+
+    for (int f = 0; f < count; f++) {
+      const float* t0 = fields[f] + index[0];
+      const float* t1 = fields[f] + index[1];
+      const float* t2 = fields[f] + index[2];
+      const float* t3 = fields[f] + index[3];
+      __m128 tl = _mm_setr_ps(t0[0], t1[0], t2[0], t3[0]);
+      __m128 tr = _mm_setr_ps(t0[1], t1[1], t2[1], t3[1]);
+      __m128 bl = _mm_setr_ps(t0[s], t1[s], t2[s], t3[s]);
+      __m128 br = _mm_setr_ps(t0[s + 1], t1[s + 1], t2[s + 1], t3[s + 1]);
+      __m128 vl = _mm_add_ps(_mm_mul_ps(wy, tl), _mm_mul_ps(ty, bl));
+      __m128 vr = _mm_add_ps(_mm_mul_ps(wy, tr), _mm_mul_ps(ty, br));
+      _mm_storeu_ps(outs[f] + row + i,
+                    _mm_add_ps(_mm_mul_ps(wx, vl), _mm_mul_ps(tx, vr)));
+    }
+  }
+  AdvectRowTail(fields, outs, count, u_y, u_x, y, x0, i, n, cells_y, cells_x,
+                dt);
+}
+
+__attribute__((target("avx2"))) void AdvectRowAvx2(
+    const float* const* fields, float* const* outs, int count,
+    const float* u_y, const float* u_x, int y, int x0, int n, int cells_y,
+    int cells_x, float dt) {
+  const __m256 vdt = _mm256_set1_ps(dt);
+  const __m256 vone = _mm256_set1_ps(1.0f);
+  const __m256 vhalf = _mm256_set1_ps(0.5f);
+  const __m256 vy_max = _mm256_set1_ps(static_cast<float>(cells_y) - 2.0f);
+  const __m256 vx_max = _mm256_set1_ps(static_cast<float>(cells_x) - 2.0f);
+  const __m256 vy = _mm256_set1_ps(static_cast<float>(y) + 0.5f);
+  const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  const __m256i vstride = _mm256_set1_epi32(cells_x);
+  const int row = y * cells_x + x0;
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256 vx = _mm256_add_ps(
+        _mm256_cvtepi32_ps(_mm256_add_epi32(_mm256_set1_epi32(x0 + i), lanes)),
+        vhalf);
+    __m256 py = _mm256_sub_ps(
+        vy, _mm256_mul_ps(vdt, _mm256_loadu_ps(u_y + row + i)));
+    __m256 px = _mm256_sub_ps(
+        vx, _mm256_mul_ps(vdt, _mm256_loadu_ps(u_x + row + i)));
+    py = _mm256_sub_ps(_mm256_max_ps(vone, _mm256_min_ps(py, vy_max)), vhalf);
+    px = _mm256_sub_ps(_mm256_max_ps(vone, _mm256_min_ps(px, vx_max)), vhalf);
+
+    __m256 fy = _mm256_floor_ps(py);
+    __m256 fx = _mm256_floor_ps(px);
+    __m256 ty = _mm256_sub_ps(py, fy);
+    __m256 tx = _mm256_sub_ps(px, fx);
+    __m256 wy = _mm256_sub_ps(vone, ty);
+    __m256 wx = _mm256_sub_ps(vone, tx);
+    __m256i index = _mm256_add_epi32(
+        _mm256_mullo_epi32(_mm256_cvttps_epi32(fy), vstride),
+        _mm256_cvttps_epi32(fx));
+
+    for (int f = 0; f < count; f++) {
+      const float* field = fields[f];
+      const float* below = field + cells_x;
+      __m256 tl = _mm256_i32gather_ps(field, index, 4);
+      __m256 tr = _mm256_i32gather_ps(field + 1, index, 4);
+      __m256 bl = _mm256_i32gather_ps(below, index, 4);
+      __m256 br = _mm256_i32gather_ps(below + 1, index, 4);
+      __m256 vl = _mm256_add_ps(_mm256_mul_ps(wy, tl), _mm256_mul_ps(ty, bl));
+      __m256 vr = _mm256_add_ps(_mm256_mul_ps(wy, tr), _mm256_mul_ps(ty, br));
+      _mm256_storeu_ps(outs[f] + row + i,
+                       _mm256_add_ps(_mm256_mul_ps(wx, vl),
+                                     _mm256_mul_ps(tx, vr)));
+    }
+  }
+  AdvectRowTail(fields, outs, count, u_y, u_x, y, x0, i, n, cells_y, cells_x,
+                dt);
+}
+
+__attribute__((target("avx512f"))) void AdvectRowAvx512(
+    const float* const* fields, float* const* outs, int count,
+    const float* u_y, const float* u_x, int y, int x0, int n, int cells_y,
+    int cells_x, float dt) {
+  const __m512 vdt = _mm512_set1_ps(dt);
+  const __m512 vone = _mm512_set1_ps(1.0f);
+  const __m512 vhalf = _mm512_set1_ps(0.5f);
+  const __m512 vy_max = _mm512_set1_ps(static_cast<float>(cells_y) - 2.0f);
+  const __m512 vx_max = _mm512_set1_ps(static_cast<float>(cells_x) - 2.0f);
+  const __m512 vy = _mm512_set1_ps(static_cast<float>(y) + 0.5f);
+  const __m512i lanes = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10,
+                                          11, 12, 13, 14, 15);
+  const __m512i vstride = _mm512_set1_epi32(cells_x);
+  const __m512 vzero = _mm512_setzero_ps();
+  const int kFloor = _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC;
+  const int row = y * cells_x + x0;
+  int i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m512 vx = _mm512_add_ps(
+        _mm512_maskz_cvtepi32_ps(kAll16, _mm512_add_epi32(_mm512_set1_epi32(x0 + i), lanes)),
+        vhalf);
+    __m512 py = _mm512_sub_ps(
+        vy, _mm512_mul_ps(vdt, _mm512_loadu_ps(u_y + row + i)));
+    __m512 px = _mm512_sub_ps(
+        vx, _mm512_mul_ps(vdt, _mm512_loadu_ps(u_x + row + i)));
+    py = _mm512_sub_ps(_mm512_maskz_max_ps(kAll16, vone, _mm512_maskz_min_ps(kAll16, py, vy_max)),
+                       vhalf);
+    px = _mm512_sub_ps(_mm512_maskz_max_ps(kAll16, vone, _mm512_maskz_min_ps(kAll16, px, vx_max)),
+                       vhalf);
+
+    __m512 fy = _mm512_maskz_roundscale_ps(kAll16, py, kFloor);
+    __m512 fx = _mm512_maskz_roundscale_ps(kAll16, px, kFloor);
+    __m512 ty = _mm512_sub_ps(py, fy);
+    __m512 tx = _mm512_sub_ps(px, fx);
+    __m512 wy = _mm512_sub_ps(vone, ty);
+    __m512 wx = _mm512_sub_ps(vone, tx);
+    __m512i index = _mm512_add_epi32(
+        _mm512_mullo_epi32(_mm512_maskz_cvttps_epi32(kAll16, fy), vstride),
+        _mm512_maskz_cvttps_epi32(kAll16, fx));
+
+    for (int f = 0; f < count; f++) {
+      const float* field = fields[f];
+      const float* below = field + cells_x;
+      __m512 tl = _mm512_mask_i32gather_ps(vzero, kAll16, index, field, 4);
+      __m512 tr = _mm512_mask_i32gather_ps(vzero, kAll16, index, field + 1, 4);
+      __m512 bl = _mm512_mask_i32gather_ps(vzero, kAll16, index, below, 4);
+      __m512 br = _mm512_mask_i32gather_ps(vzero, kAll16, index, below + 1, 4);
+      __m512 vl = _mm512_add_ps(_mm512_mul_ps(wy, tl), _mm512_mul_ps(ty, bl));
+      __m512 vr = _mm512_add_ps(_mm512_mul_ps(wy, tr), _mm512_mul_ps(ty, br));
+      _mm512_storeu_ps(outs[f] + row + i,
+                       _mm512_add_ps(_mm512_mul_ps(wx, vl),
+                                     _mm512_mul_ps(tx, vr)));
+    }
+  }
+  AdvectRowTail(fields, outs, count, u_y, u_x, y, x0, i, n, cells_y, cells_x,
+                dt);
+}
+
+// The cubic kernels below compute the Catmull-Rom weights of each axis once
+// per cell, then filter each field along x on four rows with 16 gathers and
+// blend the rows along y.
+__attribute__((target("avx2"), always_inline)) inline void CatmullRomWeightsAvx2(
+    __m256 t, __m256* w) {
+  const __m256 half = _mm256_set1_ps(0.5f);
+  const __m256 t2 = _mm256_mul_ps(t, t);
+  const __m256 t3 = _mm256_mul_ps(t2, t);
+  w[0] = _mm256_mul_ps(half, _mm256_sub_ps(_mm256_sub_ps(
+      _mm256_mul_ps(_mm256_set1_ps(2.0f), t2), t3), t));
+  w[1] = _mm256_mul_ps(half, _mm256_add_ps(_mm256_sub_ps(
+      _mm256_mul_ps(_mm256_set1_ps(3.0f), t3),
+      _mm256_mul_ps(_mm256_set1_ps(5.0f), t2)), _mm256_set1_ps(2.0f)));
+  w[2] = _mm256_mul_ps(half, _mm256_add_ps(_mm256_sub_ps(
+      _mm256_mul_ps(_mm256_set1_ps(4.0f), t2),
+      _mm256_mul_ps(_mm256_set1_ps(3.0f), t3)), t));
+  w[3] = _mm256_mul_ps(half, _mm256_sub_ps(t3, t2));
+}
+
+// One row of the 4x4 stencil, filtered along x; taps at index - left,
+// index, index + 1 and index + 2 of row. The two middle taps are kept for
+// the monotone clamp.
+__attribute__((target("avx2"), always_inline)) inline __m256 CubicRowAvx2(
+    const float* row, __m256i index, __m256i index_left, const __m256* wx,
+    __m256* middle0, __m256* middle1) {
+  __m256 a = _mm256_i32gather_ps(row, index_left, 4);
+  __m256 b = _mm256_i32gather_ps(row, index, 4);
+  __m256 c = _mm256_i32gather_ps(row + 1, index, 4);
+  __m256 d = _mm256_i32gather_ps(row + 2, index, 4);
+  *middle0 = b;
+  *middle1 = c;
+  return _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(
+      _mm256_mul_ps(wx[0], a), _mm256_mul_ps(wx[1], b)),
+      _mm256_mul_ps(wx[2], c)), _mm256_mul_ps(wx[3], d));
+}
+
+__attribute__((target("avx2"))) void AdvectCubicRowAvx2(
+    const float* const* fields, float* const* outs, int count,
+    const float* u_y, const float* u_x, int y, int x0, int n, int cells_y,
+    int cells_x, float dt) {
+  const __m256 vdt = _mm256_set1_ps(dt);
+  const __m256 vone = _mm256_set1_ps(1.0f);
+  const __m256 vhalf = _mm256_set1_ps(0.5f);
+  const __m256 vy_max = _mm256_set1_ps(static_cast<float>(cells_y) - 2.0f);
+  const __m256 vx_max = _mm256_set1_ps(static_cast<float>(cells_x) - 2.0f);
+  const __m256 vy = _mm256_set1_ps(static_cast<float>(y) + 0.5f);
+  const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  const __m256i vstride = _mm256_set1_epi32(cells_x);
+  const __m256i izero = _mm256_setzero_si256();
+  const __m256i ione = _mm256_set1_epi32(1);
+  const int s = cells_x;
+  const int row = y * cells_x + x0;
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256 vx = _mm256_add_ps(
+        _mm256_cvtepi32_ps(_mm256_add_epi32(_mm256_set1_epi32(x0 + i), lanes)),
+        vhalf);
+    __m256 py = _mm256_sub_ps(
+        vy, _mm256_mul_ps(vdt, _mm256_loadu_ps(u_y + row + i)));
+    __m256 px = _mm256_sub_ps(
+        vx, _mm256_mul_ps(vdt, _mm256_loadu_ps(u_x + row + i)));
+    py = _mm256_sub_ps(_mm256_max_ps(vone, _mm256_min_ps(py, vy_max)), vhalf);
+    px = _mm256_sub_ps(_mm256_max_ps(vone, _mm256_min_ps(px, vx_max)), vhalf);
+
+    __m256 fy = _mm256_floor_ps(py);
+    __m256 fx = _mm256_floor_ps(px);
+    __m256 wy[4];
+    __m256 wx[4];
+    CatmullRomWeightsAvx2(_mm256_sub_ps(py, fy), wy);
+    CatmullRomWeightsAvx2(_mm256_sub_ps(px, fx), wx);
+    __m256i iy = _mm256_cvttps_epi32(fy);
+    __m256i ix = _mm256_cvttps_epi32(fx);
+    __m256i index = _mm256_add_epi32(_mm256_mullo_epi32(iy, vstride), ix);
+    __m256i up = _mm256_and_si256(_mm256_cmpgt_epi32(iy, izero), vstride);
+    __m256i left = _mm256_and_si256(_mm256_cmpgt_epi32(ix, izero), ione);
+    __m256i index_left = _mm256_sub_epi32(index, left);
+    __m256i index_up = _mm256_sub_epi32(index, up);
+    __m256i index_up_left = _mm256_sub_epi32(index_up, left);
+
+    for (int f = 0; f < count; f++) {
+      const float* field = fields[f];
+      __m256 tl, tr, bl, br, unused0, unused1;
+      __m256 h0 = CubicRowAvx2(field, index_up, index_up_left, wx, &unused0,
+                               &unused1);
+      __m256 h1 = CubicRowAvx2(field, index, index_left, wx, &tl, &tr);
+      __m256 h2 = CubicRowAvx2(field + s, index, index_left, wx, &bl, &br);
+      __m256 h3 = CubicRowAvx2(field + 2 * s, index, index_left, wx,
+                               &unused0, &unused1);
+      __m256 v = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(
+          _mm256_mul_ps(wy[0], h0), _mm256_mul_ps(wy[1], h1)),
+          _mm256_mul_ps(wy[2], h2)), _mm256_mul_ps(wy[3], h3));
+      __m256 lo = _mm256_min_ps(_mm256_min_ps(tl, tr), _mm256_min_ps(bl, br));
+      __m256 hi = _mm256_max_ps(_mm256_max_ps(tl, tr), _mm256_max_ps(bl, br));
+      _mm256_storeu_ps(outs[f] + row + i,
+                       _mm256_max_ps(lo, _mm256_min_ps(v, hi)));
+    }
+  }
+  AdvectCubicRowTail(fields, outs, count, u_y, u_x, y, x0, i, n, cells_y,
+                     cells_x, dt);
+}
+
+__attribute__((target("avx512f"), always_inline)) inline void
+CatmullRomWeightsAvx512(__m512 t, __m512* w) {
+  const __m512 half = _mm512_set1_ps(0.5f);
+  const __m512 t2 = _mm512_mul_ps(t, t);
+  const __m512 t3 = _mm512_mul_ps(t2, t);
+  w[0] = _mm512_mul_ps(half, _mm512_sub_ps(_mm512_sub_ps(
+      _mm512_mul_ps(_mm512_set1_ps(2.0f), t2), t3), t));
+  w[1] = _mm512_mul_ps(half, _mm512_add_ps(_mm512_sub_ps(
+      _mm512_mul_ps(_mm512_set1_ps(3.0f), t3),
+      _mm512_mul_ps(_mm512_set1_ps(5.0f), t2)), _mm512_set1_ps(2.0f)));
+  w[2] = _mm512_mul_ps(half, _mm512_add_ps(_mm512_sub_ps(
+      _mm512_mul_ps(_mm512_set1_ps(4.0f), t2),
+      _mm512_mul_ps(_mm512_set1_ps(3.0f), t3)), t));
+  w[3] = _mm512_mul_ps(half, _mm512_sub_ps(t3, t2));
+}
+
+__attribute__((target("avx512f"), always_inline)) inline __m512
+CubicRowAvx512(const float* row, __m512i index, __m512i index_left,
+               const __m512* wx, __m512* middle0, __m512* middle1) {
+  __m512 a = _mm512_mask_i32gather_ps(_mm512_setzero_ps(), kAll16, index_left, row, 4);
+  __m512 b = _mm512_mask_i32gather_ps(_mm512_setzero_ps(), kAll16, index, row, 4);
+  __m512 c = _mm512_mask_i32gather_ps(_mm512_setzero_ps(), kAll16, index, row + 1, 4);
+  __m512 d = _mm512_mask_i32gather_ps(_mm512_setzero_ps(), kAll16, index, row + 2, 4);
+  *middle0 = b;
+  *middle1 = c;
+  return _mm512_add_ps(_mm512_add_ps(_mm512_add_ps(
+      _mm512_mul_ps(wx[0], a), _mm512_mul_ps(wx[1], b)),
+      _mm512_mul_ps(wx[2], c)), _mm512_mul_ps(wx[3], d));
+}
+
+__attribute__((target("avx512f"))) void AdvectCubicRowAvx512(
+    const float* const* fields, float* const* outs, int count,
+    const float* u_y, const float* u_x, int y, int x0, int n, int cells_y,
+    int cells_x, float dt) {
+  const __m512 vdt = _mm512_set1_ps(dt);
+  const __m512 vone = _mm512_set1_ps(1.0f);
+  const __m512 vhalf = _mm512_set1_ps(0.5f);
+  const __m512 vy_max = _mm512_set1_ps(static_cast<float>(cells_y) - 2.0f);
+  const __m512 vx_max = _mm512_set1_ps(static_cast<float>(cells_x) - 2.0f);
+  const __m512 vy = _mm512_set1_ps(static_cast<float>(y) + 0.5f);
+  const __m512i lanes = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10,
+                                          11, 12, 13, 14, 15);
+  const __m512i vstride = _mm512_set1_epi32(cells_x);
+  const __m512i izero = _mm512_setzero_si512();
+  const __m512i ione = _mm512_set1_epi32(1);
+  const int kFloor = _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC;
+  const int s = cells_x;
+  const int row = y * cells_x + x0;
+  int i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m512 vx = _mm512_add_ps(
+        _mm512_maskz_cvtepi32_ps(kAll16, _mm512_add_epi32(_mm512_set1_epi32(x0 + i), lanes)),
+        vhalf);
+    __m512 py = _mm512_sub_ps(
+        vy, _mm512_mul_ps(vdt, _mm512_loadu_ps(u_y + row + i)));
+    __m512 px = _mm512_sub_ps(
+        vx, _mm512_mul_ps(vdt, _mm512_loadu_ps(u_x + row + i)));
+    py = _mm512_sub_ps(_mm512_maskz_max_ps(kAll16, vone, _mm512_maskz_min_ps(kAll16, py, vy_max)),
+                       vhalf);
+    px = _mm512_sub_ps(_mm512_maskz_max_ps(kAll16, vone, _mm512_maskz_min_ps(kAll16, px, vx_max)),
+                       vhalf);
+
+    __m512 fy = _mm512_maskz_roundscale_ps(kAll16, py, kFloor);
+    __m512 fx = _mm512_maskz_roundscale_ps(kAll16, px, kFloor);
+    __m512 wy[4];
+    __m512 wx[4];
+    CatmullRomWeightsAvx512(_mm512_sub_ps(py, fy), wy);
+    CatmullRomWeightsAvx512(_mm512_sub_ps(px, fx), wx);
+    __m512i iy = _mm512_maskz_cvttps_epi32(kAll16, fy);
+    __m512i ix = _mm512_maskz_cvttps_epi32(kAll16, fx);
+    __m512i index = _mm512_add_epi32(_mm512_mullo_epi32(iy, vstride), ix);
+    __m512i up = _mm512_maskz_mov_epi32(_mm512_cmpgt_epi32_mask(iy, izero),
+                                        vstride);
+    __m512i left = _mm512_maskz_mov_epi32(_mm512_cmpgt_epi32_mask(ix, izero),
+                                          ione);
+    __m512i index_left = _mm512_sub_epi32(index, left);
+    __m512i index_up = _mm512_sub_epi32(index, up);
+    __m512i index_up_left = _mm512_sub_epi32(index_up, left);
+
+    for (int f = 0; f < count; f++) {
+      const float* field = fields[f];
+      __m512 tl, tr, bl, br, unused0, unused1;
+      __m512 h0 = CubicRowAvx512(field, index_up, index_up_left, wx,
+                                 &unused0, &unused1);
+      __m512 h1 = CubicRowAvx512(field, index, index_left, wx, &tl, &tr);
+      __m512 h2 = CubicRowAvx512(field + s, index, index_left, wx, &bl, &br);
+      __m512 h3 = CubicRowAvx512(field + 2 * s, index, index_left, wx,
+                                 &unused0, &unused1);
+      __m512 v = _mm512_add_ps(_mm512_add_ps(_mm512_add_ps(
+          _mm512_mul_ps(wy[0], h0), _mm512_mul_ps(wy[1], h1)),
+          _mm512_mul_ps(wy[2], h2)), _mm512_mul_ps(wy[3], h3));
+      __m512 lo = _mm512_maskz_min_ps(kAll16, _mm512_maskz_min_ps(kAll16, tl, tr),
+                                      _mm512_maskz_min_ps(kAll16, bl, br));
+      __m512 hi = _mm512_maskz_max_ps(kAll16, _mm512_maskz_max_ps(kAll16, tl, tr),
+                                      _mm512_maskz_max_ps(kAll16, bl, br));
+      _mm512_storeu_ps(outs[f] + row + i,
+                       _mm512_maskz_max_ps(kAll16, lo, _mm512_maskz_min_ps(kAll16, v, hi)));
+    }
+  }
+  AdvectCubicRowTail(fields, outs, count, u_y, u_x, y, x0, i, n, cells_y,
+                     cells_x, dt);
+}
+
+// The packed kernels gather each pair of horizontal taps as one 32-bit
+// word, the left tap in the low half, and split the pairs in registers.
+// Returns the tap index of eight cells from x0 + i and their weights.
+__attribute__((target("avx2"), always_inline)) inline __m256i
+PackedDepartureAvx2(const float* u_y, const float* u_x, int y, int x0, int i,
+                    int cells_y, int cells_x, float dt, __m256* ty,
+                    __m256* tx) {
+  const __m256 vone = _mm256_set1_ps(1.0f);
+  const __m256 vhalf = _mm256_set1_ps(0.5f);
+  const __m256 vdt = _mm256_set1_ps(dt);
+  const int row = y * cells_x + x0;
+  __m256 vy = _mm256_set1_ps(static_cast<float>(y) + 0.5f);
+  __m256 vx = _mm256_add_ps(
+      _mm256_cvtepi32_ps(_mm256_add_epi32(
+          _mm256_set1_epi32(x0 + i), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7))),
+      vhalf);
+  __m256 py = _mm256_sub_ps(
+      vy, _mm256_mul_ps(vdt, _mm256_loadu_ps(u_y + row + i)));
+  __m256 px = _mm256_sub_ps(
+      vx, _mm256_mul_ps(vdt, _mm256_loadu_ps(u_x + row + i)));
+  py = _mm256_sub_ps(
+      _mm256_max_ps(vone, _mm256_min_ps(
+          py, _mm256_set1_ps(static_cast<float>(cells_y) - 2.0f))), vhalf);
+  px = _mm256_sub_ps(
+      _mm256_max_ps(vone, _mm256_min_ps(
+          px, _mm256_set1_ps(static_cast<float>(cells_x) - 2.0f))), vhalf);
+
+  __m256 fy = _mm256_floor_ps(py);
+  __m256 fx = _mm256_floor_ps(px);
+  *ty = _mm256_sub_ps(py, fy);
+  *tx = _mm256_sub_ps(px, fx);
+  return _mm256_add_epi32(
+      _mm256_mullo_epi32(_mm256_cvttps_epi32(fy), _mm256_set1_epi32(cells_x)),
+      _mm256_cvttps_epi32(fx));
+}
+
+__attribute__((target("avx2,f16c"), always_inline)) inline void
+GatherHalfPairsAvx2(const uint16_t* field, __m256i index, __m256* left,
+                    __m256* right) {
+  __m256i pairs = _mm256_i32gather_epi32(
+      reinterpret_cast<const int*>(field), index, 2);
+  // lefts in the low, rights in the high 128 bits
+  __m256i halves = _mm256_packus_epi32(
+      _mm256_and_si256(pairs, _mm256_set1_epi32(0xFFFF)),
+      _mm256_srli_epi32(pairs, 16));
+  halves = _mm256_permute4x64_epi64(halves, _MM_SHUFFLE(3, 1, 2, 0));
+  *left = _mm256_cvtph_ps(_mm256_castsi256_si128(halves));
+  *right = _mm256_cvtph_ps(_mm256_extracti128_si256(halves, 1));
+}
+
+__attribute__((target("avx2"), always_inline)) inline void
+GatherBFloat16PairsAvx2(const uint16_t* field, __m256i index, __m256* left,
+                        __m256* right) {
+  __m256i pairs = _mm256_i32gather_epi32(
+      reinterpret_cast<const int*>(field), index, 2);
+  *left = _mm256_castsi256_ps(_mm256_slli_epi32(pairs, 16));
+  *right = _mm256_castsi256_ps(
+      _mm256_and_si256(pairs, _mm256_set1_epi32(0xFFFF0000)));
+}
+
+__attribute__((target("avx2,f16c"))) void AdvectHalfRowAvx2(
+    const uint16_t* field, uint16_t* out, const float* u_y, const float* u_x,
+    int y, int x0, int n, int cells_y, int cells_x, float dt, float scale) {
+  const __m256 vone = _mm256_set1_ps(1.0f);
+  const __m256 vscale = _mm256_set1_ps(scale);
+  const int row = y * cells_x + x0;
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256 ty, tx;
+    __m256i index = PackedDepartureAvx2(u_y, u_x, y, x0, i, cells_y, cells_x,
+                                        dt, &ty, &tx);
+    __m256 tl, tr, bl, br;
+    GatherHalfPairsAvx2(field, index, &tl, &tr);
+    GatherHalfPairsAvx2(field + cells_x, index, &bl, &br);
+    __m256 wy = _mm256_sub_ps(vone, ty);
+    __m256 wx = _mm256_sub_ps(vone, tx);
+    __m256 vl = _mm256_add_ps(_mm256_mul_ps(wy, tl), _mm256_mul_ps(ty, bl));
+    __m256 vr = _mm256_add_ps(_mm256_mul_ps(wy, tr), _mm256_mul_ps(ty, br));
+    __m256 v = _mm256_mul_ps(
+        _mm256_add_ps(_mm256_mul_ps(wx, vl), _mm256_mul_ps(tx, vr)), vscale);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + row + i),
+                     _mm256_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT));
+  }
+  AdvectPackedRowTail<float, HalfToFloat, FloatToHalf>(
+      field, out, u_y, u_x, y, x0, i, n, cells_y, cells_x, dt, scale);
+}
+
+// The bfloat16 store rounds to nearest even with integer adds, like
+// FloatToBFloat16; NaNs, which the advection cannot produce from finite
+// input, are not quieted.
+__attribute__((target("avx2"))) void AdvectBFloat16RowAvx2(
+    const uint16_t* field, uint16_t* out, const float* u_y, const float* u_x,
+    int y, int x0, int n, int cells_y, int cells_x, float dt, float scale) {
+  const __m256 vone = _mm256_set1_ps(1.0f);
+  const __m256 vscale = _mm256_set1_ps(scale);
+  const __m256i vround = _mm256_set1_epi32(0x7FFF);
+  const __m256i vlsb = _mm256_set1_epi32(1);
+  const int row = y * cells_x + x0;
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256 ty, tx;
+    __m256i index = PackedDepartureAvx2(u_y, u_x, y, x0, i, cells_y, cells_x,
+                                        dt, &ty, &tx);
+    __m256 tl, tr, bl, br;
+    GatherBFloat16PairsAvx2(field, index, &tl, &tr);
+    GatherBFloat16PairsAvx2(field + cells_x, index, &bl, &br);
+    __m256 wy = _mm256_sub_ps(vone, ty);
+    __m256 wx = _mm256_sub_ps(vone, tx);
+    __m256 vl = _mm256_add_ps(_mm256_mul_ps(wy, tl), _mm256_mul_ps(ty, bl));
+    __m256 vr = _mm256_add_ps(_mm256_mul_ps(wy, tr), _mm256_mul_ps(ty, br));
+    __m256 v = _mm256_mul_ps(
+        _mm256_add_ps(_mm256_mul_ps(wx, vl), _mm256_mul_ps(tx, vr)), vscale);
+
+    __m256i bits = _mm256_castps_si256(v);
+    __m256i lsb = _mm256_and_si256(_mm256_srli_epi32(bits, 16), vlsb);
+    bits = _mm256_srli_epi32(
+        _mm256_add_epi32(bits, _mm256_add_epi32(vround, lsb)), 16);
+    __m256i packed = _mm256_permute4x64_epi64(
+        _mm256_packus_epi32(bits, bits), _MM_SHUFFLE(3, 1, 2, 0));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + row + i),
+                     _mm256_castsi256_si128(packed));
+  }
+  AdvectPackedRowTail<float, BFloat16ToFloat, FloatToBFloat16>(
+      field, out, u_y, u_x, y, x0, i, n, cells_y, cells_x, dt, scale);
+}
+// Double counterparts of AdvectRowAvx2 and AdvectRowAvx512: the same
+// steps on four or eight cells, with 32-bit tap indices.
+__attribute__((target("avx2"))) void AdvectRowAvx2(
+    const double* const* fields, double* const* outs, int count,
+    const double* u_y, const double* u_x, int y, int x0, int n, int cells_y,
+    int cells_x, float dt) {
+  const __m256d vdt = _mm256_set1_pd(dt);
+  const __m256d vone = _mm256_set1_pd(1.0);
+  const __m256d vhalf = _mm256_set1_pd(0.5);
+  const __m256d vy_max = _mm256_set1_pd(static_cast<double>(cells_y) - 2.0);
+  const __m256d vx_max = _mm256_set1_pd(static_cast<double>(cells_x) - 2.0);
+  const __m256d vy = _mm256_set1_pd(static_cast<double>(y) + 0.5);
+  const __m256d lanes = _mm256_setr_pd(0.0, 1.0, 2.0, 3.0);
+  const __m128i vstride = _mm_set1_epi32(cells_x);
+  // the gathers are masked with every lane on, from zero: the unmasked
+  // double forms start from an undefined vector that GCC warns about
+  const __m256d vzero = _mm256_setzero_pd();
+  const __m256d vall = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+  const int row = y * cells_x + x0;
+  int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m256d vx = _mm256_add_pd(
+        _mm256_add_pd(_mm256_set1_pd(static_cast<double>(x0 + i)), lanes),
+        vhalf);
+    __m256d py = _mm256_sub_pd(
+        vy, _mm256_mul_pd(vdt, _mm256_loadu_pd(u_y + row + i)));
+    __m256d px = _mm256_sub_pd(
+        vx, _mm256_mul_pd(vdt, _mm256_loadu_pd(u_x + row + i)));
+    py = _mm256_sub_pd(_mm256_max_pd(vone, _mm256_min_pd(py, vy_max)), vhalf);
+    px = _mm256_sub_pd(_mm256_max_pd(vone, _mm256_min_pd(px, vx_max)), vhalf);
+
+    __m256d fy = _mm256_floor_pd(py);
+    __m256d fx = _mm256_floor_pd(px);
+    __m256d ty = _mm256_sub_pd(py, fy);
+    __m256d tx = _mm256_sub_pd(px, fx);
+    __m256d wy = _mm256_sub_pd(vone, ty);
+    __m256d wx = _mm256_sub_pd(vone, tx);
+    __m128i index = _mm_add_epi32(
+        _mm_mullo_epi32(_mm256_cvttpd_epi32(fy), vstride),
+        _mm256_cvttpd_epi32(fx));
+
+    for (int f = 0; f < count; f++) {
+      const double* field = fields[f];
+      const double* below = field + cells_x;
+      __m256d tl = _mm256_mask_i32gather_pd(vzero, field, index, vall, 8);
+      __m256d tr = _mm256_mask_i32gather_pd(vzero, field + 1, index, vall, 8);
+      __m256d bl = _mm256_mask_i32gather_pd(vzero, below, index, vall, 8);
+      __m256d br = _mm256_mask_i32gather_pd(vzero, below + 1, index, vall, 8);
+      __m256d vl = _mm256_add_pd(_mm256_mul_pd(wy, tl), _mm256_mul_pd(ty, bl));
+      __m256d vr = _mm256_add_pd(_mm256_mul_pd(wy, tr), _mm256_mul_pd(ty, br));
+      _mm256_storeu_pd(outs[f] + row + i,
+                       _mm256_add_pd(_mm256_mul_pd(wx, vl),
+                                     _mm256_mul_pd(tx, vr)));
+    }
+  }
+  AdvectRowTail(fields, outs, count, u_y, u_x, y, x0, i, n, cells_y, cells_x,
+                dt);
+}
+
+__attribute__((target("avx512f"))) void AdvectRowAvx512(
+    const double* const* fields, double* const* outs, int count,
+    const double* u_y, const double* u_x, int y, int x0, int n, int cells_y,
+    int cells_x, float dt) {
+  const __m512d vdt = _mm512_set1_pd(dt);
+  const __m512d vone = _mm512_set1_pd(1.0);
+  const __m512d vhalf = _mm512_set1_pd(0.5);
+  const __m512d vy_max = _mm512_set1_pd(static_cast<double>(cells_y) - 2.0);
+  const __m512d vx_max = _mm512_set1_pd(static_cast<double>(cells_x) - 2.0);
+  const __m512d vy = _mm512_set1_pd(static_cast<double>(y) + 0.5);
+  const __m512d lanes =
+      _mm512_setr_pd(0.0, 1.0, 2.0, 3.0, 4.0, 5.0, 6.0, 7.0);
+  const __m256i vstride = _mm256_set1_epi32(cells_x);
+  const __m512d vzero = _mm512_setzero_pd();
+  const int kFloor = _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC;
+  const int row = y * cells_x + x0;
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m512d vx = _mm512_add_pd(
+        _mm512_add_pd(_mm512_set1_pd(static_cast<double>(x0 + i)), lanes),
+        vhalf);
+    __m512d py = _mm512_sub_pd(
+        vy, _mm512_mul_pd(vdt, _mm512_loadu_pd(u_y + row + i)));
+    __m512d px = _mm512_sub_pd(
+        vx, _mm512_mul_pd(vdt, _mm512_loadu_pd(u_x + row + i)));
+    py = _mm512_sub_pd(_mm512_maskz_max_pd(kAll8, vone, _mm512_maskz_min_pd(kAll8, py, vy_max)),
+                       vhalf);
+    px = _mm512_sub_pd(_mm512_maskz_max_pd(kAll8, vone, _mm512_maskz_min_pd(kAll8, px, vx_max)),
+                       vhalf);
+
+    __m512d fy = _mm512_maskz_roundscale_pd(kAll8, py, kFloor);
+    __m512d fx = _mm512_maskz_roundscale_pd(kAll8, px, kFloor);
+    __m512d ty = _mm512_sub_pd(py, fy);
+    __m512d tx = _mm512_sub_pd(px, fx);
+    __m512d wy = _mm512_sub_pd(vone, ty);
+    __m512d wx = _mm512_sub_pd(vone, tx);
+    __m256i index = _mm256_add_epi32(
+        _mm256_mullo_epi32(_mm512_maskz_cvttpd_epi32(kAll8, fy), vstride),
+        _mm512_maskz_cvttpd_epi32(kAll8, fx));
+
+    for (int f = 0; f < count; f++) {
+      const double* field = fields[f];
+      const double* below = field + cells_x;
+      __m512d tl = _mm512_mask_i32gather_pd(vzero, kAll8, index, field, 8);
+      __m512d tr = _mm512_mask_i32gather_pd(vzero, kAll8, index, field + 1, 8);
+      __m512d bl = _mm512_mask_i32gather_pd(vzero, kAll8, index, below, 8);
+      __m512d br = _mm512_mask_i32gather_pd(vzero, kAll8, index, below + 1, 8);
+      __m512d vl = _mm512_add_pd(_mm512_mul_pd(wy, tl), _mm512_mul_pd(ty, bl));
+      __m512d vr = _mm512_add_pd(_mm512_mul_pd(wy, tr), _mm512_mul_pd(ty, br));
+      _mm512_storeu_pd(outs[f] + row + i,
+                       _mm512_add_pd(_mm512_mul_pd(wx, vl),
+                                     _mm512_mul_pd(tx, vr)));
+    }
+  }
+  AdvectRowTail(fields, outs, count, u_y, u_x, y, x0, i, n, cells_y, cells_x,
+                dt);
+}
+#endif
+}  // namespace
+
+template <>
+AdvectRowKernel GetAdvectRowKernel<float>(SimdLevel level) {
+#ifdef GLOO_SIMD_X86
+  switch (ClampSimdLevel(level)) {
+    case SimdLevel::Avx512:
+      return AdvectRowAvx512;
+    case SimdLevel::Avx2:
+      return AdvectRowAvx2;
+    case SimdLevel::Sse42:
+      return AdvectRowSse42;
+    case SimdLevel::Scalar:
+      break;
+  }
+#endif
+  return AdvectRowScalar<float>;
+}
+
+template <>
+BasicAdvectRowKernel<double> GetAdvectRowKernel<double>(SimdLevel level) {
+#ifdef GLOO_SIMD_X86
+  switch (ClampSimdLevel(level)) {
+    case SimdLevel::Avx512:
+      return AdvectRowAvx512;
+    case SimdLevel::Avx2:
+      return AdvectRowAvx2;
+    case SimdLevel::Sse42:
+    case SimdLevel::Scalar:
+      break;
+  }
+#endif
+  return AdvectRowScalar<double>;
+}
+
+template <>
+AdvectRowKernel GetCubicAdvectRowKernel<float>(SimdLevel level) {
+#ifdef GLOO_SIMD_X86
+  switch (ClampSimdLevel(level)) {
+    case SimdLevel::Avx512:
+      return AdvectCubicRowAvx512;
+    case SimdLevel::Avx2:
+      return AdvectCubicRowAvx2;
+    case SimdLevel::Sse42:
+    case SimdLevel::Scalar:
+      break;
+  }
+#endif
+  return AdvectCubicRowScalar<float>;
+}
+
+template <>
+BasicAdvectRowKernel<double> GetCubicAdvectRowKernel<double>(SimdLevel) {
+  return AdvectCubicRowScalar<double>;
+}
+
+template <typename Real>
+BasicAdvectRowKernel<Real> GetPeriodicAdvectRowKernel() {
+  return AdvectPeriodicRowScalar<Real>;
+}
+
+template AdvectRowKernel GetPeriodicAdvectRowKernel<float>();
+template BasicAdvectRowKernel<double> GetPeriodicAdvectRowKernel<double>();
+
+template <>
+PackedAdvectRowKernel GetPackedAdvectRowKernel<float>(ScalarStorage storage,
+                                                      SimdLevel level) {
+  const bool half = storage == ScalarStorage::Float16;
+#ifdef GLOO_SIMD_X86
+  const SimdLevel clamped = ClampSimdLevel(level);
+  if (clamped == SimdLevel::Avx2 || clamped == SimdLevel::Avx512) {
+    if (!half) {
+      return AdvectBFloat16RowAvx2;
+    }
+    if (__builtin_cpu_supports("f16c")) {
+      return AdvectHalfRowAvx2;
+    }
+  }
+#endif
+  return half ? AdvectHalfRowScalar<float> : AdvectBFloat16RowScalar<float>;
+}
+
+template <>
+BasicPackedAdvectRowKernel<double> GetPackedAdvectRowKernel<double>(
+    ScalarStorage storage, SimdLevel) {
+  return storage == ScalarStorage::Float16 ? AdvectHalfRowScalar<double>
+                                           : AdvectBFloat16RowScalar<double>;
+}
+}  // namespace GLOO
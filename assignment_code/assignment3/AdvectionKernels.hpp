@@ -0,0 +1,78 @@
+#ifndef ADVECTION_KERNELS_H_
+#define ADVECTION_KERNELS_H_
+
+#include "Parameters.hpp"
+#include "Simd.hpp"
+#include <cstdint>
+
+namespace GLOO {
+// Semi-Lagrangian advection of the n cells (y, x0) ... (y, x0 + n - 1) of
+// a cells_y x cells_x grid: each cell centre is traced back by
+// dt * (u_y, u_x), clamped to [1, cells - 2] on both axes, and sampled
+// bilinearly, exactly like Fluid::lin_interp. The departure point and the
+// weights are computed once per cell and applied to all count fields:
+// fields[f] is sampled into outs[f]. All pointers are to whole grids of
+// Real, float or double.
+template <typename Real>
+using BasicAdvectRowKernel = void (*)(const Real* const* fields,
+                                      Real* const* outs, int count,
+                                      const Real* u_y, const Real* u_x,
+                                      int y, int x0, int n, int cells_y,
+                                      int cells_x, float dt);
+typedef BasicAdvectRowKernel<float> AdvectRowKernel;
+
+// The kernel for level, or for the widest supported level below it. The
+// double kernels gather half as many cells per vector; SSE4.2 has no
+// gather and uses the scalar kernel for doubles.
+template <typename Real>
+BasicAdvectRowKernel<Real> GetAdvectRowKernel(SimdLevel level);
+template <>
+AdvectRowKernel GetAdvectRowKernel<float>(SimdLevel level);
+template <>
+BasicAdvectRowKernel<double> GetAdvectRowKernel<double>(SimdLevel level);
+
+// Same interface, sampling with a clamped Catmull-Rom cubic instead: the
+// 4x4 taps around the departure point are filtered along x, then y, and the
+// result is clamped to the four bilinear taps so that no new extrema
+// appear. SSE4.2 has no gather and uses the scalar kernel, and so do
+// doubles.
+template <typename Real>
+BasicAdvectRowKernel<Real> GetCubicAdvectRowKernel(SimdLevel level);
+template <>
+AdvectRowKernel GetCubicAdvectRowKernel<float>(SimdLevel level);
+template <>
+BasicAdvectRowKernel<double> GetCubicAdvectRowKernel<double>(SimdLevel level);
+
+// Bilinear advection on a periodic grid (WallCondition::Periodic): the
+// departure point wraps around the interior, and the ghost ring must hold
+// the periodic images of the opposite edges. Scalar only.
+template <typename Real>
+BasicAdvectRowKernel<Real> GetPeriodicAdvectRowKernel();
+
+// Bilinear advection of one field stored in a 16-bit ScalarStorage format:
+// the taps are decoded to Real, sampled as above, multiplied by scale and
+// rounded back to nearest even. The velocity stays in Real.
+template <typename Real>
+using BasicPackedAdvectRowKernel = void (*)(const uint16_t* field,
+                                            uint16_t* out, const Real* u_y,
+                                            const Real* u_x, int y, int x0,
+                                            int n, int cells_y, int cells_x,
+                                            float dt, float scale);
+typedef BasicPackedAdvectRowKernel<float> PackedAdvectRowKernel;
+
+// The kernel for storage (Float16 or BFloat16) at level or below. The
+// Float16 vector kernel needs F16C besides AVX2; AVX-512 uses the AVX2
+// kernels, as the gathers of 16-bit pairs do not widen further. With a
+// double velocity the kernels are scalar.
+template <typename Real>
+BasicPackedAdvectRowKernel<Real> GetPackedAdvectRowKernel(
+    ScalarStorage storage, SimdLevel level);
+template <>
+PackedAdvectRowKernel GetPackedAdvectRowKernel<float>(ScalarStorage storage,
+                                                      SimdLevel level);
+template <>
+BasicPackedAdvectRowKernel<double> GetPackedAdvectRowKernel<double>(
+    ScalarStorage storage, SimdLevel level);
+}  // namespace GLOO
+
+#endif
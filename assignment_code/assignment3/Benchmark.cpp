@@ -0,0 +1,236 @@
+#include "Benchmark.hpp"
+
+#include "AdvectionKernels.hpp"
+#include "Field2D.hpp"
+#include "Fluid.hpp"
+#include "gloo/utils.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+namespace GLOO {
+namespace {
+// Each measurement repeats whole-grid sweeps for at least this long.
+const double kMinSeconds = 0.2;
+
+template <typename Real>
+double SecondsPerSweep(BasicAdvectRowKernel<Real> kernel, const Real* const* fields,
+                       Real* const* outs, int count, const BasicField2D<Real>& u_y,
+                       const BasicField2D<Real>& u_x, float dt) {
+  using Clock = std::chrono::steady_clock;
+  const int cells_y = u_y.cells_y();
+  const int cells_x = u_y.cells_x();
+  auto sweep = [&]() {
+    for (int y = 1; y < cells_y - 1; y++) {
+      kernel(fields, outs, count, u_y.data(), u_x.data(), y, 1, cells_x - 2,
+             cells_y, cells_x, dt);
+    }
+  };
+  // first touch and warm-up
+  sweep();
+  int sweeps = 0;
+  Clock::time_point start = Clock::now();
+  double elapsed = 0.0;
+  while (elapsed < kMinSeconds) {
+    sweep();
+    sweeps++;
+    elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+  }
+  return elapsed / sweeps;
+}
+
+// The rows of RunAdvectionBenchmark for one precision.
+template <typename Real>
+void TimeAdvectionKernels(const SimulationConfig& config, const char* precision,
+                          std::ostream& out) {
+  typedef BasicField2D<Real> Field;
+  const int cells_y = config.cells_y;
+  const int cells_x = config.cells_x;
+  const int kMaxFields = 3;
+
+  // a vortex around the centre, moving up to about four cells per step,
+  // and smooth fields so both samplers see realistic data
+  Field u_y(cells_y, cells_x);
+  Field u_x(cells_y, cells_x);
+  std::vector<std::unique_ptr<Field>> fields;
+  std::vector<std::unique_ptr<Field>> outs;
+  for (int f = 0; f < kMaxFields; f++) {
+    fields.push_back(make_unique<Field>(cells_y, cells_x));
+    outs.push_back(make_unique<Field>(cells_y, cells_x));
+  }
+  const float radius = 0.5f * static_cast<float>(std::min(cells_y, cells_x));
+  for (int y = 0; y < cells_y; y++) {
+    for (int x = 0; x < cells_x; x++) {
+      const int i = y * cells_x + x;
+      const float dy = (static_cast<float>(y) - 0.5f * cells_y) / radius;
+      const float dx = (static_cast<float>(x) - 0.5f * cells_x) / radius;
+      u_y[i] = 4.0f * dx;
+      u_x[i] = -4.0f * dy;
+      for (int f = 0; f < kMaxFields; f++) {
+        (*fields[f])[i] = std::sin(8.0f * dy + f) * std::cos(8.0f * dx);
+      }
+    }
+  }
+  std::vector<const Real*> in_grids;
+  std::vector<Real*> out_grids;
+  for (int f = 0; f < kMaxFields; f++) {
+    in_grids.push_back(fields[f]->data());
+    out_grids.push_back(outs[f]->data());
+  }
+
+  const double interior = static_cast<double>(cells_y - 2) * (cells_x - 2);
+  const SimdLevel widest = DetectSimdLevel();
+  for (int cubic = 0; cubic < 2; cubic++) {
+    for (int level = 0; level <= static_cast<int>(widest); level++) {
+      const SimdLevel simd = static_cast<SimdLevel>(level);
+      BasicAdvectRowKernel<Real> kernel = cubic ? GetCubicAdvectRowKernel<Real>(simd)
+                                                : GetAdvectRowKernel<Real>(simd);
+      double one = SecondsPerSweep(kernel, in_grids.data(), out_grids.data(),
+                                   1, u_y, u_x, config.dt);
+      double three = SecondsPerSweep(kernel, in_grids.data(),
+                                     out_grids.data(), kMaxFields, u_y, u_x,
+                                     config.dt);
+      char line[128];
+      std::snprintf(line, sizeof(line), "%-9s %-9s %-8s %7.2f  %8.2f",
+                    precision, cubic ? "cubic" : "bilinear", GetSimdLevelName(simd),
+                    one * 1e9 / interior,
+                    three * 1e9 / (interior * kMaxFields));
+      out << line << std::endl;
+    }
+  }
+}
+
+// Runs the SimulationApp scene for steps steps on a BasicFluid<Real> and
+// returns the seconds taken; the final density is stored in density.
+template <typename Real>
+double RunScene(const SimulationConfig& config, int steps, std::vector<double>& density) {
+  using Clock = std::chrono::steady_clock;
+  BasicFluid<Real> fluid(config);
+  const float add_amount = 0.3f * std::fmax(config.cells_x, config.cells_y);
+  for (int y = 0; y < config.cells_y; y++) {
+    for (int x = 0; x < config.cells_x; x++) {
+      fluid.add_U_y_force_at(y, x, 10.f * 20);
+      fluid.add_U_x_force_at(y, x, 10.f * 20);
+      fluid.add_source_at(y, x, add_amount);
+    }
+  }
+  Clock::time_point start = Clock::now();
+  for (int i = 0; i < steps; i++) {
+    fluid.step();
+  }
+  const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+  density.resize(static_cast<size_t>(config.cells_y) * config.cells_x);
+  for (int y = 0; y < config.cells_y; y++) {
+    for (int x = 0; x < config.cells_x; x++) {
+      density[y * config.cells_x + x] = fluid.S_at(y, x);
+    }
+  }
+  return seconds;
+}
+
+// RunScene after a warm-up run, repeated kSceneRepeats times; returns the
+// median of the timed runs, which all leave the same density.
+template <typename Real>
+double MedianSceneSeconds(const SimulationConfig& config, int steps, std::vector<double>& density) {
+  const int kSceneRepeats = 5;
+  RunScene<Real>(config, steps, density);
+  std::vector<double> seconds(kSceneRepeats);
+  for (int r = 0; r < kSceneRepeats; r++) {
+    seconds[r] = RunScene<Real>(config, steps, density);
+  }
+  std::nth_element(seconds.begin(), seconds.begin() + kSceneRepeats / 2, seconds.end());
+  return seconds[kSceneRepeats / 2];
+}
+}  // namespace
+
+void RunAdvectionBenchmark(const SimulationConfig& config, std::ostream& out) {
+  out << "advection, " << config.cells_y << " x " << config.cells_x
+      << " cells, ns per cell and field" << std::endl;
+  out << "precision sampler   simd     1 field  3 fields" << std::endl;
+  TimeAdvectionKernels<float>(config, "float", out);
+  TimeAdvectionKernels<double>(config, "double", out);
+}
+
+void RunStorageBenchmark(const SimulationConfig& config, std::ostream& out) {
+  const int kSteps = 24;
+  const ScalarStorage storages[] = {ScalarStorage::Float32, ScalarStorage::Float16,
+                                    ScalarStorage::BFloat16};
+  const char* names[] = {"float32", "float16", "bfloat16"};
+  const int cells = config.cells_y * config.cells_x;
+  // every run must be allowed the 16-bit storage
+  SimulationConfig packed = config;
+  packed.density_storage = ScalarStorage::Float16;
+  CheckFluidConfig(packed, false);
+
+  out << "density storage, " << config.cells_y << " x " << config.cells_x
+      << " cells, " << kSteps << " steps" << std::endl;
+  out << "storage   ms/step  bytes     max error  rel L2     mass diff" << std::endl;
+  std::vector<double> reference;
+  for (int k = 0; k < 3; k++) {
+    SimulationConfig run = config;
+    run.density_storage = storages[k];
+    std::vector<double> density;
+    const double seconds = MedianSceneSeconds<float>(run, kSteps, density);
+    if (k == 0) {
+      reference = density;
+    }
+    double max_error = 0.0;
+    double error2 = 0.0;
+    double norm2 = 0.0;
+    double mass = 0.0;
+    double reference_mass = 0.0;
+    for (int i = 0; i < cells; i++) {
+      const double e = density[i] - reference[i];
+      max_error = std::max(max_error, std::fabs(e));
+      error2 += e * e;
+      norm2 += reference[i] * reference[i];
+      mass += density[i];
+      reference_mass += reference[i];
+    }
+    const int bytes = cells * (k > 0 ? 2 : 4);
+    char line[160];
+    std::snprintf(line, sizeof(line), "%-9s %7.2f  %-8d  %9.3g  %9.3g  %9.3g",
+                  names[k], seconds * 1e3 / kSteps, bytes, max_error,
+                  norm2 > 0.0 ? std::sqrt(error2 / norm2) : 0.0,
+                  reference_mass > 0.0 ? (mass - reference_mass) / reference_mass : 0.0);
+    out << line << std::endl;
+  }
+}
+
+void RunPrecisionBenchmark(const SimulationConfig& config, std::ostream& out) {
+  const int kSteps = 24;
+  const int cells = config.cells_y * config.cells_x;
+  std::vector<double> single;
+  std::vector<double> reference;
+  const double float_seconds = MedianSceneSeconds<float>(config, kSteps, single);
+  const double double_seconds = MedianSceneSeconds<double>(config, kSteps, reference);
+
+  double max_error = 0.0;
+  double error2 = 0.0;
+  double norm2 = 0.0;
+  for (int i = 0; i < cells; i++) {
+    const double e = single[i] - reference[i];
+    max_error = std::max(max_error, std::fabs(e));
+    error2 += e * e;
+    norm2 += reference[i] * reference[i];
+  }
+  out << "solver precision, " << config.cells_y << " x " << config.cells_x
+      << " cells, " << kSteps << " steps" << std::endl;
+  out << "precision ms/step  bytes/cell" << std::endl;
+  char line[160];
+  std::snprintf(line, sizeof(line), "%-9s %7.2f  %d", "float",
+                float_seconds * 1e3 / kSteps, static_cast<int>(sizeof(float)));
+  out << line << std::endl;
+  std::snprintf(line, sizeof(line), "%-9s %7.2f  %d", "double",
+                double_seconds * 1e3 / kSteps, static_cast<int>(sizeof(double)));
+  out << line << std::endl;
+  std::snprintf(line, sizeof(line), "float density against double: max error %.3g, rel L2 %.3g",
+                max_error, norm2 > 0.0 ? std::sqrt(error2 / norm2) : 0.0);
+  out << line << std::endl;
+}
+}  // namespace GLOO
@@ -0,0 +1,27 @@
+#ifndef BENCHMARK_H_
+#define BENCHMARK_H_
+
+#include "Parameters.hpp"
+#include <ostream>
+
+namespace GLOO {
+// Times the advection row kernels, single threaded, on a config.cells_y x
+// config.cells_x grid through a swirling velocity field, and prints the cost
+// per cell of every sampler and supported instruction set, for one field
+// and for three fields sharing the departure points, in float and double.
+void RunAdvectionBenchmark(const SimulationConfig& config, std::ostream& out);
+
+// Runs the app's 2D scene for 24 steps with the density stored in float32,
+// float16 and bfloat16, and prints the time per step (the median of five
+// runs after a warm-up run), the density's bytes and the error of the
+// 16-bit runs against the float32 one. Throws for settings that rule out
+// the 16-bit formats (see CheckFluidConfig).
+void RunStorageBenchmark(const SimulationConfig& config, std::ostream& out);
+
+// Runs the same scene with the float and the double solver, and prints the
+// time per step of both, timed like RunStorageBenchmark, and the
+// difference of the float density from the double one.
+void RunPrecisionBenchmark(const SimulationConfig& config, std::ostream& out);
+}  // namespace GLOO
+
+#endif
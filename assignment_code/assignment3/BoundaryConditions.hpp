@@ -0,0 +1,122 @@
+#ifndef BOUNDARY_CONDITIONS_H_
+#define BOUNDARY_CONDITIONS_H_
+
+namespace GLOO {
+// What a 2D grid holds, which together with SimulationConfig::walls picks
+// its boundary policy. FaceY and FaceX are the velocity components of a
+// MAC grid (see VelocityLayout).
+enum class FieldKind {
+  Scalar,
+  VelocityY,
+  VelocityX,
+  FaceY,
+  FaceX,
+};
+
+// What a Fluid3D grid holds. Its walls are free slip: each velocity
+// component is reflected through the walls normal to it, and every other
+// ghost copies its neighbour. The policies below are 2D only, so Fluid3D
+// fills its ghost faces itself.
+enum class FieldKind3D {
+  Scalar,
+  VelocityZ,
+  VelocityY,
+  VelocityX,
+};
+
+// Boundary policies for a cell-centred cells_y x cells_x grid whose
+// outermost ring of cells are ghosts. Each policy is a type, so the fills
+// below compile to straight copies with the signs folded in:
+//   kSide is the sign of the copy into the left and right ghost columns,
+//   kEnd the sign of the copy into the top and bottom ghost rows, and
+//   kPeriodic makes every ghost copy the interior cell on the opposite
+//   side instead of its neighbour.
+// The fills take raw grids so the solvers can call them from inside their
+// sweeps, on the rows they just finished.
+
+// Zero normal derivative: scalars, the pressure, the divergence.
+struct NeumannScalar {
+  static constexpr int kSide = 1;
+  static constexpr int kEnd = 1;
+  static constexpr bool kPeriodic = false;
+};
+
+// Free slip for the y or the x velocity component: the component normal to
+// a wall is reflected through it, the tangential one is copied.
+struct FreeSlipY {
+  static constexpr int kSide = 1;
+  static constexpr int kEnd = -1;
+  static constexpr bool kPeriodic = false;
+};
+
+struct FreeSlipX {
+  static constexpr int kSide = -1;
+  static constexpr int kEnd = 1;
+  static constexpr bool kPeriodic = false;
+};
+
+// No slip: both velocity components vanish on every wall.
+struct NoSlip {
+  static constexpr int kSide = -1;
+  static constexpr int kEnd = -1;
+  static constexpr bool kPeriodic = false;
+};
+
+// Periodic in both directions, for any field.
+struct Periodic {
+  static constexpr int kSide = 1;
+  static constexpr int kEnd = 1;
+  static constexpr bool kPeriodic = true;
+};
+
+// Fills the left and right ghosts of row y.
+template <class Policy, typename Real>
+inline void FillSideGhosts(Real* field, int cells_x, int y) {
+  Real* row = field + y * cells_x;
+  if (Policy::kPeriodic) {
+    row[0] = row[cells_x - 2];
+    row[cells_x - 1] = row[1];
+  } else {
+    row[0] = static_cast<Real>(Policy::kSide) * row[1];
+    row[cells_x - 1] = static_cast<Real>(Policy::kSide) * row[cells_x - 2];
+  }
+}
+
+// Fills columns [x0, x1) of ghost row 0 (top) or cells_y - 1 (bottom).
+template <class Policy, typename Real>
+inline void FillEndGhosts(Real* field, int cells_y, int cells_x, int ghost_row,
+                          int x0, int x1) {
+  const bool top = ghost_row == 0;
+  const int source = Policy::kPeriodic ? (top ? cells_y - 2 : 1)
+                                       : (top ? 1 : cells_y - 2);
+  Real* row = field + ghost_row * cells_x;
+  const Real* from = field + source * cells_x;
+  const Real sign = static_cast<Real>(Policy::kEnd);
+  for (int x = x0; x < x1; x++) {
+    row[x] = sign * from[x];
+  }
+}
+
+// Fills the two corners of ghost row 0 or cells_y - 1, once the ghosts
+// next to them are set: with the average of those two, or with the
+// opposite interior corner when periodic.
+template <class Policy, typename Real>
+inline void FillCornerGhosts(Real* field, int cells_y, int cells_x,
+                             int ghost_row) {
+  const int s = cells_x;
+  const int last = cells_x - 1;
+  const bool top = ghost_row == 0;
+  Real* row = field + ghost_row * s;
+  if (Policy::kPeriodic) {
+    const Real* from = field + (top ? cells_y - 2 : 1) * s;
+    row[0] = from[last - 1];
+    row[last] = from[1];
+    return;
+  }
+  const Real* next = top ? row + s : row - s;
+  row[0] = (row[1] + next[0]) / 2.0f;
+  row[last] = (row[last - 1] + next[last]) / 2.0f;
+}
+}  // namespace GLOO
+
+#endif
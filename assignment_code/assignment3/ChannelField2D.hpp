@@ -0,0 +1,131 @@
+#ifndef CHANNEL_FIELD2D_H_
+#define CHANNEL_FIELD2D_H_
+
+#include <algorithm>
+#include <vector>
+
+namespace GLOO {
+// channels scalar grids of cells_y * cells_x values of type T, interleaved
+// as an array of structures of arrays. Each row is cut into blocks of
+// kLanes cells, and a block holds kLanes values of channel 0, then kLanes
+// of channel 1, and so on; the last block of a row is padded. Every
+// channel of a cell lies in the same block, so one pass over the grid
+// reads each cache line once however many channels there are, and each
+// channel of a block is one contiguous vector.
+template <typename T>
+class BasicChannelField2D {
+ public:
+  static const int kLanes = 8;
+
+  BasicChannelField2D(int cells_y, int cells_x, int channels)
+      : cells_y_(cells_y),
+        cells_x_(cells_x),
+        channels_(channels),
+        blocks_x_((cells_x + kLanes - 1) / kLanes),
+        data_(static_cast<size_t>(cells_y) * blocks_x_ * channels * kLanes, T(0)) {
+  }
+
+  // Fields are large; copying one is almost always a mistake.
+  BasicChannelField2D(const BasicChannelField2D&) = delete;
+  BasicChannelField2D& operator=(const BasicChannelField2D&) = delete;
+
+  int cells_y() const {
+    return cells_y_;
+  }
+
+  int cells_x() const {
+    return cells_x_;
+  }
+
+  int channels() const {
+    return channels_;
+  }
+
+  // blocks per row
+  int blocks_x() const {
+    return blocks_x_;
+  }
+
+  // Index of channel 0 of cell (y, x); channel c is c * kLanes further.
+  int Offset(int y, int x) const {
+    return (y * blocks_x_ + x / kLanes) * channels_ * kLanes + x % kLanes;
+  }
+
+  T& at(int channel, int y, int x) {
+    return data_[Offset(y, x) + channel * kLanes];
+  }
+
+  const T& at(int channel, int y, int x) const {
+    return data_[Offset(y, x) + channel * kLanes];
+  }
+
+  // First value of block b of row y.
+  T* block(int y, int b) {
+    return data_.data() + (static_cast<size_t>(y) * blocks_x_ + b) * channels_ * kLanes;
+  }
+
+  const T* block(int y, int b) const {
+    return data_.data() + (static_cast<size_t>(y) * blocks_x_ + b) * channels_ * kLanes;
+  }
+
+  T* data() {
+    return data_.data();
+  }
+
+  const T* data() const {
+    return data_.data();
+  }
+
+  void fill(T value) {
+    std::fill(data_.begin(), data_.end(), value);
+  }
+
+ private:
+  int cells_y_;
+  int cells_x_;
+  int channels_;
+  int blocks_x_;
+  std::vector<T> data_;
+};
+
+// BasicDoubleBuffer for BasicChannelField2D.
+template <typename T>
+class BasicChannelDoubleBuffer {
+ public:
+  BasicChannelDoubleBuffer(int cells_y, int cells_x, int channels)
+      : buffers_{{cells_y, cells_x, channels}, {cells_y, cells_x, channels}},
+        front_(&buffers_[0]),
+        back_(&buffers_[1]) {
+  }
+
+  BasicChannelDoubleBuffer(const BasicChannelDoubleBuffer&) = delete;
+  BasicChannelDoubleBuffer& operator=(const BasicChannelDoubleBuffer&) = delete;
+
+  BasicChannelField2D<T>& front() {
+    return *front_;
+  }
+
+  const BasicChannelField2D<T>& front() const {
+    return *front_;
+  }
+
+  BasicChannelField2D<T>& back() {
+    return *back_;
+  }
+
+  const BasicChannelField2D<T>& back() const {
+    return *back_;
+  }
+
+  void swap() {
+    std::swap(front_, back_);
+  }
+
+ private:
+  BasicChannelField2D<T> buffers_[2];
+  BasicChannelField2D<T>* front_;
+  BasicChannelField2D<T>* back_;
+};
+}  // namespace GLOO
+
+#endif
@@ -0,0 +1,326 @@
+#include "ChannelKernels.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#ifdef GLOO_SIMD_X86
+#include <immintrin.h>
+#endif
+
+namespace GLOO {
+namespace {
+template <typename Real>
+void AdvectChannelsScalar(const BasicChannelField2D<Real>& in,
+                          BasicChannelField2D<Real>& out, const Real* u_y,
+                          const Real* u_x, const Real* scale, int y0, int y1,
+                          int x0, int x1, float dt) {
+  const int lanes = BasicChannelField2D<Real>::kLanes;
+  const int cells_y = in.cells_y();
+  const int cells_x = in.cells_x();
+  const int channels = in.channels();
+  const Real y_max = static_cast<Real>(cells_y) - 2.0f;
+  const Real x_max = static_cast<Real>(cells_x) - 2.0f;
+  for (int y = y0; y < y1; y++) {
+    for (int x = x0; x < x1; x++) {
+      Real py = (static_cast<Real>(y) + 0.5f) - dt * u_y[y * cells_x + x];
+      Real px = (static_cast<Real>(x) + 0.5f) - dt * u_x[y * cells_x + x];
+      py = std::fmax(1.0f, std::fmin(y_max, py)) - 0.5f;
+      px = std::fmax(1.0f, std::fmin(x_max, px)) - 0.5f;
+
+      Real fy = std::floor(py);
+      Real fx = std::floor(px);
+      Real ty = py - fy;
+      Real tx = px - fx;
+      const int iy = static_cast<int>(fy);
+      const int ix = static_cast<int>(fx);
+      const int o0 = in.Offset(iy, ix);
+      const int o1 = in.Offset(iy, ix + 1);
+      const int o2 = in.Offset(iy + 1, ix);
+      const int o3 = in.Offset(iy + 1, ix + 1);
+      const Real w0 = (1.0f - ty) * (1.0f - tx);
+      const Real w1 = (1.0f - ty) * tx;
+      const Real w2 = ty * (1.0f - tx);
+      const Real w3 = ty * tx;
+      Real* o = out.data() + out.Offset(y, x);
+      for (int c = 0; c < channels; c++) {
+        const Real* src = in.data() + c * lanes;
+        o[c * lanes] = scale[c] * (w0 * src[o0] + w1 * src[o1] + w2 * src[o2] + w3 * src[o3]);
+      }
+    }
+  }
+}
+
+// Blocks go left to right; the lanes of a block are updated together from
+// their old values. Runs are separated by solid cells, so a block shared
+// by two runs gives the same result as one pass over it.
+template <typename Real>
+void RelaxChannelsScalar(BasicChannelField2D<Real>& field,
+                         const BasicChannelField2D<Real>& rhs, const Real* a,
+                         const Real* inv_b, int y, int x0, int x1) {
+  const int lanes = BasicChannelField2D<Real>::kLanes;
+  const int channels = field.channels();
+  const int blocks = field.blocks_x();
+  for (int b = x0 / lanes; b * lanes < x1; b++) {
+    // lanes of the block inside the run
+    const int lo = std::max(x0 - b * lanes, 0);
+    const int hi = std::min(x1 - b * lanes, lanes);
+    Real* cur = field.block(y, b);
+    const Real* up = field.block(y - 1, b);
+    const Real* down = field.block(y + 1, b);
+    const Real* prev = b > 0 ? field.block(y, b - 1) : nullptr;
+    const Real* next = b + 1 < blocks ? field.block(y, b + 1) : nullptr;
+    const Real* r = rhs.block(y, b);
+    for (int c = 0; c < channels; c++) {
+      // the channel's lanes with their left and right neighbours
+      Real row[lanes + 2];
+      row[0] = prev ? prev[c * lanes + lanes - 1] : Real(0);
+      std::copy(cur + c * lanes, cur + (c + 1) * lanes, row + 1);
+      row[lanes + 1] = next ? next[c * lanes] : Real(0);
+      for (int l = lo; l < hi; l++) {
+        const int i = c * lanes + l;
+        cur[i] = (r[i] + a[c] * (up[i] + down[i] + row[l] + row[l + 2])) * inv_b[c];
+      }
+    }
+  }
+}
+
+#ifdef GLOO_SIMD_X86
+// The scalar kernel with a block traced in one vector and each channel
+// sampled by four gathers that share the tap offsets. The lanes of the
+// end blocks outside the run are traced with zero velocity and masked out
+// of the stores.
+__attribute__((target("avx2"))) void AdvectChannelsAvx2(
+    const BasicChannelField2D<float>& in, BasicChannelField2D<float>& out,
+    const float* u_y, const float* u_x, const float* scale, int y0, int y1,
+    int x0, int x1, float dt) {
+  static_assert(BasicChannelField2D<float>::kLanes == 8, "one block per AVX2 vector");
+  const int cells_y = in.cells_y();
+  const int cells_x = in.cells_x();
+  const int channels = in.channels();
+  const int block_size = channels * 8;
+  const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  const __m256i before = _mm256_set1_epi32(x0 - 1);
+  const __m256i end = _mm256_set1_epi32(x1);
+  const __m256i seven = _mm256_set1_epi32(7);
+  const __m256i vblocks = _mm256_set1_epi32(in.blocks_x());
+  const __m256i vblock_size = _mm256_set1_epi32(block_size);
+  const __m256i row_size = _mm256_set1_epi32(in.blocks_x() * block_size);
+  const __m256 vdt = _mm256_set1_ps(dt);
+  const __m256 one = _mm256_set1_ps(1.0f);
+  const __m256 half = _mm256_set1_ps(0.5f);
+  const __m256 y_max = _mm256_set1_ps(static_cast<float>(cells_y) - 2.0f);
+  const __m256 x_max = _mm256_set1_ps(static_cast<float>(cells_x) - 2.0f);
+  for (int y = y0; y < y1; y++) {
+    const __m256 centre_y = _mm256_set1_ps(static_cast<float>(y) + 0.5f);
+    for (int b = x0 / 8; b * 8 < x1; b++) {
+      // lanes past the end of the row read the next row, which exists as
+      // y < cells_y - 1
+      const __m256i x = _mm256_add_epi32(_mm256_set1_epi32(b * 8), lane);
+      const __m256i inside =
+          _mm256_and_si256(_mm256_cmpgt_epi32(x, before), _mm256_cmpgt_epi32(end, x));
+      const bool whole = b * 8 >= x0 && b * 8 + 8 <= x1;
+      const __m256 vy = _mm256_and_ps(_mm256_castsi256_ps(inside),
+                                      _mm256_loadu_ps(u_y + y * cells_x + b * 8));
+      const __m256 vx = _mm256_and_ps(_mm256_castsi256_ps(inside),
+                                      _mm256_loadu_ps(u_x + y * cells_x + b * 8));
+      __m256 py = _mm256_sub_ps(centre_y, _mm256_mul_ps(vdt, vy));
+      __m256 px = _mm256_sub_ps(_mm256_add_ps(_mm256_cvtepi32_ps(x), half),
+                                _mm256_mul_ps(vdt, vx));
+      py = _mm256_sub_ps(_mm256_max_ps(one, _mm256_min_ps(py, y_max)), half);
+      px = _mm256_sub_ps(_mm256_max_ps(one, _mm256_min_ps(px, x_max)), half);
+
+      const __m256 fy = _mm256_floor_ps(py);
+      const __m256 fx = _mm256_floor_ps(px);
+      const __m256 ty = _mm256_sub_ps(py, fy);
+      const __m256 tx = _mm256_sub_ps(px, fx);
+      const __m256i iy = _mm256_cvttps_epi32(fy);
+      const __m256i ix = _mm256_cvttps_epi32(fx);
+      const __m256i ix1 = _mm256_add_epi32(ix, _mm256_set1_epi32(1));
+      // Offset(iy, x) for the two tap columns
+      const __m256i row = _mm256_mullo_epi32(iy, vblocks);
+      const __m256i o0 = _mm256_add_epi32(
+          _mm256_mullo_epi32(_mm256_add_epi32(row, _mm256_srli_epi32(ix, 3)), vblock_size),
+          _mm256_and_si256(ix, seven));
+      const __m256i o1 = _mm256_add_epi32(
+          _mm256_mullo_epi32(_mm256_add_epi32(row, _mm256_srli_epi32(ix1, 3)), vblock_size),
+          _mm256_and_si256(ix1, seven));
+      const __m256i o2 = _mm256_add_epi32(o0, row_size);
+      const __m256i o3 = _mm256_add_epi32(o1, row_size);
+      const __m256 w0 = _mm256_mul_ps(_mm256_sub_ps(one, ty), _mm256_sub_ps(one, tx));
+      const __m256 w1 = _mm256_mul_ps(_mm256_sub_ps(one, ty), tx);
+      const __m256 w2 = _mm256_mul_ps(ty, _mm256_sub_ps(one, tx));
+      const __m256 w3 = _mm256_mul_ps(ty, tx);
+
+      float* o = out.block(y, b);
+      for (int c = 0; c < channels; c++) {
+        const float* src = in.data() + c * 8;
+        __m256 v = _mm256_mul_ps(w0, _mm256_i32gather_ps(src, o0, 4));
+        v = _mm256_add_ps(v, _mm256_mul_ps(w1, _mm256_i32gather_ps(src, o1, 4)));
+        v = _mm256_add_ps(v, _mm256_mul_ps(w2, _mm256_i32gather_ps(src, o2, 4)));
+        v = _mm256_add_ps(v, _mm256_mul_ps(w3, _mm256_i32gather_ps(src, o3, 4)));
+        v = _mm256_mul_ps(_mm256_set1_ps(scale[c]), v);
+        if (whole) {
+          _mm256_storeu_ps(o + c * 8, v);
+        } else {
+          _mm256_maskstore_ps(o + c * 8, inside, v);
+        }
+      }
+    }
+  }
+}
+
+// RelaxChannelsScalar with each channel of a block in one vector; the
+// neighbour vectors are the block rotated by one lane, with the end lane
+// taken from the next block over.
+__attribute__((target("avx2"))) void RelaxChannelsAvx2(
+    BasicChannelField2D<float>& field, const BasicChannelField2D<float>& rhs,
+    const float* a, const float* inv_b, int y, int x0, int x1) {
+  const int channels = field.channels();
+  const int blocks = field.blocks_x();
+  const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  const __m256i before = _mm256_set1_epi32(x0 - 1);
+  const __m256i end = _mm256_set1_epi32(x1);
+  // lane l takes lane l - 1, or lane l + 1
+  const __m256i from_left = _mm256_setr_epi32(7, 0, 1, 2, 3, 4, 5, 6);
+  const __m256i from_right = _mm256_setr_epi32(1, 2, 3, 4, 5, 6, 7, 0);
+  for (int b = x0 / 8; b * 8 < x1; b++) {
+    const __m256i x = _mm256_add_epi32(_mm256_set1_epi32(b * 8), lane);
+    const __m256i inside =
+        _mm256_and_si256(_mm256_cmpgt_epi32(x, before), _mm256_cmpgt_epi32(end, x));
+    const bool whole = b * 8 >= x0 && b * 8 + 8 <= x1;
+    float* cur = field.block(y, b);
+    const float* up = field.block(y - 1, b);
+    const float* down = field.block(y + 1, b);
+    const float* prev = b > 0 ? field.block(y, b - 1) : nullptr;
+    const float* next = b + 1 < blocks ? field.block(y, b + 1) : nullptr;
+    const float* r = rhs.block(y, b);
+    for (int c = 0; c < channels; c++) {
+      const int i = c * 8;
+      const __m256 centre = _mm256_loadu_ps(cur + i);
+      const __m256 left = _mm256_blend_ps(_mm256_permutevar8x32_ps(centre, from_left),
+                                          _mm256_set1_ps(prev ? prev[i + 7] : 0.f), 0x01);
+      const __m256 right = _mm256_blend_ps(_mm256_permutevar8x32_ps(centre, from_right),
+                                           _mm256_set1_ps(next ? next[i] : 0.f), 0x80);
+      const __m256 sum = _mm256_add_ps(
+          _mm256_add_ps(_mm256_add_ps(_mm256_loadu_ps(up + i), _mm256_loadu_ps(down + i)), left),
+          right);
+      const __m256 fresh = _mm256_mul_ps(
+          _mm256_add_ps(_mm256_loadu_ps(r + i), _mm256_mul_ps(_mm256_set1_ps(a[c]), sum)),
+          _mm256_set1_ps(inv_b[c]));
+      if (whole) {
+        _mm256_storeu_ps(cur + i, fresh);
+      } else {
+        _mm256_maskstore_ps(cur + i, inside, fresh);
+      }
+    }
+  }
+}
+#endif
+}  // namespace
+
+template <>
+BasicChannelAdvectKernel<float> GetChannelAdvectKernel<float>(SimdLevel level) {
+#ifdef GLOO_SIMD_X86
+  switch (ClampSimdLevel(level)) {
+    case SimdLevel::Avx512:
+    case SimdLevel::Avx2:
+      return AdvectChannelsAvx2;
+    case SimdLevel::Sse42:
+    case SimdLevel::Scalar:
+      break;
+  }
+#endif
+  return AdvectChannelsScalar<float>;
+}
+
+template <>
+BasicChannelAdvectKernel<double> GetChannelAdvectKernel<double>(SimdLevel) {
+  return AdvectChannelsScalar<double>;
+}
+
+template <>
+BasicChannelRelaxKernel<float> GetChannelRelaxKernel<float>(SimdLevel level) {
+#ifdef GLOO_SIMD_X86
+  switch (ClampSimdLevel(level)) {
+    case SimdLevel::Avx512:
+    case SimdLevel::Avx2:
+      return RelaxChannelsAvx2;
+    case SimdLevel::Sse42:
+    case SimdLevel::Scalar:
+      break;
+  }
+#endif
+  return RelaxChannelsScalar<float>;
+}
+
+template <>
+BasicChannelRelaxKernel<double> GetChannelRelaxKernel<double>(SimdLevel) {
+  return RelaxChannelsScalar<double>;
+}
+
+template <typename Real>
+void FillChannelWalls(BasicChannelField2D<Real>& field, const ObstacleMap* obstacles) {
+  const int lanes = BasicChannelField2D<Real>::kLanes;
+  const int cells_y = field.cells_y();
+  const int cells_x = field.cells_x();
+  const int channels = field.channels();
+  if (obstacles) {
+    for (int open = 1; open < ObstacleMap::kNumBuckets; open++) {
+      const int neighbours[4][2] = {{-1, 0}, {1, 0}, {0, -1}, {0, 1}};
+      const int faces[4] = {ObstacleMap::kOpenUp, ObstacleMap::kOpenDown,
+                            ObstacleMap::kOpenLeft, ObstacleMap::kOpenRight};
+      int count = 0;
+      for (int f = 0; f < 4; f++) {
+        count += (open & faces[f]) != 0;
+      }
+      const Real share = Real(1) / static_cast<Real>(count);
+      for (int k : obstacles->GetBoundaryCells(open)) {
+        const int y = k / cells_x;
+        const int x = k % cells_x;
+        Real* cell = field.data() + field.Offset(y, x);
+        for (int c = 0; c < channels; c++) {
+          Real sum = 0;
+          for (int f = 0; f < 4; f++) {
+            if (open & faces[f]) {
+              sum += field.at(c, y + neighbours[f][0], x + neighbours[f][1]);
+            }
+          }
+          cell[c * lanes] = sum * share;
+        }
+      }
+    }
+  }
+  for (int y = 1; y < cells_y - 1; y++) {
+    for (int c = 0; c < channels; c++) {
+      field.at(c, y, 0) = field.at(c, y, 1);
+      field.at(c, y, cells_x - 1) = field.at(c, y, cells_x - 2);
+    }
+  }
+  // whole rows of blocks, corners included
+  std::copy(field.block(1, 0), field.block(2, 0), field.block(0, 0));
+  std::copy(field.block(cells_y - 2, 0), field.block(cells_y - 1, 0), field.block(cells_y - 1, 0));
+}
+
+template <typename Real>
+void AddChannelBuoyancy(const BasicChannelField2D<Real>& field, const Real* buoyancy,
+                        Real* u_y, int y, int x0, int x1, float dt) {
+  const int lanes = BasicChannelField2D<Real>::kLanes;
+  const int channels = field.channels();
+  Real* row = u_y + y * field.cells_x();
+  for (int x = x0; x < x1; x++) {
+    const Real* cell = field.data() + field.Offset(y, x);
+    Real force = 0;
+    for (int c = 0; c < channels; c++) {
+      force += buoyancy[c] * cell[c * lanes];
+    }
+    row[x] += dt * force;
+  }
+}
+
+template void FillChannelWalls<float>(BasicChannelField2D<float>&, const ObstacleMap*);
+template void FillChannelWalls<double>(BasicChannelField2D<double>&, const ObstacleMap*);
+template void AddChannelBuoyancy<float>(const BasicChannelField2D<float>&, const float*, float*,
+                                        int, int, int, float);
+template void AddChannelBuoyancy<double>(const BasicChannelField2D<double>&, const double*, double*,
+                                         int, int, int, float);
+}  // namespace GLOO
@@ -0,0 +1,68 @@
+#ifndef CHANNEL_KERNELS_H_
+#define CHANNEL_KERNELS_H_
+
+#include "ChannelField2D.hpp"
+#include "Obstacles.hpp"
+#include "Simd.hpp"
+
+namespace GLOO {
+// Semi-Lagrangian advection of every channel of cells [x0, x1) of rows
+// [y0, y1), traced and sampled like AdvectRowKernel, with channel c scaled
+// by scale[c] on the way out (the dissipation). The departure point and
+// weights of a cell are computed once and applied to each channel in turn,
+// so a channel adds arithmetic but no pass over memory. Only cells inside
+// the run are written; callers pass the fluid runs of each row, so solid
+// cells are skipped, and the walls fill the ghosts.
+template <typename Real>
+using BasicChannelAdvectKernel = void (*)(const BasicChannelField2D<Real>& in,
+                                          BasicChannelField2D<Real>& out,
+                                          const Real* u_y, const Real* u_x,
+                                          const Real* scale, int y0, int y1,
+                                          int x0, int x1, float dt);
+
+// The kernel for level, or for the widest supported level below it. The
+// float kernel gathers the taps of a block with AVX2, which AVX-512 also
+// uses; SSE4.2 and doubles use the scalar kernel.
+template <typename Real>
+BasicChannelAdvectKernel<Real> GetChannelAdvectKernel(SimdLevel level);
+template <>
+BasicChannelAdvectKernel<float> GetChannelAdvectKernel<float>(SimdLevel level);
+template <>
+BasicChannelAdvectKernel<double> GetChannelAdvectKernel<double>(SimdLevel level);
+
+// One Gauss-Seidel relaxation of cells [x0, x1) of interior row y of
+//
+//   x[c] = (rhs[c] + a[c] * (sum of the four neighbours)) * inv_b[c]
+//
+// for every channel c. Blocks go left to right; the lanes of a block are
+// updated together from their old values, so each channel of a block is
+// one vector operation. Callers pass the fluid runs of the row, so solid
+// cells are kept. The rows above and below are read, so rows of the same
+// parity can be relaxed concurrently.
+template <typename Real>
+using BasicChannelRelaxKernel = void (*)(BasicChannelField2D<Real>& field,
+                                         const BasicChannelField2D<Real>& rhs,
+                                         const Real* a, const Real* inv_b, int y,
+                                         int x0, int x1);
+
+// The kernel for level, picked like GetChannelAdvectKernel.
+template <typename Real>
+BasicChannelRelaxKernel<Real> GetChannelRelaxKernel(SimdLevel level);
+template <>
+BasicChannelRelaxKernel<float> GetChannelRelaxKernel<float>(SimdLevel level);
+template <>
+BasicChannelRelaxKernel<double> GetChannelRelaxKernel<double>(SimdLevel level);
+
+// Zero-gradient ghosts for every channel: the solid cells next to the
+// fluid from their open neighbours, then the ring like NeumannScalar.
+template <typename Real>
+void FillChannelWalls(BasicChannelField2D<Real>& field, const ObstacleMap* obstacles);
+
+// u_y += dt * sum over c of buoyancy[c] * field[c], on cells [x0, x1) of
+// row y of the grid u_y.
+template <typename Real>
+void AddChannelBuoyancy(const BasicChannelField2D<Real>& field, const Real* buoyancy,
+                        Real* u_y, int y, int x0, int x1, float dt);
+}  // namespace GLOO
+
+#endif
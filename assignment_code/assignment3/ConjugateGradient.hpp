@@ -0,0 +1,50 @@
+#ifndef CONJUGATE_GRADIENT_H_
+#define CONJUGATE_GRADIENT_H_
+
+#include "PoissonSolver.hpp"
+#include <vector>
+
+namespace GLOO {
+// Matrix-free preconditioned conjugate gradient for the 5-point operator.
+// The operator application, the vector updates, the dot products and the
+// Jacobi preconditioner are split over the thread pool by rows. The
+// incomplete-Cholesky triangular solves are sequential.
+template <typename Real>
+class ConjugateGradientSolver : public BasicPoissonSolver<Real> {
+ public:
+  ConjugateGradientSolver(const SimulationConfig& config, ThreadPool& pool);
+
+  void Solve(BasicField2D<Real>& x, const BasicField2D<Real>& rhs, Real a,
+             Real c) override;
+
+ private:
+  // out = A in over the interior. Fills the boundary ring of in first.
+  void ApplyOperator(Real* in, Real* out);
+  void ApplyPreconditioner(const Real* r, Real* z);
+  void BuildPreconditioner();
+  double Dot(const Real* u, const Real* v);
+  void RemoveMean(Real* v);
+
+  ThreadPool& pool_;
+  Preconditioner preconditioner_;
+  float tolerance_;
+  int max_iter_;
+  int cells_y_;
+  int cells_x_;
+
+  // operator of the current solve, and the one precon_ was built for
+  Real a_;
+  Real c_;
+  Real precon_a_;
+  Real precon_c_;
+
+  std::vector<Real> r_;
+  std::vector<Real> z_;
+  std::vector<Real> p_;
+  std::vector<Real> q_;
+  // 1/diag for Jacobi, or the factor's inverse pivots for IC(0)/MIC(0)
+  std::vector<Real> precon_;
+};
+}  // namespace GLOO
+
+#endif
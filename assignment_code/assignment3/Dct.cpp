@@ -0,0 +1,252 @@
+#include "Dct.hpp"
+
+#include <cmath>
+
+namespace GLOO {
+namespace {
+// std::complex multiplication checks for NaN/inf; the transforms do not
+// need that.
+template <typename Real>
+inline std::complex<Real> Mul(const std::complex<Real>& a,
+                              const std::complex<Real>& b) {
+  return std::complex<Real>(a.real() * b.real() - a.imag() * b.imag(),
+                            a.real() * b.imag() + a.imag() * b.real());
+}
+
+template <typename Real>
+std::complex<Real> UnitRoot(double turns) {
+  const double angle = -2.0 * 3.14159265358979323846 * turns;
+  return std::complex<Real>(static_cast<Real>(std::cos(angle)),
+                            static_cast<Real>(std::sin(angle)));
+}
+
+// Largest prime factor left to an O(n p) pass. Beyond it the three
+// power-of-two FFTs of the chirp convolution are cheaper.
+const int kMaxDirectRadix = 23;
+}  // namespace
+
+template <typename Real>
+FftPlan<Real>::FftPlan(int n) : n_(n), scratch_size_(1) {
+  int max_radix = 1;
+  int remaining = n;
+  int p = 4;
+  while (remaining > 1) {
+    while (remaining % p != 0) {
+      if (p == 4) {
+        p = 2;
+      } else if (p == 2) {
+        p = 3;
+      } else {
+        p += 2;
+      }
+      if (p * p > remaining) {
+        p = remaining;
+      }
+    }
+    remaining /= p;
+    factors_.push_back(p);
+    factors_.push_back(remaining);
+    if (p > max_radix) {
+      max_radix = p;
+    }
+  }
+
+  if (max_radix <= kMaxDirectRadix) {
+    twiddles_.resize(n);
+    for (int k = 0; k < n; k++) {
+      twiddles_[k] = UnitRoot<Real>(static_cast<double>(k) / n);
+    }
+    scratch_size_ = max_radix;
+    return;
+  }
+
+  // X[k] = conj(w[k]) sum_j (x[j] conj(w[j])) w[k - j] with
+  // w[j] = exp(i pi j^2 / n), a linear convolution of length 2n - 1.
+  int padded = 1;
+  while (padded < 2 * n - 1) {
+    padded *= 2;
+  }
+  factors_.clear();
+  padded_.reset(new FftPlan(padded));
+  chirp_.resize(n);
+  for (int j = 0; j < n; j++) {
+    // j^2 mod 2n keeps the angle accurate for large j
+    long long square = static_cast<long long>(j) * j % (2 * n);
+    chirp_[j] = UnitRoot<Real>(static_cast<double>(square) / (2.0 * n));
+  }
+  std::vector<Complex> wrapped(padded, Complex(0, 0));
+  for (int j = 0; j < n; j++) {
+    wrapped[j] = std::conj(chirp_[j]);
+    if (j > 0) {
+      wrapped[padded - j] = wrapped[j];
+    }
+  }
+  chirp_spectrum_.resize(padded);
+  std::vector<Complex> padded_scratch(padded_->GetScratchSize());
+  padded_->Forward(wrapped.data(), chirp_spectrum_.data(),
+                   padded_scratch.data());
+  const Real scale = Real(1) / padded;
+  for (Complex& value : chirp_spectrum_) {
+    value *= scale;
+  }
+  scratch_size_ = 2 * padded + padded_->GetScratchSize();
+}
+
+template <typename Real>
+void FftPlan<Real>::Forward(const Complex* in, Complex* out,
+                            Complex* scratch) const {
+  if (n_ == 1) {
+    out[0] = in[0];
+    return;
+  }
+  if (padded_) {
+    ForwardChirp(in, out, scratch);
+    return;
+  }
+  Work(out, in, 1, 0, scratch);
+}
+
+template <typename Real>
+void FftPlan<Real>::ForwardChirp(const Complex* in, Complex* out,
+                                 Complex* scratch) const {
+  const int padded = padded_->GetSize();
+  Complex* a = scratch;
+  Complex* spectrum = scratch + padded;
+  Complex* inner = scratch + 2 * padded;
+  for (int j = 0; j < n_; j++) {
+    a[j] = Mul(in[j], chirp_[j]);
+  }
+  for (int j = n_; j < padded; j++) {
+    a[j] = Complex(0, 0);
+  }
+  padded_->Forward(a, spectrum, inner);
+  // inverse FFT of the product as the conjugate of a forward one
+  for (int k = 0; k < padded; k++) {
+    spectrum[k] = std::conj(Mul(spectrum[k], chirp_spectrum_[k]));
+  }
+  padded_->Forward(spectrum, a, inner);
+  for (int k = 0; k < n_; k++) {
+    out[k] = Mul(chirp_[k], std::conj(a[k]));
+  }
+}
+
+template <typename Real>
+void FftPlan<Real>::Work(Complex* out, const Complex* in, int fstride,
+                         int factor, Complex* scratch) const {
+  const int p = factors_[2 * factor];
+  const int m = factors_[2 * factor + 1];
+  if (m == 1) {
+    for (int k = 0; k < p; k++) {
+      out[k] = in[k * fstride];
+    }
+  } else {
+    for (int q = 0; q < p; q++) {
+      Work(out + q * m, in + q * fstride, fstride * p, factor + 1, scratch);
+    }
+  }
+
+  // combine p sub-transforms of length m
+  const Complex* tw = twiddles_.data();
+  if (p == 2) {
+    for (int u = 0; u < m; u++) {
+      Complex t = Mul(out[u + m], tw[u * fstride]);
+      out[u + m] = out[u] - t;
+      out[u] += t;
+    }
+  } else if (p == 4) {
+    for (int u = 0; u < m; u++) {
+      Complex s0 = Mul(out[u + m], tw[u * fstride]);
+      Complex s1 = Mul(out[u + 2 * m], tw[2 * u * fstride]);
+      Complex s2 = Mul(out[u + 3 * m], tw[3 * u * fstride]);
+      Complex s5 = out[u] - s1;
+      Complex f0 = out[u] + s1;
+      Complex s3 = s0 + s2;
+      Complex s4 = s0 - s2;
+      out[u + 2 * m] = f0 - s3;
+      out[u] = f0 + s3;
+      out[u + m] = Complex(s5.real() + s4.imag(), s5.imag() - s4.real());
+      out[u + 3 * m] = Complex(s5.real() - s4.imag(), s5.imag() + s4.real());
+    }
+  } else {
+    for (int u = 0; u < m; u++) {
+      for (int q = 0; q < p; q++) {
+        scratch[q] = out[u + q * m];
+      }
+      for (int q1 = 0; q1 < p; q1++) {
+        int k = u + q1 * m;
+        int twidx = 0;
+        Complex sum = scratch[0];
+        for (int q = 1; q < p; q++) {
+          twidx += fstride * k;
+          if (twidx >= n_) {
+            twidx -= n_;
+          }
+          sum += Mul(scratch[q], tw[twidx]);
+        }
+        out[k] = sum;
+      }
+    }
+  }
+}
+
+template <typename Real>
+DctPlan<Real>::DctPlan(int n) : fft_(n) {
+  shift_.resize(n);
+  for (int k = 0; k < n; k++) {
+    shift_[k] = UnitRoot<Real>(static_cast<double>(k) / (4.0 * n));
+  }
+}
+
+template <typename Real>
+typename DctPlan<Real>::Workspace DctPlan<Real>::MakeWorkspace() const {
+  Workspace work;
+  work.v.resize(fft_.GetSize());
+  work.spectrum.resize(fft_.GetSize());
+  work.scratch.resize(fft_.GetScratchSize());
+  return work;
+}
+
+template <typename Real>
+void DctPlan<Real>::Forward(const Real* in, Real* out, Workspace& work) const {
+  const int n = fft_.GetSize();
+  Complex* v = work.v.data();
+  // even samples ascending, then odd samples descending
+  for (int j = 0; 2 * j < n; j++) {
+    v[j] = Complex(in[2 * j], Real(0));
+  }
+  for (int j = 0; 2 * j + 1 < n; j++) {
+    v[n - 1 - j] = Complex(in[2 * j + 1], Real(0));
+  }
+  fft_.Forward(v, work.spectrum.data(), work.scratch.data());
+  for (int k = 0; k < n; k++) {
+    out[k] = Mul(shift_[k], work.spectrum[k]).real();
+  }
+}
+
+template <typename Real>
+void DctPlan<Real>::Inverse(const Real* in, Real* out, Workspace& work) const {
+  const int n = fft_.GetSize();
+  Complex* spectrum = work.spectrum.data();
+  // Rebuild the FFT of the reordered signal, conjugated so that the forward
+  // FFT computes the inverse one.
+  for (int k = 0; k < n; k++) {
+    Real mirrored = k == 0 ? 0.f : in[n - k];
+    Complex value = Mul(std::conj(shift_[k]), Complex(in[k], -mirrored));
+    spectrum[k] = std::conj(value);
+  }
+  fft_.Forward(spectrum, work.v.data(), work.scratch.data());
+  const Real scale = Real(1) / n;
+  const Complex* v = work.v.data();
+  for (int j = 0; 2 * j < n; j++) {
+    out[2 * j] = v[j].real() * scale;
+  }
+  for (int j = 0; 2 * j + 1 < n; j++) {
+    out[2 * j + 1] = v[n - 1 - j].real() * scale;
+  }
+}
+
+template class FftPlan<float>;
+template class FftPlan<double>;
+template class DctPlan<float>;
+template class DctPlan<double>;
+}  // namespace GLOO
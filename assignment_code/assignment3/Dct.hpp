@@ -0,0 +1,88 @@
+#ifndef DCT_H_
+#define DCT_H_
+
+#include <complex>
+#include <memory>
+#include <vector>
+
+namespace GLOO {
+// Precomputed complex FFT of one length. Lengths are split into radix
+// 4, 2, 3, 5, ... passes, each costing O(n p). A length with a prime factor
+// above 23 is instead computed as a convolution with a chirp
+// (Bluestein's algorithm) through a power-of-two FFT of at least 2n - 1
+// points. Real is float or double.
+template <typename Real>
+class FftPlan {
+ public:
+  typedef std::complex<Real> Complex;
+
+  explicit FftPlan(int n);
+
+  int GetSize() const {
+    return n_;
+  }
+
+  // Number of Complex values the scratch argument must hold.
+  int GetScratchSize() const {
+    return scratch_size_;
+  }
+
+  // out = sum_j in[j] exp(-2 pi i j k / n), unnormalized. in and out must
+  // not overlap.
+  void Forward(const Complex* in, Complex* out, Complex* scratch) const;
+
+ private:
+  void Work(Complex* out, const Complex* in, int fstride, int factor,
+            Complex* scratch) const;
+  void ForwardChirp(const Complex* in, Complex* out, Complex* scratch) const;
+
+  int n_;
+  int scratch_size_;
+  // (radix, remaining length) pairs, outermost pass first
+  std::vector<int> factors_;
+  std::vector<Complex> twiddles_;
+
+  // Bluestein path, empty unless a prime factor exceeds 23.
+  // chirp_[j] = exp(-i pi j^2 / n); chirp_spectrum_ is the FFT of the
+  // conjugated, wrapped chirp divided by the padded length.
+  std::unique_ptr<FftPlan> padded_;
+  std::vector<Complex> chirp_;
+  std::vector<Complex> chirp_spectrum_;
+};
+
+// Precomputed real-to-real DCT-II of one length, computed with one complex
+// FFT of the same length (Makhoul's reordering).
+template <typename Real>
+class DctPlan {
+ public:
+  typedef std::complex<Real> Complex;
+
+  // Buffers for one transform at a time; use one per thread.
+  struct Workspace {
+    std::vector<Complex> v;
+    std::vector<Complex> spectrum;
+    std::vector<Complex> scratch;
+  };
+
+  explicit DctPlan(int n);
+
+  int GetSize() const {
+    return fft_.GetSize();
+  }
+
+  Workspace MakeWorkspace() const;
+
+  // out[k] = sum_j in[j] cos(pi k (j + 1/2) / n). in and out may alias.
+  void Forward(const Real* in, Real* out, Workspace& work) const;
+
+  // Exact inverse of Forward (a scaled DCT-III). in and out may alias.
+  void Inverse(const Real* in, Real* out, Workspace& work) const;
+
+ private:
+  FftPlan<Real> fft_;
+  // exp(-i pi k / 2n)
+  std::vector<Complex> shift_;
+};
+}  // namespace GLOO
+
+#endif
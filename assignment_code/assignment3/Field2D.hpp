@@ -0,0 +1,105 @@
+#ifndef FIELD2D_H_
+#define FIELD2D_H_
+
+#include <algorithm>
+#include <vector>
+
+namespace GLOO {
+// A row-major scalar grid of cells_y * cells_x values of type T. The
+// storage is allocated once on construction; solver kernels take fields by
+// reference so a simulation step never copies grid data.
+template <typename T>
+class BasicField2D {
+ public:
+  BasicField2D(int cells_y, int cells_x)
+      : cells_y_(cells_y), cells_x_(cells_x), data_(cells_y * cells_x, T(0)) {
+  }
+
+  // Fields are large; copying one is almost always a mistake.
+  BasicField2D(const BasicField2D&) = delete;
+  BasicField2D& operator=(const BasicField2D&) = delete;
+
+  int cells_y() const {
+    return cells_y_;
+  }
+
+  int cells_x() const {
+    return cells_x_;
+  }
+
+  T& operator[](int i) {
+    return data_[i];
+  }
+
+  const T& operator[](int i) const {
+    return data_[i];
+  }
+
+  T* data() {
+    return data_.data();
+  }
+
+  const T* data() const {
+    return data_.data();
+  }
+
+  int size() const {
+    return static_cast<int>(data_.size());
+  }
+
+  void fill(T value) {
+    std::fill(data_.begin(), data_.end(), value);
+  }
+
+ private:
+  int cells_y_;
+  int cells_x_;
+  std::vector<T> data_;
+};
+
+typedef BasicField2D<float> Field2D;
+
+// Ping-pong pair of fields. A kernel reads back() and writes front(); swap()
+// exchanges the two by pointer.
+template <typename T>
+class BasicDoubleBuffer {
+ public:
+  BasicDoubleBuffer(int cells_y, int cells_x)
+      : buffers_{{cells_y, cells_x}, {cells_y, cells_x}},
+        front_(&buffers_[0]),
+        back_(&buffers_[1]) {
+  }
+
+  BasicDoubleBuffer(const BasicDoubleBuffer&) = delete;
+  BasicDoubleBuffer& operator=(const BasicDoubleBuffer&) = delete;
+
+  BasicField2D<T>& front() {
+    return *front_;
+  }
+
+  const BasicField2D<T>& front() const {
+    return *front_;
+  }
+
+  BasicField2D<T>& back() {
+    return *back_;
+  }
+
+  const BasicField2D<T>& back() const {
+    return *back_;
+  }
+
+  void swap() {
+    std::swap(front_, back_);
+  }
+
+ private:
+  BasicField2D<T> buffers_[2];
+  BasicField2D<T>* front_;
+  BasicField2D<T>* back_;
+};
+
+typedef BasicDoubleBuffer<float> DoubleBuffer;
+}  // namespace GLOO
+
+#endif
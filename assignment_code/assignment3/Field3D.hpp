@@ -0,0 +1,105 @@
+#ifndef FIELD3D_H_
+#define FIELD3D_H_
+
+#include <algorithm>
+#include <vector>
+
+namespace GLOO {
+// A cells_z * cells_y * cells_x grid of floats, stored as consecutive z
+// slabs of row-major rows, so a 7-point stencil touches three slabs and a
+// pool task that owns a range of slabs works on contiguous memory.
+class Field3D {
+ public:
+  Field3D(int cells_z, int cells_y, int cells_x)
+      : cells_z_(cells_z),
+        cells_y_(cells_y),
+        cells_x_(cells_x),
+        data_(static_cast<size_t>(cells_z) * cells_y * cells_x, 0.f) {
+  }
+
+  Field3D(const Field3D&) = delete;
+  Field3D& operator=(const Field3D&) = delete;
+
+  int cells_z() const {
+    return cells_z_;
+  }
+
+  int cells_y() const {
+    return cells_y_;
+  }
+
+  int cells_x() const {
+    return cells_x_;
+  }
+
+  float& operator[](size_t i) {
+    return data_[i];
+  }
+
+  const float& operator[](size_t i) const {
+    return data_[i];
+  }
+
+  float* data() {
+    return data_.data();
+  }
+
+  const float* data() const {
+    return data_.data();
+  }
+
+  size_t size() const {
+    return data_.size();
+  }
+
+  void fill(float value) {
+    std::fill(data_.begin(), data_.end(), value);
+  }
+
+ private:
+  int cells_z_;
+  int cells_y_;
+  int cells_x_;
+  std::vector<float> data_;
+};
+
+// DoubleBuffer for Field3D.
+class DoubleBuffer3D {
+ public:
+  DoubleBuffer3D(int cells_z, int cells_y, int cells_x)
+      : buffers_{{cells_z, cells_y, cells_x}, {cells_z, cells_y, cells_x}},
+        front_(&buffers_[0]),
+        back_(&buffers_[1]) {
+  }
+
+  DoubleBuffer3D(const DoubleBuffer3D&) = delete;
+  DoubleBuffer3D& operator=(const DoubleBuffer3D&) = delete;
+
+  Field3D& front() {
+    return *front_;
+  }
+
+  const Field3D& front() const {
+    return *front_;
+  }
+
+  Field3D& back() {
+    return *back_;
+  }
+
+  const Field3D& back() const {
+    return *back_;
+  }
+
+  void swap() {
+    std::swap(front_, back_);
+  }
+
+ private:
+  Field3D buffers_[2];
+  Field3D* front_;
+  Field3D* back_;
+};
+}  // namespace GLOO
+
+#endif
@@ -1,144 +1,1158 @@
 #include "Fluid.hpp"
 #include "Parameters.hpp"
-#include <vector>
+#include "gloo/Image.hpp"
+#include "gloo/utils.hpp"
+
+#include <stdexcept>
 
 namespace GLOO {
+namespace {
+const int kBoundaryGrain = 4096;
 
-Fluid::Fluid(){
-  // std::cout << num_cells << std::endl;
-  for (int i=0; i<num_cells; i++){
-    U0_y.push_back(0.f);
-    U0_x.push_back(0.f);
-    U1_y.push_back(0.f);
-    U1_x.push_back(0.f);
-    S0.push_back(0.f);
-    S1.push_back(0.f);
+// The obstacles handed to the constructor, else those of
+// config.obstacle_image, oriented like the saved frames; null when there
+// are none. Checks config first, as this builds the first member that
+// depends on it.
+std::unique_ptr<ObstacleMap> MakeObstacles(const SimulationConfig& config,
+                                           std::unique_ptr<ObstacleMap> obstacles) {
+  CheckFluidConfig(config, obstacles || !config.obstacle_image.empty());
+  if (!obstacles && !config.obstacle_image.empty()) {
+    obstacles = ObstacleMap::FromImage(*Image::LoadPNG(config.obstacle_image, false),
+                                       config.cells_y, config.cells_x, true);
+  }
+  if (!obstacles) {
+    return obstacles;
+  }
+  if (obstacles->cells_y() != config.cells_y || obstacles->cells_x() != config.cells_x) {
+    throw std::runtime_error("The obstacle map does not match the grid.");
   }
-  // std::cout << U0_y.size() << std::endl;
+  obstacles->Build();
+  return obstacles;
 }
+}  // namespace
 
-void Fluid::swap_grids() {
-    std::vector<float> temp;
-    temp = U0_y; U0_y = U1_y; U1_y = temp;
-    temp = U0_x; U0_x = U1_x; U1_x = temp;
-    S1 = S0;
+void CheckFluidConfig(const SimulationConfig& config, bool obstacles) {
+  const bool collocated = config.velocity_layout == VelocityLayout::Collocated;
+  const bool periodic = config.walls == WallCondition::Periodic;
+  const bool semi_lagrangian = config.velocity_advection == AdvectionScheme::SemiLagrangian &&
+                               config.density_advection == AdvectionScheme::SemiLagrangian;
+  // the backends other than Gauss-Seidel assume a plain box
+  const bool gauss_seidel = config.pressure_solver == LinearSolverType::GaussSeidel &&
+                            config.diffusion_solver == LinearSolverType::GaussSeidel;
+  if (periodic && !collocated) {
+    throw std::runtime_error("Periodic walls need the collocated layout.");
+  }
+  if (periodic && !gauss_seidel) {
+    throw std::runtime_error("Periodic walls need the gauss-seidel solver.");
+  }
+  if (periodic && config.advection_sampler != AdvectionSampler::Bilinear) {
+    throw std::runtime_error("Periodic walls need the bilinear sampler.");
+  }
+  if (config.fused_advection && !collocated) {
+    throw std::runtime_error("Fused advection needs the collocated layout.");
+  }
+  if (config.vorticity_confinement > 0.f && !collocated) {
+    throw std::runtime_error("Vorticity confinement needs the collocated layout.");
+  }
+  if (obstacles && !collocated) {
+    throw std::runtime_error("Obstacles need the collocated layout.");
+  }
+  if (obstacles && !gauss_seidel) {
+    throw std::runtime_error("Obstacles need the gauss-seidel solver.");
+  }
+  if (!config.scalar_channels.empty() && (!collocated || periodic)) {
+    throw std::runtime_error("Scalar channels need the collocated layout and non-periodic walls.");
+  }
+  // the other backends solve, and write, the whole grid
+  if (config.sparse_tile_size > 0 && !gauss_seidel) {
+    throw std::runtime_error("Block-sparse mode needs the gauss-seidel solver.");
+  }
+  if (config.sparse_tile_size > 0 &&
+      (!collocated || periodic || obstacles || !config.scalar_channels.empty() ||
+       config.fused_advection || config.task_graph || !semi_lagrangian)) {
+    throw std::runtime_error("Block-sparse mode needs the collocated layout, non-periodic walls, "
+                             "no obstacles or channels, unfused semi-Lagrangian advection and "
+                             "the sequential step.");
+  }
+  // the packed density has its own advection kernel, so every other path
+  // that touches S must be off
+  if (config.density_storage != ScalarStorage::Float32 &&
+      (!collocated || !semi_lagrangian || config.advection_sampler != AdvectionSampler::Bilinear ||
+       config.fused_advection || config.task_graph || config.sparse_tile_size > 0 ||
+       config.diffusion > 0.f || periodic || obstacles)) {
+    throw std::runtime_error("16-bit density storage needs the collocated layout, bilinear "
+                             "semi-Lagrangian advection without fusion, the sequential dense "
+                             "step, no density diffusion, non-periodic walls and no obstacles.");
+  }
 }
 
-void Fluid::step() {
-  v_step(U1_y, U1_x, U0_y, U0_x);
-  s_step(S1, S0, U0_y, U0_x);
-  swap_grids();
+template <typename Real>
+BasicFluid<Real>::BasicFluid(const SimulationConfig& config, std::unique_ptr<ObstacleMap> obstacles)
+    : config(config),
+      cells_y(config.cells_y),
+      cells_x(config.cells_x),
+      num_cells(config.cells_y * config.cells_x),
+      obstacles(MakeObstacles(config, std::move(obstacles))),
+      U_y(cells_y, cells_x),
+      U_x(cells_y, cells_x),
+      packed_density(config.density_storage != ScalarStorage::Float32),
+      S(packed_density ? 1 : cells_y, packed_density ? 1 : cells_x),
+      channels_diffuse(false),
+      channels_buoyant(false),
+      staggered(config.velocity_layout == VelocityLayout::Staggered),
+      kind_y(staggered ? FieldKind::FaceY : FieldKind::VelocityY),
+      kind_x(staggered ? FieldKind::FaceX : FieldKind::VelocityX),
+      no_slip(config.walls == WallCondition::NoSlip),
+      periodic(config.walls == WallCondition::Periodic),
+      fuse_advection(config.fused_advection),
+      confine(config.vorticity_confinement > 0.f),
+      pressure(cells_y, cells_x),
+      divergence(cells_y, cells_x),
+      pool(config.num_threads, config.pin_threads, config.grain_size),
+      sweep_barrier(pool.GetNumThreads()),
+      pressure_solver(CreatePoissonSolver<Real>(config.pressure_solver, config, pool)),
+      diffusion_solver(CreatePoissonSolver<Real>(config.diffusion_solver, config, pool)),
+      advect_row(periodic ? GetPeriodicAdvectRowKernel<Real>()
+                 : config.advection_sampler == AdvectionSampler::Cubic
+                     ? GetCubicAdvectRowKernel<Real>(DetectSimdLevel())
+                     : GetAdvectRowKernel<Real>(DetectSimdLevel())),
+      packed_advect_row(nullptr),
+      confine_row(GetConfineRowKernel<Real>(DetectSimdLevel())),
+      channel_advect(GetChannelAdvectKernel<Real>(DetectSimdLevel())),
+      channel_relax(GetChannelRelaxKernel<Real>(DetectSimdLevel())),
+      graph_velocity_swaps(0) {
+  advected_scalars.push_back(&S);
+  if (!config.scalar_channels.empty()) {
+    channels = make_unique<BasicChannelDoubleBuffer<Real>>(
+        cells_y, cells_x, static_cast<int>(config.scalar_channels.size()));
+    for (const ScalarChannel& channel : config.scalar_channels) {
+      const Real a = config.dt * channel.diffusion * num_cells;
+      channel_scale.push_back(1.0f / (1.0f + config.dt * channel.dissipation));
+      channel_a.push_back(a);
+      channel_inv_b.push_back(1.0f / (1.0f + 4.0f * a));
+      channel_buoyancy.push_back(channel.buoyancy);
+      channels_diffuse = channels_diffuse || channel.diffusion > 0.f;
+      channels_buoyant = channels_buoyant || channel.buoyancy != 0.f;
+    }
+  }
+  if (packed_density) {
+    packed_S = make_unique<PackedDoubleBuffer>(cells_y, cells_x, config.density_storage);
+    packed_advect_row = GetPackedAdvectRowKernel<Real>(config.density_storage, DetectSimdLevel());
+  }
+  if (config.sparse_tile_size > 0) {
+    tiles = make_unique<TileMap>(cells_y, cells_x, config.sparse_tile_size);
+  }
+  if (confine) {
+    confine_rows.resize(static_cast<size_t>(3 * pool.GetNumThreads()) * cells_x);
+  }
+  // v_step advects both velocity components together, and the scalars
+  // with them when fused
+  fused_kinds = {kind_y, kind_x};
+  fused_schemes.assign(2, config.velocity_advection);
+  if (fuse_advection) {
+    fused_kinds.resize(2 + advected_scalars.size(), FieldKind::Scalar);
+    fused_schemes.resize(2 + advected_scalars.size(), config.density_advection);
+  }
+  const size_t max_fields = fused_kinds.size();
+  fused_outs.resize(max_fields);
+  fused_ins.resize(max_fields);
+  transport_outs.resize(max_fields);
+  transport_ins.resize(max_fields);
+  group_outs.resize(max_fields);
+  group_ins.resize(max_fields);
+  group_kinds.resize(max_fields);
+  correct_outs.resize(max_fields);
+  correct_ins.resize(max_fields);
+  correct_back.resize(max_fields);
+  if (config.velocity_advection != AdvectionScheme::SemiLagrangian ||
+      config.density_advection != AdvectionScheme::SemiLagrangian) {
+    for (size_t i = 0; i < max_fields; i++) {
+      advect_scratch.push_back(make_unique<Field2D>(cells_y, cells_x));
+    }
+  }
+  if (staggered) {
+    u_x_at_y_faces = make_unique<Field2D>(cells_y, cells_x);
+    u_y_at_x_faces = make_unique<Field2D>(cells_y, cells_x);
+    u_y_at_centres = make_unique<Field2D>(cells_y, cells_x);
+    u_x_at_centres = make_unique<Field2D>(cells_y, cells_x);
+  }
 }
 
-void Fluid::add_U_y_force_at(int y, int x, float force) {
-    if (y > 0 && y < CELLS_Y - 1 && x > 0 && x < CELLS_X - 1) {
-        U1_y[IndexOf(y, x)] += force;
+template <typename Real>
+void BasicFluid<Real>::step() {
+  pressure_stats = SolverStats();
+  diffusion_stats = SolverStats();
+  if (!moving_obstacles.empty()) {
+    update_moving_obstacles();
+  }
+  if (config.task_graph) {
+    step_graph();
+    return;
+  }
+  if (tiles) {
+    update_tiles();
+  }
+  v_step(U_y, U_x);
+  s_step(S, U_y.front(), U_x.front());
+}
+
+// The same work as v_step() and s_step(), split into bands of rows so that
+// independent stages overlap: the density advection of a band starts as
+// soon as the final velocity of that band is known, and the two velocity
+// components diffuse side by side. The pressure solves cannot be split into
+// bands, so they run as parallel tasks that use the whole pool.
+//
+// The graph is built on the first call and run again every step. The
+// buffers are only swapped once it has run, so each task names its grids
+// as graph grids (see GraphGrid), rebound here to the buffers the
+// sequential step would use at that point.
+template <typename Real>
+void BasicFluid<Real>::step_graph() {
+  if (!graph) {
+    build_step_graph();
+  }
+  for (GraphGrid& grid : graph_grids) {
+    grid.field = grid.swaps % 2 == 0 ? &grid.buffer->front() : &grid.buffer->back();
+  }
+  for (size_t i = 0; i < graph_advect_in.size(); i++) {
+    graph_advect_in_fields[i] = graph_grids[graph_advect_in[i]].field;
+    graph_advect_out_fields[i] = graph_grids[graph_advect_out[i]].field;
+    graph_advect_in_data[i] = graph_advect_in_fields[i]->data();
+    graph_advect_out_data[i] = graph_advect_out_fields[i]->data();
+  }
+
+  graph->Run(pool);
+  step_report = graph->GetLastReport();
+
+  if (graph_velocity_swaps % 2 != 0) {
+    U_y.swap();
+    U_x.swap();
+  }
+  for (size_t i = 0; i < advected_scalars.size(); i++) {
+    if (graph_scalar_swaps[i] % 2 != 0) {
+      advected_scalars[i]->swap();
     }
+  }
 }
 
-void Fluid::add_U_x_force_at(int y, int x, float force) {
-    if (y > 0 && y < CELLS_Y - 1 && x > 0 && x < CELLS_X - 1) {
-        U1_x[IndexOf(y, x)] += force;
+template <typename Real>
+int BasicFluid<Real>::add_graph_grid(DoubleBuffer& buffer, int swaps) {
+  GraphGrid grid;
+  grid.buffer = &buffer;
+  grid.swaps = swaps;
+  grid.field = nullptr;
+  graph_grids.push_back(grid);
+  return static_cast<int>(graph_grids.size()) - 1;
+}
+
+template <typename Real>
+void BasicFluid<Real>::build_step_graph() {
+  typedef TaskGraph::Kind Kind;
+  graph = make_unique<TaskGraph>();
+  graph_grids.clear();
+  graph_velocity_swaps = 0;
+  graph_scalar_swaps.assign(advected_scalars.size(), 0);
+
+  const int interior = cells_y - 2;
+  int tiles = config.graph_tiles > 0 ? config.graph_tiles : 4 * pool.GetNumThreads();
+  tiles = std::max(1, std::min(tiles, interior));
+  std::vector<std::pair<int, int>> bands;
+  for (int t = 0; t < tiles; t++) {
+    bands.push_back(std::make_pair(1 + interior * t / tiles, 1 + interior * (t + 1) / tiles));
+  }
+  // a lexicographic Gauss-Seidel diffusion is sequential anyway, so it can
+  // share the pool with other tasks
+  const Kind diffuse_kind = !diffusion_solver && config.gauss_seidel_order == SweepOrder::Lexicographic
+                          ? Kind::Serial : Kind::Parallel;
+
+  // velocity
+  int uy = add_graph_grid(U_y, graph_velocity_swaps);
+  int ux = add_graph_grid(U_x, graph_velocity_swaps);
+  std::vector<int> after = {graph->AddTask("velocity walls", Kind::Serial, [=] {
+    set_boundary_values(graph_field(uy), kind_y);
+    set_boundary_values(graph_field(ux), kind_x);
+  })};
+  if (channels_buoyant) {
+    int buoyancy = graph->AddTask("buoyancy", Kind::Parallel, [=] {
+      add_buoyancy(graph_field(uy));
+    });
+    graph->AddDependency(buoyancy, after[0]);
+  }
+  if (confine) {
+    graph_velocity_swaps++;
+    int cy = add_graph_grid(U_y, graph_velocity_swaps);
+    int cx = add_graph_grid(U_x, graph_velocity_swaps);
+    int walls = graph->AddTask("confinement walls", Kind::Serial, [=] {
+      set_boundary_values(graph_field(cy), kind_y);
+      set_boundary_values(graph_field(cx), kind_x);
+    });
+    for (size_t t = 0; t < bands.size(); t++) {
+      const int y0 = bands[t].first;
+      const int y1 = bands[t].second;
+      int task = graph->AddTask("confine vorticity " + std::to_string(t), Kind::Serial, [=] {
+        // runs inline, passing the index of the thread running the task
+        pool.ParallelForChunks(y0, y1, [&](int thread, int r0, int r1) {
+          confine_vorticity_rows(graph_field(cy), graph_field(cx), graph_field(uy),
+                                 graph_field(ux), r0, r1, thread);
+        });
+      });
+      graph->AddDependency(after[0], task);
+      graph->AddDependency(task, walls);
+    }
+    after = {walls};
+    uy = cy;
+    ux = cx;
+  }
+  if (config.viscosity > 0.f) {
+    graph_velocity_swaps++;
+    int dy = add_graph_grid(U_y, graph_velocity_swaps);
+    int dx = add_graph_grid(U_x, graph_velocity_swaps);
+    int diffuse_y = graph->AddTask("diffuse U_y", diffuse_kind, [=] {
+      diffuse(graph_field(dy), graph_field(uy), config.viscosity, kind_y);
+    });
+    int diffuse_x = graph->AddTask("diffuse U_x", diffuse_kind, [=] {
+      diffuse(graph_field(dx), graph_field(ux), config.viscosity, kind_x);
+    });
+    graph->AddDependency(after[0], diffuse_y);
+    graph->AddDependency(after[0], diffuse_x);
+    after = {diffuse_y, diffuse_x};
+    uy = dy;
+    ux = dx;
+  }
+  GraphProjection first = add_projection_tasks(*graph, uy, ux, after, bands, "1");
+
+  const int old_uy = uy;
+  const int old_ux = ux;
+  graph_velocity_swaps++;
+  uy = add_graph_grid(U_y, graph_velocity_swaps);
+  ux = add_graph_grid(U_x, graph_velocity_swaps);
+  graph_advect_in = {old_uy, old_ux};
+  graph_advect_out = {uy, ux};
+  std::vector<FieldKind> advect_kinds = {kind_y, kind_x};
+  std::vector<AdvectionScheme> advect_schemes(2, config.velocity_advection);
+  if (fuse_advection) {
+    for (size_t i = 0; i < advected_scalars.size(); i++) {
+      graph_advect_in.push_back(add_graph_grid(*advected_scalars[i], graph_scalar_swaps[i]));
+      graph_scalar_swaps[i]++;
+      graph_advect_out.push_back(add_graph_grid(*advected_scalars[i], graph_scalar_swaps[i]));
+      advect_kinds.push_back(FieldKind::Scalar);
+      advect_schemes.push_back(config.density_advection);
+    }
+  }
+  const int advect_count = static_cast<int>(graph_advect_in.size());
+  graph_advect_in_fields.assign(advect_count, nullptr);
+  graph_advect_out_fields.assign(advect_count, nullptr);
+  graph_advect_in_data.assign(advect_count, nullptr);
+  graph_advect_out_data.assign(advect_count, nullptr);
+  int advect_walls;
+  if (!staggered &&
+      std::count(advect_schemes.begin(), advect_schemes.end(), AdvectionScheme::SemiLagrangian) ==
+      advect_count) {
+    std::vector<int> advect_tiles;
+    for (size_t t = 0; t < bands.size(); t++) {
+      const int y0 = bands[t].first;
+      const int y1 = bands[t].second;
+      int task = graph->AddTask("advect velocity " + std::to_string(t), Kind::Serial, [=] {
+        advect_rows(graph_advect_in_data.data(), graph_advect_out_data.data(), advect_count,
+                    graph_field(old_uy), graph_field(old_ux), y0, y1, config.dt);
+      });
+      graph->AddDependency(first.walls, task);
+      advect_tiles.push_back(task);
     }
+    advect_walls = graph->AddTask("advected walls", Kind::Serial, [=] {
+      for (int i = 0; i < advect_count; i++) {
+        set_boundary_values(*graph_advect_out_fields[i], advect_kinds[i]);
+      }
+    });
+    for (int task : advect_tiles) {
+      graph->AddDependency(task, advect_walls);
+    }
+  } else {
+    // the corrections trace the forward result back from anywhere in the
+    // grid, and the MAC grid first averages the velocity onto the faces, so
+    // the advection is one whole-pool stage
+    advect_walls = graph->AddTask("advect velocity", Kind::Parallel, [=] {
+      if (fuse_advection) {
+        transport_fields(graph_advect_out_fields.data(), graph_advect_in_fields.data(), advect_kinds.data(),
+                         advect_schemes.data(), advect_count, graph_field(old_uy), graph_field(old_ux));
+      } else {
+        transport_velocity(graph_field(uy), graph_field(ux), graph_field(old_uy), graph_field(old_ux));
+      }
+    });
+    graph->AddDependency(first.walls, advect_walls);
+  }
+  GraphProjection second = add_projection_tasks(*graph, uy, ux, {advect_walls}, bands, "2");
+
+  // density
+  for (size_t s = 0; s < advected_scalars.size(); s++) {
+    DoubleBuffer& scalar = *advected_scalars[s];
+    int& swaps = graph_scalar_swaps[s];
+    // Runs after every task that reads the previous density. Dissipation
+    // writes into that buffer, and reads the whole advected field.
+    int advected = advect_walls;
+    if (!fuse_advection && (staggered || config.density_advection != AdvectionScheme::SemiLagrangian)) {
+      const int in = add_graph_grid(scalar, swaps);
+      const int out = add_graph_grid(scalar, ++swaps);
+      advected = graph->AddTask("advect density", Kind::Parallel, [=] {
+        transport_scalar(graph_field(out), graph_field(in), graph_field(uy), graph_field(ux));
+      });
+      graph->AddDependency(second.walls, advected);
+    } else if (!fuse_advection) {
+      const int in = add_graph_grid(scalar, swaps);
+      const int out = add_graph_grid(scalar, ++swaps);
+      advected = graph->AddTask("density walls", Kind::Serial, [=] {
+        set_boundary_values(graph_field(out), FieldKind::Scalar);
+      });
+      for (size_t t = 0; t < bands.size(); t++) {
+        const int y0 = bands[t].first;
+        const int y1 = bands[t].second;
+        // a band only needs the final velocity of its own cells
+        int task = graph->AddTask("advect density " + std::to_string(t), Kind::Serial, [=] {
+          const Real* ins[1] = {graph_field(in).data()};
+          Real* outs[1] = {graph_field(out).data()};
+          advect_rows(ins, outs, 1, graph_field(uy), graph_field(ux), y0, y1, config.dt);
+        });
+        graph->AddDependency(second.gradient_tiles[t], task);
+        graph->AddDependency(task, advected);
+      }
+    }
+
+    if (config.diffusion > 0.f) {
+      const int in = add_graph_grid(scalar, swaps);
+      const int out = add_graph_grid(scalar, ++swaps);
+      int task = graph->AddTask("diffuse density", diffuse_kind, [=] {
+        diffuse(graph_field(out), graph_field(in), config.diffusion, FieldKind::Scalar);
+      });
+      graph->AddDependency(advected, task);
+      advected = task;
+    }
+
+    const int in = add_graph_grid(scalar, swaps);
+    const int out = add_graph_grid(scalar, ++swaps);
+    for (size_t t = 0; t < bands.size(); t++) {
+      // the first and last bands also take the boundary rows
+      const int y0 = t == 0 ? 0 : bands[t].first;
+      const int y1 = t + 1 == bands.size() ? cells_y : bands[t].second;
+      int task = graph->AddTask("dissipate " + std::to_string(t), Kind::Serial, [=] {
+        dissipate_rows(graph_field(out), graph_field(in), y0, y1);
+      });
+      graph->AddDependency(advected, task);
+    }
+  }
+
+  if (channels) {
+    int task = graph->AddTask("scalar channels", Kind::Parallel, [=] {
+      step_channels(graph_field(uy), graph_field(ux));
+    });
+    graph->AddDependency(second.walls, task);
+  }
+}
+
+template <typename Real>
+typename BasicFluid<Real>::GraphProjection BasicFluid<Real>::add_projection_tasks(TaskGraph& graph, int uy, int ux,
+                                                   const std::vector<int>& after,
+                                                   const std::vector<std::pair<int, int>>& bands,
+                                                   const std::string& label) {
+  typedef TaskGraph::Kind Kind;
+
+  std::vector<int> divergence_tiles;
+  for (size_t t = 0; t < bands.size(); t++) {
+    const int y0 = bands[t].first;
+    const int y1 = bands[t].second;
+    int task = graph.AddTask("divergence " + label + "." + std::to_string(t), Kind::Serial, [=] {
+      negative_divergence_rows(divergence, graph_field(uy), graph_field(ux), y0, y1);
+    });
+    for (int before : after) {
+      graph.AddDependency(before, task);
+    }
+    divergence_tiles.push_back(task);
+  }
+  int solve = graph.AddTask("pressure solve " + label, Kind::Parallel, [=] {
+    set_boundary_values(divergence, FieldKind::Scalar);
+    solve_pressure();
+  });
+  for (int task : divergence_tiles) {
+    graph.AddDependency(task, solve);
+  }
+
+  // each band reads and writes only its own velocity rows
+  GraphProjection projection;
+  for (size_t t = 0; t < bands.size(); t++) {
+    const int y0 = bands[t].first;
+    const int y1 = bands[t].second;
+    int task = graph.AddTask("gradient " + label + "." + std::to_string(t), Kind::Serial, [=] {
+      subtract_gradient_rows(graph_field(uy), graph_field(ux), graph_field(uy), graph_field(ux), y0, y1);
+    });
+    graph.AddDependency(solve, task);
+    projection.gradient_tiles.push_back(task);
+  }
+  projection.walls = graph.AddTask("projected walls " + label, Kind::Serial, [=] {
+    set_boundary_values(graph_field(uy), kind_y);
+    set_boundary_values(graph_field(ux), kind_x);
+  });
+  for (int task : projection.gradient_tiles) {
+    graph.AddDependency(task, projection.walls);
+  }
+  return projection;
 }
 
-void Fluid::add_source_at(int y, int x, float source) {
-    if (y > 0 && y < CELLS_Y - 1 && x > 0 && x < CELLS_X - 1) {
-        S1[IndexOf(y, x)] += source;
+// Every grid, both buffers included, is zero on the inactive tiles: the
+// loops never write there, so the dropped tiles are cleared once here and
+// a tile that becomes active starts out empty.
+template <typename Real>
+void BasicFluid<Real>::update_tiles() {
+  const Field2D* fields[] = {&U_y.front(), &U_x.front(), &S.front()};
+  tiles->Update(pool, fields, 3, config.sparse_threshold, config.sparse_dilation);
+  Field2D* grids[] = {&U_y.front(), &U_y.back(), &U_x.front(), &U_x.back(),
+                      &S.front(), &S.back(), &pressure, &divergence};
+  const std::vector<int>& dropped = tiles->GetDeactivated();
+  pool.ParallelFor(0, static_cast<int>(dropped.size()), [&](int t0, int t1) {
+    for (int t = t0; t < t1; t++) {
+      TileBounds b = tiles->GetBounds(dropped[t]);
+      for (Field2D* grid : grids) {
+        for (int y = b.y0; y < b.y1; y++) {
+          std::fill(grid->data() + IndexOf(y, b.x0), grid->data() + IndexOf(y, b.x1), 0.f);
+        }
+      }
     }
+  }, 1);
 }
 
-float Fluid::Uy_at(int y, int x) {
-    return U1_y[IndexOf(y, x)];
+// The obstacle paths need Gauss-Seidel solves and dense grids, which the
+// constructor only checks for static obstacles, so they are checked here
+// rather than switched on behind the caller's back.
+template <typename Real>
+MovingObstacle* BasicFluid<Real>::add_moving_obstacle(std::unique_ptr<MovingObstacle> obstacle) {
+  CheckFluidConfig(config, true);
+  if (!obstacles) {
+    obstacles = make_unique<ObstacleMap>(cells_y, cells_x);
+  }
+  if (!wall_u_y) {
+    wall_u_y = make_unique<Field2D>(cells_y, cells_x);
+    wall_u_x = make_unique<Field2D>(cells_y, cells_x);
+  }
+  MovingObstacle* added = obstacle.get();
+  AddChild(std::move(obstacle));
+  moving_obstacles.push_back(added);
+  return added;
 }
 
-float Fluid::Ux_at(int y, int x) {
-    return U1_x[IndexOf(y, x)];
+// Everything here scales with the rims and the cells that changed, not
+// with the grid. Newly covered cells lose their velocity and density;
+// uncovered ones start with no density.
+template <typename Real>
+void BasicFluid<Real>::update_moving_obstacles() {
+  for (MovingObstacle* moving : moving_obstacles) {
+    moving->Rasterize(*obstacles);
+  }
+  obstacles->Update();
+
+  Field2D& uy = U_y.front();
+  Field2D& ux = U_x.front();
+  for (MovingObstacle* moving : moving_obstacles) {
+    for (int i : moving->GetReleased()) {
+      const int y = i / cells_x;
+      const int x = i % cells_x;
+      if (obstacles->IsSolid(y, x)) {
+        continue;
+      }
+      float u_y, u_x;
+      moving->GetVelocityAt(y, x, config.dt, u_y, u_x);
+      uy[i] = u_y;
+      ux[i] = u_x;
+      clear_scalars_at(y, x);
+    }
+  }
+  for (int i : obstacles->GetCovered()) {
+    uy[i] = 0.f;
+    ux[i] = 0.f;
+    clear_scalars_at(i / cells_x, i % cells_x);
+  }
+
+  for (int i : wall_cells) {
+    (*wall_u_y)[i] = 0.f;
+    (*wall_u_x)[i] = 0.f;
+  }
+  wall_cells.clear();
+  for (MovingObstacle* moving : moving_obstacles) {
+    for (int i : moving->GetRim()) {
+      if (!obstacles->IsMovingOnly(i)) {
+        continue;
+      }
+      float u_y, u_x;
+      moving->GetVelocityAt(i / cells_x, i % cells_x, config.dt, u_y, u_x);
+      (*wall_u_y)[i] = u_y;
+      (*wall_u_x)[i] = u_x;
+      wall_cells.push_back(i);
+    }
+  }
 }
 
-float Fluid::S_at(int y, int x) {
-    return S1[IndexOf(y, x)];
+template <typename Real>
+void BasicFluid<Real>::clear_scalars_at(int y, int x) {
+  for (DoubleBuffer* scalar : advected_scalars) {
+    scalar->front()[IndexOf(y, x)] = 0.f;
+  }
+  for (int c = 0; c < get_num_channels(); c++) {
+    channels->front().at(c, y, x) = 0.f;
+  }
 }
 
-void Fluid::v_step(std::vector<float> U1_y, std::vector<float> U1_x, std::vector<float> U0_y, std::vector<float> U0_x) {
-  set_boundary_values(U1_y, 1);
-  set_boundary_values(U1_x, 1);
+// On the MAC grid the force on a cell is split between its two faces.
+// Forces and sources on solid cells are dropped.
+template <typename Real>
+void BasicFluid<Real>::add_U_y_force_at(int y, int x, Real force) {
+    if (tiles) {
+        tiles->Touch(y, x);
+    }
+    if (y > 0 && y < cells_y - 1 && x > 0 && x < cells_x - 1 && !is_solid_at(y, x)) {
+        if (staggered) {
+            U_y.front()[IndexOf(y, x)] += 0.5f * force;
+            U_y.front()[IndexOf(y + 1, x)] += 0.5f * force;
+        } else {
+            U_y.front()[IndexOf(y, x)] += force;
+        }
+    }
+}
+
+template <typename Real>
+void BasicFluid<Real>::add_U_x_force_at(int y, int x, Real force) {
+    if (tiles) {
+        tiles->Touch(y, x);
+    }
+    if (y > 0 && y < cells_y - 1 && x > 0 && x < cells_x - 1 && !is_solid_at(y, x)) {
+        if (staggered) {
+            U_x.front()[IndexOf(y, x)] += 0.5f * force;
+            U_x.front()[IndexOf(y, x + 1)] += 0.5f * force;
+        } else {
+            U_x.front()[IndexOf(y, x)] += force;
+        }
+    }
+}
+
+template <typename Real>
+void BasicFluid<Real>::add_source_at(int y, int x, Real source) {
+    if (tiles) {
+        tiles->Touch(y, x);
+    }
+    if (y > 0 && y < cells_y - 1 && x > 0 && x < cells_x - 1 && !is_solid_at(y, x)) {
+        if (packed_S) {
+            PackedField2D& field = packed_S->front();
+            field.Set(IndexOf(y, x), field.Get(IndexOf(y, x)) + source);
+        } else {
+            S.front()[IndexOf(y, x)] += source;
+        }
+    }
+}
+
+template <typename Real>
+void BasicFluid<Real>::add_channel_at(int channel, int y, int x, Real amount) {
+    if (y > 0 && y < cells_y - 1 && x > 0 && x < cells_x - 1 && !is_solid_at(y, x)) {
+        channels->front().at(channel, y, x) += amount;
+    }
+}
+
+// Both getters return the velocity at the cell centre.
+template <typename Real>
+Real BasicFluid<Real>::Uy_at(int y, int x) {
+    if (staggered && y < cells_y - 1) {
+        return 0.5f * (U_y.front()[IndexOf(y, x)] + U_y.front()[IndexOf(y + 1, x)]);
+    }
+    return U_y.front()[IndexOf(y, x)];
+}
+
+template <typename Real>
+Real BasicFluid<Real>::Ux_at(int y, int x) {
+    if (staggered && x < cells_x - 1) {
+        return 0.5f * (U_x.front()[IndexOf(y, x)] + U_x.front()[IndexOf(y, x + 1)]);
+    }
+    return U_x.front()[IndexOf(y, x)];
+}
+
+template <typename Real>
+Real BasicFluid<Real>::S_at(int y, int x) {
+    if (packed_S) {
+        return packed_S->front().Get(IndexOf(y, x));
+    }
+    return S.front()[IndexOf(y, x)];
+}
+
+template <typename Real>
+Real BasicFluid<Real>::channel_at(int channel, int y, int x) const {
+    return channels->front().at(channel, y, x);
+}
+
+template <typename Real>
+int BasicFluid<Real>::find_channel(const std::string& name) const {
+    for (size_t c = 0; c < config.scalar_channels.size(); c++) {
+        if (config.scalar_channels[c].name == name) {
+            return static_cast<int>(c);
+        }
+    }
+    return -1;
+}
+
+template <typename Real>
+void BasicFluid<Real>::v_step(DoubleBuffer& U_y, DoubleBuffer& U_x) {
+  if (channels_buoyant) {
+    add_buoyancy(U_y.front());
+  }
+  set_boundary_values(U_y.front(), kind_y);
+  set_boundary_values(U_x.front(), kind_x);
+
+  // vorticity confinement
+  if (confine) {
+    U_y.swap();
+    U_x.swap();
+    confine_vorticity(U_y.front(), U_x.front(), U_y.back(), U_x.back());
+    set_boundary_values(U_y.front(), kind_y);
+    set_boundary_values(U_x.front(), kind_x);
+  }
 
   // diffuse
-  if (VISCOSITY > 0.f) {
-    std::swap(U0_y, U1_y);
-    std::swap(U0_x, U1_x);
-    diffuse(U1_y, U0_y, VISCOSITY, 1);
-    diffuse(U1_x, U0_x, VISCOSITY, 2);
+  if (config.viscosity > 0.f) {
+    U_y.swap();
+    U_x.swap();
+    diffuse(U_y.front(), U_y.back(), config.viscosity, kind_y);
+    diffuse(U_x.front(), U_x.back(), config.viscosity, kind_x);
   }
   // pressure correction 1
-  project(U0_y, U0_x, U1_y, U1_x);
+  project(U_y.front(), U_x.front(), U_y.front(), U_x.front());
 
   // advect
-  transport(U1_y, U0_y, U0_y, U0_x, 1);
-  transport(U1_x, U0_x, U0_y, U0_x, 2);
+  U_y.swap();
+  U_x.swap();
+  if (fuse_advection) {
+    // the scalars ride along with the velocity, so s_step skips its own
+    // transport
+    fused_outs[0] = &U_y.front();
+    fused_outs[1] = &U_x.front();
+    fused_ins[0] = &U_y.back();
+    fused_ins[1] = &U_x.back();
+    for (size_t i = 0; i < advected_scalars.size(); i++) {
+      advected_scalars[i]->swap();
+      fused_outs[2 + i] = &advected_scalars[i]->front();
+      fused_ins[2 + i] = &advected_scalars[i]->back();
+    }
+    transport_fields(fused_outs.data(), fused_ins.data(), fused_kinds.data(), fused_schemes.data(),
+                     static_cast<int>(fused_outs.size()), U_y.back(), U_x.back());
+  } else {
+    transport_velocity(U_y.front(), U_x.front(), U_y.back(), U_x.back());
+  }
 
   // pressure correction 2
-  project(U0_y, U0_x, U1_y, U1_x);
+  project(U_y.front(), U_x.front(), U_y.front(), U_x.front());
 }
 
-void Fluid::s_step(std::vector<float> S1, std::vector<float> S0, std::vector<float> U_y, std::vector<float> U_x){
-  // advect according to velocity field
-  transport(S0, S1, U_y, U_x, 0);
+template <typename Real>
+void BasicFluid<Real>::s_step(DoubleBuffer& S, const Field2D& U_y, const Field2D& U_x){
+  if (channels) {
+      step_channels(U_y, U_x);
+  }
+  if (packed_S) {
+      // advection with the dissipation folded into the store. The walls
+      // are zero-gradient, so every ghost is a plain copy and is filled on
+      // the raw words: the side ghosts with their row, the ghost rows
+      // (corners included) afterwards.
+      packed_S->swap();
+      const uint16_t* in = packed_S->back().data();
+      uint16_t* out = packed_S->front().data();
+      const float scale = 1.0f / (1.0f + config.dt * config.dissipation);
+      pool.ParallelFor(1, cells_y - 1, [&](int y0, int y1) {
+          for (int y = y0; y < y1; y++) {
+              packed_advect_row(in, out, U_y.data(), U_x.data(), y, 1, cells_x - 2,
+                                cells_y, cells_x, config.dt, scale);
+              FillSideGhosts<NeumannScalar>(out, cells_x, y);
+          }
+      });
+      FillEndGhosts<NeumannScalar>(out, cells_y, cells_x, 0, 0, cells_x);
+      FillEndGhosts<NeumannScalar>(out, cells_y, cells_x, cells_y - 1, 0, cells_x);
+      return;
+  }
+
+  // advect according to velocity field, unless v_step already did
+  if (!fuse_advection) {
+      S.swap();
+      transport_scalar(S.front(), S.back(), U_y, U_x);
+  }
 
   // diffuse
-  if (DIFFUSION > 0.0f) {
-      std::swap(S1, S0);
-      diffuse(S0, S1, DIFFUSION, 0);
+  if (config.diffusion > 0.0f) {
+      S.swap();
+      diffuse(S.front(), S.back(), config.diffusion, FieldKind::Scalar);
   }
 
   // dissipate
-  std::swap(S1, S0);
-  dissipate(S0, S1);
+  S.swap();
+  dissipate(S.front(), S.back());
+}
+
+// On the MAC grid each component lives on its own lattice, shifted half a
+// cell from the centres. The advection kernels only see grid indices, so
+// they advect a component exactly like a centred field once they are given
+// the velocity at its own sample points.
+template <typename Real>
+void BasicFluid<Real>::transport_velocity(Field2D& U1_y, Field2D& U1_x, const Field2D& U0_y, const Field2D& U0_x) {
+  if (!staggered) {
+    transport(U1_y, U0_y, U0_y, U0_x, kind_y, config.velocity_advection);
+    transport(U1_x, U0_x, U0_y, U0_x, kind_x, config.velocity_advection);
+    return;
+  }
+  pool.ParallelFor(1, cells_y - 1, [&](int y0, int y1) {
+    face_velocity_rows(U0_y, U0_x, y0, y1);
+  });
+  transport(U1_y, U0_y, U0_y, *u_x_at_y_faces, kind_y, config.velocity_advection);
+  transport(U1_x, U0_x, *u_y_at_x_faces, U0_x, kind_x, config.velocity_advection);
 }
 
-void Fluid::set_boundary_values(std::vector<float> field, int key) {
-  switch (key) {
-    case 1:
-      // vertical velocity
-      for (int y = 1; y < CELLS_Y - 1; y++) {
-          field[IndexOf(y, 0)] = field[IndexOf(y, 1)];
-          field[IndexOf(y, CELLS_X - 1)] = field[IndexOf(y, CELLS_X - 2)];
+template <typename Real>
+void BasicFluid<Real>::transport_scalar(Field2D& S1, const Field2D& S0, const Field2D& U_y, const Field2D& U_x) {
+  if (!staggered) {
+    transport(S1, S0, U_y, U_x, FieldKind::Scalar, config.density_advection);
+    return;
+  }
+  pool.ParallelFor(1, cells_y - 1, [&](int y0, int y1) {
+    centre_velocity_rows(U_y, U_x, y0, y1);
+  });
+  transport(S1, S0, *u_y_at_centres, *u_x_at_centres, FieldKind::Scalar, config.density_advection);
+}
+
+template <typename Real>
+void BasicFluid<Real>::transport_fields(Field2D* const* S1, const Field2D* const* S0, const FieldKind* kinds,
+                             const AdvectionScheme* schemes, int count,
+                             const Field2D& U_y, const Field2D& U_x) {
+  for (int i = 0; i < count; i++) {
+    transport_outs[i] = S1[i]->data();
+    transport_ins[i] = S0[i]->data();
+  }
+  Real* const* outs = transport_outs.data();
+  const Real* const* ins = transport_ins.data();
+  if (tiles) {
+    for_each_tile([&](int y0, int y1, int x0, int x1) {
+      for (int y = y0; y < y1; y++) {
+        advect_row(ins, outs, count, U_y.data(), U_x.data(), y, x0, x1 - x0,
+                   cells_y, cells_x, config.dt);
       }
-      for (int x = 1; x < CELLS_X - 1; x++) {
-          field[IndexOf(0, x)] = -field[IndexOf(1, x)];
-          field[IndexOf(CELLS_Y - 1, x)] = -field[IndexOf(CELLS_Y - 2, x)];
+    });
+  } else {
+    pool.ParallelFor(1, cells_y - 1, [&](int y0, int y1) {
+      advect_rows(ins, outs, count, U_y, U_x, y0, y1, config.dt);
+    });
+  }
+  for (int i = 0; i < count; i++) {
+    set_boundary_values(*S1[i], kinds[i]);
+  }
+
+  // the corrections sweep the fields that share a scheme together
+  for (AdvectionScheme scheme : {AdvectionScheme::MacCormack, AdvectionScheme::Bfecc}) {
+    int group = 0;
+    for (int i = 0; i < count; i++) {
+      if (schemes[i] == scheme) {
+        group_outs[group] = S1[i];
+        group_ins[group] = S0[i];
+        group_kinds[group] = kinds[i];
+        group++;
       }
-      break;
-    case 2:
-      // horizontal velocity
-      for (int y = 1; y < CELLS_Y - 1; ++y) {
-          field[IndexOf(y, 0)] = -field[IndexOf(y, 1)];
-          field[IndexOf(y, CELLS_X - 1)] = -field[IndexOf(y, CELLS_X - 2)];
+    }
+    if (group > 0) {
+      correct_advection(scheme, group_outs.data(), group_ins.data(), group_kinds.data(), group,
+                        U_y, U_x);
+    }
+  }
+}
+
+// Both schemes advect the semi-Lagrangian result S1 back over -dt. The
+// difference between that and S0 is twice the error of one step.
+// MacCormack subtracts half of it from S1 directly; BFECC subtracts it from
+// S0 and advects again, which costs a third sweep. The walls have no
+// departure point, so they are left to set_boundary_values.
+template <typename Real>
+void BasicFluid<Real>::correct_advection(AdvectionScheme scheme, Field2D* const* S1, const Field2D* const* S0,
+                              const FieldKind* kinds, int count, const Field2D& U_y, const Field2D& U_x) {
+  for (int i = 0; i < count; i++) {
+    correct_outs[i] = S1[i]->data();
+    correct_ins[i] = S0[i]->data();
+    correct_back[i] = advect_scratch[i]->data();
+  }
+  Real* const* outs = correct_outs.data();
+  const Real* const* ins = correct_ins.data();
+  Real* const* back = correct_back.data();
+  pool.ParallelFor(1, cells_y - 1, [&](int y0, int y1) {
+    advect_rows(outs, back, count, U_y, U_x, y0, y1, -config.dt);
+  });
+
+  if (scheme == AdvectionScheme::MacCormack) {
+    pool.ParallelFor(1, cells_y - 1, [&](int y0, int y1) {
+      maccormack_rows(outs, ins, back, count, y0, y1);
+      limit_rows(outs, ins, count, U_y, U_x, y0, y1);
+    });
+  } else {
+    pool.ParallelFor(0, cells_y, [&](int y0, int y1) {
+      bfecc_rows(back, ins, count, y0, y1);
+    });
+    for (int i = 0; i < count; i++) {
+      set_boundary_values(*advect_scratch[i], kinds[i]);
+    }
+    pool.ParallelFor(1, cells_y - 1, [&](int y0, int y1) {
+      advect_rows(back, outs, count, U_y, U_x, y0, y1, config.dt);
+      limit_rows(outs, ins, count, U_y, U_x, y0, y1);
+    });
+  }
+  for (int i = 0; i < count; i++) {
+    set_boundary_values(*S1[i], kinds[i]);
+  }
+}
+
+// Picks the boundary policy of kind once per solve; the sweeps below are
+// compiled for each, and multiply by 1 / b rather than divide. The face
+// kinds have their wall faces inside the swept rows, so their ring is
+// refilled by set_boundary_values after each sweep and the policy goes
+// unused.
+template <typename Real>
+void BasicFluid<Real>::lin_solve(Field2D& S1, const Field2D& S0, Real a, Real b, FieldKind kind) {
+  if (tiles) {
+      lin_solve_tiles(S1, S0, a, b, kind);
+      return;
+  }
+  const bool red_black = config.gauss_seidel_order == SweepOrder::RedBlack;
+  if (periodic) {
+      red_black ? lin_solve_red_black<Periodic>(S1, S0, a, b, kind)
+                : lin_solve_lexicographic<Periodic>(S1, S0, a, b, kind);
+  } else if (kind == FieldKind::VelocityY && !no_slip) {
+      red_black ? lin_solve_red_black<FreeSlipY>(S1, S0, a, b, kind)
+                : lin_solve_lexicographic<FreeSlipY>(S1, S0, a, b, kind);
+  } else if (kind == FieldKind::VelocityX && !no_slip) {
+      red_black ? lin_solve_red_black<FreeSlipX>(S1, S0, a, b, kind)
+                : lin_solve_lexicographic<FreeSlipX>(S1, S0, a, b, kind);
+  } else if (kind == FieldKind::VelocityY || kind == FieldKind::VelocityX) {
+      red_black ? lin_solve_red_black<NoSlip>(S1, S0, a, b, kind)
+                : lin_solve_lexicographic<NoSlip>(S1, S0, a, b, kind);
+  } else {
+      red_black ? lin_solve_red_black<NeumannScalar>(S1, S0, a, b, kind)
+                : lin_solve_lexicographic<NeumannScalar>(S1, S0, a, b, kind);
+  }
+}
+
+// Each row's side ghosts are only read by that row, so they are filled as
+// soon as it is swept; the ghost rows and corners follow the last row.
+// This gives the same result as a boundary pass after each sweep.
+template <typename Real>
+template <class Policy>
+void BasicFluid<Real>::lin_solve_lexicographic(Field2D& S1, const Field2D& S0, Real a, Real b,
+                                               FieldKind kind) {
+  const int s = cells_x;
+  const bool faces = kind == FieldKind::FaceY || kind == FieldKind::FaceX;
+  const Real inv_b = 1.0f / b;
+  const Real weight = a * inv_b;
+  Real* grid = S1.data();
+  const Real* rhs = S0.data();
+  for (int i = 0; i < config.num_iter; i++) {
+      for (int y = 1; y < cells_y - 1; y++) {
+          // each cell waits on the one to its left, so that neighbour is
+          // added last: only one multiply and add sit on the serial chain
+          for_each_run(y, y + 1, [&](int, int, int x0, int x1) {
+              for (int k = y * s + x0; k < y * s + x1; k++) {
+                  grid[k] = (rhs[k] * inv_b
+                             + weight * (grid[k + s] + grid[k - s] + grid[k + 1]))
+                            + weight * grid[k - 1];
+              }
+          });
+          if (!faces) {
+              FillSideGhosts<Policy>(grid, s, y);
+          }
       }
-      for (int x = 1; x < CELLS_X - 1; ++x) {
-          field[IndexOf(0, x)] = field[IndexOf(1, x)];
-          field[IndexOf(CELLS_Y - 1, x)] = field[IndexOf(CELLS_Y - 2, x)];
+      if (faces) {
+          set_boundary_values(S1, kind);
+          continue;
       }
-      break;
-    case 3:
-      // scalar
-      for (int y=1; y<CELLS_Y-1; y++){
-        field[IndexOf(y,0)] = field[IndexOf(y,1)];
-        field[IndexOf(y, CELLS_X - 1)] = field[IndexOf(y, CELLS_X - 2)];
+      if (obstacles) {
+          fill_obstacles(S1, kind);
       }
-      for (int x = 1; x < CELLS_X - 1; x++) {
-        field[IndexOf(0, x)] = field[IndexOf(1, x)];
-        field[IndexOf(CELLS_Y - 1, x)] = field[IndexOf(CELLS_Y - 2, x)];
+      for (int ghost_row : {0, cells_y - 1}) {
+          FillEndGhosts<Policy>(grid, cells_y, cells_x, ghost_row, 1, cells_x - 1);
+          FillCornerGhosts<Policy>(grid, cells_y, cells_x, ghost_row);
       }
-      break;
   }
+}
+
+// Each pool thread owns a band of rows. Red cells only read black cells
+// and vice versa, so a colour can be updated in any order and the result
+// does not depend on the thread count. Each thread fills the boundary
+// cells next to its own rows, so no separate boundary pass is needed.
+template <typename Real>
+template <class Policy>
+void BasicFluid<Real>::lin_solve_red_black(Field2D& S1, const Field2D& S0, Real a, Real b,
+                                           FieldKind kind) {
+  const int s = cells_x;
+  const int ny = cells_y - 2;
+  const int last = cells_x - 1;
+  const bool faces = kind == FieldKind::FaceY || kind == FieldKind::FaceX;
+  const Real inv_b = 1.0f / b;
+  Real* x = S1.data();
+  const Real* rhs = S0.data();
+
+  pool.RunOnAll([&](int thread) {
+    const int threads = pool.GetNumThreads();
+    const int y0 = 1 + ny * thread / threads;
+    const int y1 = 1 + ny * (thread + 1) / threads;
+    for (int i = 0; i < config.num_iter; i++) {
+      for (int color = 0; color < 2; color++) {
+        for (int y = y0; y < y1; y++) {
+          // cell x of row y has colour (x + y) & 1 whichever run it is in
+          for_each_run(y, y + 1, [&](int, int, int c0, int c1) {
+            for (int k = y * s + c0 + ((y + c0 + 1 + color) & 1); k < y * s + c1; k += 2) {
+              x[k] = (rhs[k] + a * (x[k + s] + x[k - s] + x[k + 1] + x[k - 1])) * inv_b;
+            }
+          });
+        }
+        sweep_barrier.Wait();
+      }
+      // the obstacle walls are O(boundary cells), so one thread fills them
+      // all; the ring may read them next
+      if (obstacles) {
+        if (thread == 0) {
+          fill_obstacles(S1, kind);
+        }
+        sweep_barrier.Wait();
+      }
+
+      if (faces) {
+        // the wall faces cut across the bands, so one thread fills the
+        // whole ring, corners included
+        if (thread == 0) {
+          set_boundary_values(S1, kind);
+        }
+      } else {
+        for (int y = y0; y < y1; y++) {
+          FillSideGhosts<Policy>(x, s, y);
+        }
+        // the interior is final after the barrier, so the periodic ghost
+        // rows can copy rows of other bands
+        if (y0 == 1 && y0 < y1) {
+          FillEndGhosts<Policy>(x, cells_y, s, 0, 1, last);
+          FillCornerGhosts<Policy>(x, cells_y, s, 0);
+        }
+        if (y1 == ny + 1 && y0 < y1) {
+          FillEndGhosts<Policy>(x, cells_y, s, cells_y - 1, 1, last);
+          FillCornerGhosts<Policy>(x, cells_y, s, cells_y - 1);
+        }
+      }
+      sweep_barrier.Wait();
+    }
+  });
+}
+
+// The walls are only O(cells) long, so they are split over the pool in
+// large tasks; grids with fewer rows than kBoundaryGrain fill them inline.
+template <typename Real>
+template <class Policy>
+void BasicFluid<Real>::fill_boundary(Field2D& field) {
+  Real* grid = field.data();
+  pool.ParallelFor(1, cells_y - 1, [&](int y0, int y1) {
+    for (int y = y0; y < y1; y++) {
+        FillSideGhosts<Policy>(grid, cells_x, y);
+    }
+  }, kBoundaryGrain);
+  pool.ParallelFor(1, cells_x - 1, [&](int x0, int x1) {
+    FillEndGhosts<Policy>(grid, cells_y, cells_x, 0, x0, x1);
+    FillEndGhosts<Policy>(grid, cells_y, cells_x, cells_y - 1, x0, x1);
+  }, kBoundaryGrain);
+  FillCornerGhosts<Policy>(grid, cells_y, cells_x, 0);
+  FillCornerGhosts<Policy>(grid, cells_y, cells_x, cells_y - 1);
+}
+
+// FaceY and FaceX: U_y or U_x on the faces of a MAC grid. The faces on the
+// walls carry no flow, the ghost faces beyond them mirror the first
+// interior face with the opposite sign, and the tangential ghosts copy
+// their neighbour (free slip) or its negation (no slip).
+template <typename Real>
+void BasicFluid<Real>::set_face_boundary_values(Field2D& field, bool vertical) {
+  const Real tangential_sign = no_slip ? -1.0f : 1.0f;
+  if (vertical) {
+    pool.ParallelFor(1, cells_x - 1, [&](int x0, int x1) {
+      for (int x = x0; x < x1; x++) {
+          field[IndexOf(1, x)] = 0.f;
+          field[IndexOf(cells_y - 1, x)] = 0.f;
+          field[IndexOf(0, x)] = -field[IndexOf(2, x)];
+      }
+    }, kBoundaryGrain);
+    pool.ParallelFor(1, cells_y, [&](int y0, int y1) {
+      for (int y = y0; y < y1; y++) {
+          field[IndexOf(y, 0)] = tangential_sign * field[IndexOf(y, 1)];
+          field[IndexOf(y, cells_x - 1)] = tangential_sign * field[IndexOf(y, cells_x - 2)];
+      }
+    }, kBoundaryGrain);
+  } else {
+    pool.ParallelFor(1, cells_y - 1, [&](int y0, int y1) {
+      for (int y = y0; y < y1; y++) {
+          field[IndexOf(y, 1)] = 0.f;
+          field[IndexOf(y, cells_x - 1)] = 0.f;
+          field[IndexOf(y, 0)] = -field[IndexOf(y, 2)];
+      }
+    }, kBoundaryGrain);
+    pool.ParallelFor(1, cells_x, [&](int x0, int x1) {
+      for (int x = x0; x < x1; x++) {
+          field[IndexOf(0, x)] = tangential_sign * field[IndexOf(1, x)];
+          field[IndexOf(cells_y - 1, x)] = tangential_sign * field[IndexOf(cells_y - 2, x)];
+      }
+    }, kBoundaryGrain);
+  }
+  // corners averaged like on the cell-centred grids
+  FillCornerGhosts<NeumannScalar>(field.data(), cells_y, cells_x, 0);
+  FillCornerGhosts<NeumannScalar>(field.data(), cells_y, cells_x, cells_y - 1);
+}
 
-  // corner values
-  field[IndexOf(0, 0)] = (field[IndexOf(0, 1)] + field[IndexOf(1, 0)]) / 2.0f;
-  field[IndexOf(0, CELLS_X - 1)] = (field[IndexOf(0, CELLS_X - 2)] + field[IndexOf(1, CELLS_X - 1)]) / 2.0f;
-  field[IndexOf(CELLS_Y - 1, 0)] = (field[IndexOf(CELLS_Y - 1, 1)] + field[IndexOf(CELLS_Y - 2, 0)]) / 2.0f;
-  field[IndexOf(CELLS_Y - 1, CELLS_X - 1)] = (field[IndexOf(CELLS_Y - 1, CELLS_X - 2)] + field[IndexOf(CELLS_Y - 2, CELLS_X - 1)]) / 2.0f;
+template <typename Real>
+void BasicFluid<Real>::set_boundary_values(Field2D& field, FieldKind kind) {
+  if (obstacles) {
+    fill_obstacles(field, kind);
+  }
+  if (periodic) {
+    fill_boundary<Periodic>(field);
+    return;
+  }
+  switch (kind) {
+    case FieldKind::Scalar:
+      fill_boundary<NeumannScalar>(field);
+      break;
+    case FieldKind::VelocityY:
+      no_slip ? fill_boundary<NoSlip>(field) : fill_boundary<FreeSlipY>(field);
+      break;
+    case FieldKind::VelocityX:
+      no_slip ? fill_boundary<NoSlip>(field) : fill_boundary<FreeSlipX>(field);
+      break;
+    case FieldKind::FaceY:
+    case FieldKind::FaceX:
+      set_face_boundary_values(field, kind == FieldKind::FaceY);
+      break;
+  }
 }
 
+// The box walls read interior cells next to the ring, which may be solid,
+// so set_boundary_values fills the obstacles first. The velocity is
+// mirrored about that of the moving walls, which is zero on static cells.
+template <typename Real>
+void BasicFluid<Real>::fill_obstacles(Field2D& field, FieldKind kind) {
+  Real* grid = field.data();
+  const Real* wall_y = wall_u_y ? wall_u_y->data() : nullptr;
+  const Real* wall_x = wall_u_x ? wall_u_x->data() : nullptr;
+  switch (kind) {
+    case FieldKind::Scalar:
+      obstacles->Fill<NeumannScalar>(grid);
+      break;
+    case FieldKind::VelocityY:
+      no_slip ? obstacles->Fill<NoSlip>(grid, wall_y) : obstacles->Fill<FreeSlipY>(grid, wall_y);
+      break;
+    case FieldKind::VelocityX:
+      no_slip ? obstacles->Fill<NoSlip>(grid, wall_x) : obstacles->Fill<FreeSlipX>(grid, wall_x);
+      break;
+    case FieldKind::FaceY:
+    case FieldKind::FaceX:
+      // obstacles are only built on the collocated layout
+      break;
+  }
 }
+
+template class BasicFluid<float>;
+template class BasicFluid<double>;
+}  // namespace GLOO
@@ -7,150 +7,810 @@
 #include "gloo/components/MaterialComponent.hpp"
 // #include "Solver.hpp"
 #include "Parameters.hpp"
+#include "Field2D.hpp"
+#include "PoissonSolver.hpp"
+#include "ThreadPool.hpp"
+#include "TaskGraph.hpp"
+#include "AdvectionKernels.hpp"
+#include "VorticityKernels.hpp"
+#include "TileMap.hpp"
+#include "PackedField2D.hpp"
+#include "ChannelField2D.hpp"
+#include "ChannelKernels.hpp"
+#include "BoundaryConditions.hpp"
+#include "Obstacles.hpp"
+#include "MovingObstacle.hpp"
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
 #include <vector>
 
 
 namespace GLOO {
-class Fluid : public SceneNode {
+// Throws std::runtime_error when config combines settings BasicFluid does
+// not support; obstacles says whether the fluid has any, from
+// config.obstacle_image or handed to the constructor. The constructor and
+// main.cpp both check through here, so each rule has one message.
+void CheckFluidConfig(const SimulationConfig& config, bool obstacles);
+
+// The 2D solver, templated on the precision of its grids and of the
+// solver arithmetic; the configuration and the time step stay float.
+// Both BasicFluid<float> (Fluid) and BasicFluid<double> are instantiated in
+// Fluid.cpp.
+template <typename Real>
+class BasicFluid : public SceneNode {
 private:
-  // velocity grids
-  std::vector<float> U0_y;
-  std::vector<float> U0_x;
-  std::vector<float> U1_y;
-  std::vector<float> U1_x;
+  typedef BasicField2D<Real> Field2D;
+  typedef BasicDoubleBuffer<Real> DoubleBuffer;
+
+  SimulationConfig config;
+
+  // grid dimensions, fixed at construction
+  const int cells_y;
+  const int cells_x;
+  const int num_cells;
+
+  // solid cells inside the box; null when there are none. Every loop that
+  // writes interior cells goes through for_each_run, which skips them.
+  std::unique_ptr<ObstacleMap> obstacles;
+
+  // obstacles moving with their Transform, owned as children of this node
+  std::vector<MovingObstacle*> moving_obstacles;
+  // velocity of the moving walls on the rim cells listed in wall_cells,
+  // zero elsewhere; null until a moving obstacle is added
+  std::unique_ptr<Field2D> wall_u_y;
+  std::unique_ptr<Field2D> wall_u_x;
+  std::vector<int> wall_cells;
+
+  // velocity grids; front() holds the current state
+  DoubleBuffer U_y;
+  DoubleBuffer U_x;
+
+  // density kept in a 16-bit format (see config.density_storage); S is
+  // then a 1x1 placeholder and every access goes through packed_S
+  const bool packed_density;
 
   // scalar grids - density values
-  std::vector<float> S0;
-  std::vector<float> S1;
+  DoubleBuffer S;
+  std::unique_ptr<PackedDoubleBuffer> packed_S;
+
+  // scalar fields carried along by the fused advection stage
+  std::vector<DoubleBuffer*> advected_scalars;
+
+  // config.scalar_channels, interleaved in one grid; null without any
+  std::unique_ptr<BasicChannelDoubleBuffer<Real>> channels;
+  // per channel: the dissipation factor, the weights a and 1 / b of the
+  // diffusion solve, and the buoyancy
+  std::vector<Real> channel_scale;
+  std::vector<Real> channel_a;
+  std::vector<Real> channel_inv_b;
+  std::vector<Real> channel_buoyancy;
+  // whether any channel diffuses, or pushes on the velocity
+  bool channels_diffuse;
+  bool channels_buoyant;
+
+  // MAC grid (see VelocityLayout), and the kinds of U_y and U_x, which
+  // pick their boundary policies
+  const bool staggered;
+  const FieldKind kind_y;
+  const FieldKind kind_x;
+  // config.walls; periodic needs the collocated layout
+  const bool no_slip;
+  const bool periodic;
+  // config.fused_advection; collocated layout only
+  const bool fuse_advection;
+  // config.vorticity_confinement > 0; collocated layout only
+  const bool confine;
+
+  // MAC grid only: U_x averaged onto the U_y faces and U_y onto the U_x
+  // faces, so each component is advected along its own lattice, and both
+  // averaged to the cell centres for the scalars
+  std::unique_ptr<Field2D> u_x_at_y_faces;
+  std::unique_ptr<Field2D> u_y_at_x_faces;
+  std::unique_ptr<Field2D> u_y_at_centres;
+  std::unique_ptr<Field2D> u_x_at_centres;
+
+  // backward-traced fields of the MacCormack and BFECC corrections, one per
+  // field advected together; empty when every field is semi-Lagrangian
+  std::vector<std::unique_ptr<Field2D>> advect_scratch;
+  // pointer arrays of the advection, sized in the constructor for the most
+  // fields advected together so that a step allocates nothing: the fields
+  // of the fused v_step, the grids of transport_fields, and the fields of
+  // one correction group with their grids
+  std::vector<Field2D*> fused_outs;
+  std::vector<const Field2D*> fused_ins;
+  std::vector<FieldKind> fused_kinds;
+  std::vector<AdvectionScheme> fused_schemes;
+  std::vector<Real*> transport_outs;
+  std::vector<const Real*> transport_ins;
+  std::vector<Field2D*> group_outs;
+  std::vector<const Field2D*> group_ins;
+  std::vector<FieldKind> group_kinds;
+  std::vector<Real*> correct_outs;
+  std::vector<const Real*> correct_ins;
+  std::vector<Real*> correct_back;
+
+  // three curl rows per pool thread for confine_vorticity_rows; empty
+  // unless confine
+  std::vector<Real> confine_rows;
+
+  // scratch grids for the pressure projection
+  Field2D pressure;
+  Field2D divergence;
 
-  void swap_grids();
+  // workers for the grid loops and the threaded solver backends
+  ThreadPool pool;
+  Barrier sweep_barrier;
+
+  // linear solver backends; null selects lin_solve (Gauss-Seidel)
+  std::unique_ptr<BasicPoissonSolver<Real>> pressure_solver;
+  std::unique_ptr<BasicPoissonSolver<Real>> diffusion_solver;
+
+  // widest advection kernel this CPU supports, for the configured sampler
+  BasicAdvectRowKernel<Real> advect_row;
+  // the same for the packed density; null unless packed_density
+  BasicPackedAdvectRowKernel<Real> packed_advect_row;
+  // the same for the vorticity confinement force
+  BasicConfineRowKernel<Real> confine_row;
+  // the same for the scalar channels
+  BasicChannelAdvectKernel<Real> channel_advect;
+  BasicChannelRelaxKernel<Real> channel_relax;
+
+  // solver reports summed over the current step
+  SolverStats pressure_stats;
+  SolverStats diffusion_stats;
+
+  // timing of the last step_graph()
+  TaskGraphReport step_report;
+
+  // active tiles in block-sparse mode (see config.sparse_tile_size); null
+  // when the whole grid is simulated
+  std::unique_ptr<TileMap> tiles;
+
+  // tasks of one projection in the step graph
+  struct GraphProjection {
+    // one per band; each writes the final velocity of its rows
+    std::vector<int> gradient_tiles;
+    // boundary values of the projected velocity, after every tile
+    int walls;
+  };
+
+  // A grid named by a step graph task: the one buffer holds in front after
+  // swaps swaps from the start of the step. field is rebound before every
+  // run of the graph.
+  struct GraphGrid {
+    DoubleBuffer* buffer;
+    int swaps;
+    Field2D* field;
+  };
+
+  // step_graph() state, built on its first call
+  std::unique_ptr<TaskGraph> graph;
+  std::vector<GraphGrid> graph_grids;
+  // swaps of U_y and U_x, and of each of advected_scalars, in one step
+  int graph_velocity_swaps;
+  std::vector<int> graph_scalar_swaps;
+  // the graph grids advected together, and the grids and data they are
+  // bound to in the current step
+  std::vector<int> graph_advect_in;
+  std::vector<int> graph_advect_out;
+  std::vector<const Field2D*> graph_advect_in_fields;
+  std::vector<Field2D*> graph_advect_out_fields;
+  std::vector<const Real*> graph_advect_in_data;
+  std::vector<Real*> graph_advect_out_data;
 
 public:
-  Fluid();
+  // obstacles, when given, replaces config.obstacle_image.
+  explicit BasicFluid(const SimulationConfig& config = SimulationConfig(),
+                      std::unique_ptr<ObstacleMap> obstacles = nullptr);
+
+  int IndexOf(int y, int x) const { return y * cells_x + x; }
+  // Adds an obstacle that follows its Transform, in cell units, and
+  // returns it. Like static obstacles, needs the collocated layout, the
+  // float32 density, the Gauss-Seidel solver and the dense grid; throws
+  // otherwise.
+  MovingObstacle* add_moving_obstacle(std::unique_ptr<MovingObstacle> obstacle);
   void step();
+  // step() as a dependency graph of row-band tasks, see Fluid.cpp
+  void step_graph();
+  // Builds the graph step_graph() runs.
+  void build_step_graph();
+  // Adds a graph grid and returns its index in graph_grids.
+  int add_graph_grid(DoubleBuffer& buffer, int swaps);
+  // The grid graph grid index is bound to in the current step.
+  Field2D& graph_field(int grid) const { return *graph_grids[grid].field; }
 
   // setters
-  void add_U_y_force_at(int y, int x, float force);
-  void add_U_x_force_at(int y, int x, float force);
-  void add_source_at(int y, int x, float source);
+  void add_U_y_force_at(int y, int x, Real force);
+  void add_U_x_force_at(int y, int x, Real force);
+  void add_source_at(int y, int x, Real source);
+  void add_channel_at(int channel, int y, int x, Real amount);
 
   // getters
-  float Uy_at(int y, int x);
-  float Ux_at(int y, int x);
-  float S_at(int y, int x);
+  Real Uy_at(int y, int x);
+  Real Ux_at(int y, int x);
+  Real S_at(int y, int x);
+  Real channel_at(int channel, int y, int x) const;
+  int get_num_channels() const { return static_cast<int>(channel_scale.size()); }
+  // index of the channel of config.scalar_channels called name, or -1
+  int find_channel(const std::string& name) const;
+  bool is_solid_at(int y, int x) const { return obstacles && obstacles->IsSolid(y, x); }
+
+  // iterations summed and worst relative residual over the last step; only
+  // filled in by the iterative backends
+  const SolverStats& get_pressure_stats() const { return pressure_stats; }
+  const SolverStats& get_diffusion_stats() const { return diffusion_stats; }
+  // whether the solves go through a backend rather than lin_solve
+  bool has_pressure_solver() const { return pressure_solver != nullptr; }
+  bool has_diffusion_solver() const { return diffusion_solver != nullptr; }
+  // critical path of the last step, when config.task_graph is set
+  const TaskGraphReport& get_step_report() const { return step_report; }
+  // tiles simulated in the last step, in block-sparse mode
+  int get_active_tiles() const { return tiles ? static_cast<int>(tiles->GetActive().size()) : 0; }
+  int get_num_tiles() const { return tiles ? tiles->GetNumTiles() : 0; }
+  // format the density is actually stored in
+  ScalarStorage get_density_storage() const {
+    return packed_S ? packed_S->front().storage() : ScalarStorage::Float32;
+  }
+
+  // Adds the tasks of project() on the graph grids uy and ux, after the
+  // tasks in after.
+  GraphProjection add_projection_tasks(TaskGraph& graph, int uy, int ux,
+                                       const std::vector<int>& after,
+                                       const std::vector<std::pair<int, int>>& bands,
+                                       const std::string& label);
 
   // from solver
-  void v_step(std::vector<float> U1_y, std::vector<float> U1_x, std::vector<float> U0_y, std::vector<float> U0_x);
-  void s_step(std::vector<float> S1, std::vector<float> S0, std::vector<float> U_y, std::vector<float> U_x);
+  void v_step(DoubleBuffer& U_y, DoubleBuffer& U_x);
+  void s_step(DoubleBuffer& S, const Field2D& U_y, const Field2D& U_x);
+
+  void accumulate_stats(SolverStats& total, const SolverStats& solve) {
+    total.iterations += solve.iterations;
+    total.residual = std::max(total.residual, solve.residual);
+  }
 
-  void negate_field(std::vector<float> field){
-    for (int i=0; i<num_cells; i++) {field[i] = -field[i];}
+  void negate_field(Field2D& field){
+    pool.ParallelFor(0, cells_y, [&](int y0, int y1) {
+        for (int i = IndexOf(y0, 0); i < IndexOf(y1, 0); i++) {field[i] = -field[i];}
+    });
   }
 
-  void set_boundary_values(std::vector<float> field, int key);
+  void set_boundary_values(Field2D& field, FieldKind kind);
+  // Fills the solid cells next to the fluid, with the wall policy of kind
+  // (free slip in place of periodic).
+  void fill_obstacles(Field2D& field, FieldKind kind);
+  void set_face_boundary_values(Field2D& field, bool vertical);
 
-  void add_force(std::vector<float> field, std::vector<float> force, int key){
-    for (int y = 1; y < CELLS_Y - 1; y++) {
-        for (int x = 1; x < CELLS_X - 1; x++) {
-            field[IndexOf(y, x)] += force[IndexOf(y, x)];
+  // Block-sparse mode: recomputes the active tiles from the current state
+  // and zeroes every grid on the tiles that were dropped.
+  void update_tiles();
+
+  // Moves the moving obstacles to their current poses, at the start of a
+  // step: sets the wall velocity on their rims, gives the cells they
+  // uncovered the velocity of the obstacle that left them, and clears the
+  // cells they covered.
+  void update_moving_obstacles();
+  // Zeroes the density and every channel of cell (y, x).
+  void clear_scalars_at(int y, int x);
+
+  // Runs body(y0, y1, x0, x1) over the fluid cells of interior rows
+  // [y0, y1): in one call without obstacles, else once per run.
+  template <class Body>
+  void for_each_run(int y0, int y1, Body body) const {
+    if (!obstacles) {
+        body(y0, y1, 1, cells_x - 1);
+        return;
+    }
+    for (int y = y0; y < y1; y++) {
+        for (const CellRun& run : obstacles->GetRuns(y)) {
+            body(y, y + 1, run.x0, run.x1);
         }
     }
-    set_boundary_values(field, key);
   }
 
-  float lin_interp(float y, float x, std::vector<float> field){
-    int yfloor = floor(y);
-    int xfloor = floor(x);
+  // Runs body(y0, y1, x0, x1) on the pool for each active tile, clipped to
+  // the interior cells unless interior is false.
+  void for_each_tile(const std::function<void(int, int, int, int)>& body, bool interior = true) {
+    const std::vector<int>& active = tiles->GetActive();
+    pool.ParallelFor(0, static_cast<int>(active.size()), [&](int t0, int t1) {
+        for (int t = t0; t < t1; t++) {
+            TileBounds b = tiles->GetBounds(active[t]);
+            if (interior) {
+                b.y0 = std::max(b.y0, 1);
+                b.y1 = std::min(b.y1, cells_y - 1);
+                b.x0 = std::max(b.x0, 1);
+                b.x1 = std::min(b.x1, cells_x - 1);
+            }
+            if (b.y0 < b.y1 && b.x0 < b.x1) {
+                body(b.y0, b.y1, b.x0, b.x1);
+            }
+        }
+    }, 1);
+  }
+
+  void add_force(Field2D& field, const Field2D& force, FieldKind kind){
+    pool.ParallelFor(1, cells_y - 1, [&](int y0, int y1) {
+        for (int y = y0; y < y1; y++) {
+            for (int x = 1; x < cells_x - 1; x++) {
+                field[IndexOf(y, x)] += force[IndexOf(y, x)];
+            }
+        }
+    });
+    set_boundary_values(field, kind);
+  }
 
-    float ydiff = (y - 0.5f) - (float) yfloor;
-    float xdiff = (x - 0.5f) - (float) xfloor;
+  // Bilinear sample at (y, x), in cell units; same as advect_row's taps
+  // with the bilinear sampler.
+  Real lin_interp(Real y, Real x, const Field2D& field){
+    int yfloor = floor(y - 0.5f);
+    int xfloor = floor(x - 0.5f);
 
-    float tl = field[IndexOf(yfloor, xfloor)];
-    float bl = field[IndexOf(yfloor + 1, xfloor)];
-    float tr = field[IndexOf(yfloor, xfloor + 1)];
-    float br = field[IndexOf(yfloor + 1, xfloor + 1)];
+    Real ydiff = (y - 0.5f) - (Real) yfloor;
+    Real xdiff = (x - 0.5f) - (Real) xfloor;
 
-    float vl = (1.0f - ydiff) * tl + ydiff * bl;
-    float vr = (1.0f - ydiff) * tr + ydiff * br;
+    Real tl = field[IndexOf(yfloor, xfloor)];
+    Real bl = field[IndexOf(yfloor + 1, xfloor)];
+    Real tr = field[IndexOf(yfloor, xfloor + 1)];
+    Real br = field[IndexOf(yfloor + 1, xfloor + 1)];
+
+    Real vl = (1.0f - ydiff) * tl + ydiff * bl;
+    Real vr = (1.0f - ydiff) * tr + ydiff * br;
 
     return (1.0f - xdiff) * vl + xdiff * vr;
   }
 
-  void transport(std::vector<float> S1, std::vector<float> S0, std::vector<float> U_y, std::vector<float> U_x, int key){
-    for (int y = 1; y < CELLS_Y - 1; y++) {
-        for (int x = 1; x < CELLS_X - 1; x++) {
-            // trace particle
-            float y0 = ((float) y + 0.5f) - DT * U_y[IndexOf(y, x)];
-            float x0 = ((float) x + 0.5f) - DT * U_x[IndexOf(y, x)];
+  // Semi-Lagrangian advection: every interior cell traces its centre back
+  // along the velocity and samples S0 there. The other schemes correct
+  // that result, see AdvectionScheme.
+  void transport(Field2D& S1, const Field2D& S0, const Field2D& U_y, const Field2D& U_x, FieldKind kind,
+                 AdvectionScheme scheme){
+    Field2D* out = &S1;
+    const Field2D* in = &S0;
+    transport_fields(&out, &in, &kind, &scheme, 1, U_y, U_x);
+  }
+
+  // Advects both velocity components along U0 on either layout.
+  void transport_velocity(Field2D& U1_y, Field2D& U1_x, const Field2D& U0_y, const Field2D& U0_x);
 
-            y0 = fmax(1.0f, fmin(((float) CELLS_Y) - 2.0f, y0));
-            x0 = fmax(1.0f, fmin(((float) CELLS_X) - 2.0f, x0));
+  // Advects a cell-centred scalar along the velocity U on either layout.
+  void transport_scalar(Field2D& S1, const Field2D& S0, const Field2D& U_y, const Field2D& U_x);
 
-            S1[IndexOf(y, x)] = lin_interp(y0, x0, S0);
+  // MAC grid: fills u_x_at_y_faces and u_y_at_x_faces on rows [y0, y1).
+  void face_velocity_rows(const Field2D& U_y, const Field2D& U_x, int y0, int y1) {
+      Field2D& ux = *u_x_at_y_faces;
+      Field2D& uy = *u_y_at_x_faces;
+      for (int y = y0; y < y1; y++) {
+          for (int x = 1; x < cells_x - 1; x++) {
+              ux[IndexOf(y, x)] = 0.25f * (U_x[IndexOf(y - 1, x)] + U_x[IndexOf(y - 1, x + 1)]
+                                         + U_x[IndexOf(y, x)] + U_x[IndexOf(y, x + 1)]);
+              uy[IndexOf(y, x)] = 0.25f * (U_y[IndexOf(y, x - 1)] + U_y[IndexOf(y + 1, x - 1)]
+                                         + U_y[IndexOf(y, x)] + U_y[IndexOf(y + 1, x)]);
+          }
+      }
+  }
+
+  // MAC grid: fills u_y_at_centres and u_x_at_centres on rows [y0, y1).
+  void centre_velocity_rows(const Field2D& U_y, const Field2D& U_x, int y0, int y1) {
+      Field2D& uy = *u_y_at_centres;
+      Field2D& ux = *u_x_at_centres;
+      for (int y = y0; y < y1; y++) {
+          for (int x = 1; x < cells_x - 1; x++) {
+              uy[IndexOf(y, x)] = 0.5f * (U_y[IndexOf(y, x)] + U_y[IndexOf(y + 1, x)]);
+              ux[IndexOf(y, x)] = 0.5f * (U_x[IndexOf(y, x)] + U_x[IndexOf(y, x + 1)]);
+          }
+      }
+  }
+
+  // Advects rows [y0, y1) of count fields, given as raw grids, over a time
+  // step dt; a negative dt traces forward along the velocity.
+  void advect_rows(const Real* const* S0, Real* const* S1, int count,
+                   const Field2D& U_y, const Field2D& U_x, int y0, int y1, Real dt) {
+    for_each_run(y0, y1, [&](int ya, int yb, int x0, int x1) {
+        for (int y = ya; y < yb; y++) {
+            advect_row(S0, S1, count, U_y.data(), U_x.data(), y, x0, x1 - x0,
+                       cells_y, cells_x, dt);
         }
-    }
-    set_boundary_values(S1, key);
+    });
+  }
+
+  // transport() for count fields along the same velocities, in one sweep:
+  // each departure point and its weights are computed once for all of
+  // them. S0[i] is advected into S1[i] with schemes[i], and S1[i] then gets
+  // the boundary values of kinds[i].
+  void transport_fields(Field2D* const* S1, const Field2D* const* S0, const FieldKind* kinds,
+                        const AdvectionScheme* schemes, int count,
+                        const Field2D& U_y, const Field2D& U_x);
+
+  // Turns the semi-Lagrangian result S1 of S0 into the MacCormack or BFECC
+  // one, for count fields; see Fluid.cpp.
+  void correct_advection(AdvectionScheme scheme, Field2D* const* S1, const Field2D* const* S0,
+                         const FieldKind* kinds, int count, const Field2D& U_y, const Field2D& U_x);
+
+  // MacCormack: S1 += (S0 - back) / 2 on rows [y0, y1), where back is S1
+  // traced back to the start of the step.
+  void maccormack_rows(Real* const* S1, const Real* const* S0, const Real* const* back,
+                       int count, int y0, int y1) {
+      for (int f = 0; f < count; f++) {
+          for_each_run(y0, y1, [&](int ya, int yb, int x0, int x1) {
+              for (int y = ya; y < yb; y++) {
+                  for (int x = x0; x < x1; x++) {
+                      const int i = IndexOf(y, x);
+                      S1[f][i] += 0.5f * (S0[f][i] - back[f][i]);
+                  }
+              }
+          });
+      }
   }
 
-  void lin_solve(std::vector<float> S1, std::vector<float> S0, float a, float b, int key) {
-    for (int i = 0; i < NUM_ITER; i++) {
-        for (int y = 1; y < CELLS_Y - 1; y++) {
-            for (int x = 1; x < CELLS_X - 1; x++) {
-                S1[IndexOf(y, x)] = (S0[IndexOf(y, x)]
-                        + a * (S1[IndexOf(y + 1, x)] + S1[IndexOf(y - 1, x)]
-                             + S1[IndexOf(y, x + 1)] + S1[IndexOf(y, x - 1)])) / b;
+  // BFECC: back = S0 + (S0 - back) / 2, the start of the step with the
+  // round-trip error removed, on rows [y0, y1). The walls keep S0.
+  void bfecc_rows(Real* const* back, const Real* const* S0, int count, int y0, int y1) {
+      for (int f = 0; f < count; f++) {
+          for (int y = y0; y < y1; y++) {
+              const bool wall = y == 0 || y == cells_y - 1;
+              for (int x = 0; x < cells_x; x++) {
+                  const int i = IndexOf(y, x);
+                  if (wall || x == 0 || x == cells_x - 1) {
+                      back[f][i] = S0[f][i];
+                  } else {
+                      back[f][i] = S0[f][i] + 0.5f * (S0[f][i] - back[f][i]);
+                  }
+              }
+          }
+      }
+  }
+
+  // Clamps rows [y0, y1) of S1 to the four S0 values lin_interp blends at
+  // the departure point of each cell, traced the same way as advect_row.
+  void limit_rows(Real* const* S1, const Real* const* S0, int count,
+                  const Field2D& U_y, const Field2D& U_x, int y0, int y1) {
+      const Real y_max = static_cast<Real>(cells_y) - 2.0f;
+      const Real x_max = static_cast<Real>(cells_x) - 2.0f;
+      for_each_run(y0, y1, [&](int ya, int yb, int x0, int x1) {
+          for (int y = ya; y < yb; y++) {
+              for (int x = x0; x < x1; x++) {
+                  const int i = IndexOf(y, x);
+                  int yfloor;
+                  int xfloor;
+                  if (periodic) {
+                      // wrapped like the periodic advection kernel
+                      Real py = (static_cast<Real>(y) - 0.5f) - config.dt * U_y[i];
+                      Real px = (static_cast<Real>(x) - 0.5f) - config.dt * U_x[i];
+                      yfloor = floor(py - y_max * std::floor(py / y_max) + 0.5f);
+                      xfloor = floor(px - x_max * std::floor(px / x_max) + 0.5f);
+                  } else {
+                      Real py = (static_cast<Real>(y) + 0.5f) - config.dt * U_y[i];
+                      Real px = (static_cast<Real>(x) + 0.5f) - config.dt * U_x[i];
+                      yfloor = floor(std::max(Real(1), std::min(y_max, py)) - 0.5f);
+                      xfloor = floor(std::max(Real(1), std::min(x_max, px)) - 0.5f);
+                  }
+                  const int tap = IndexOf(yfloor, xfloor);
+                  for (int f = 0; f < count; f++) {
+                      const Real* t = S0[f] + tap;
+                      Real lo = std::min(std::min(t[0], t[1]), std::min(t[cells_x], t[cells_x + 1]));
+                      Real hi = std::max(std::max(t[0], t[1]), std::max(t[cells_x], t[cells_x + 1]));
+                      S1[f][i] = std::min(hi, std::max(lo, S1[f][i]));
+                  }
+              }
+          }
+      });
+  }
+
+  // Gauss-Seidel sweeps with the boundary policy of kind, see Fluid.cpp.
+  void lin_solve(Field2D& S1, const Field2D& S0, Real a, Real b, FieldKind kind);
+
+  template <class Policy>
+  void lin_solve_lexicographic(Field2D& S1, const Field2D& S0, Real a, Real b, FieldKind kind);
+
+  template <class Policy>
+  void lin_solve_red_black(Field2D& S1, const Field2D& S0, Real a, Real b, FieldKind kind);
+
+  // Fills the ghost ring of field with Policy, as separate passes.
+  template <class Policy>
+  void fill_boundary(Field2D& field);
+
+  // Gauss-Seidel sweeps over the active tiles in config.gauss_seidel_order;
+  // inactive neighbours read as zero. The lexicographic sweeps run on the
+  // calling thread, row by row across each row of tiles, so they visit the
+  // active cells in the same order as the dense sweeps.
+  void lin_solve_tiles(Field2D& S1, const Field2D& S0, Real a, Real b, FieldKind kind) {
+    const Real inv_b = 1.0f / b;
+    if (config.gauss_seidel_order == SweepOrder::Lexicographic) {
+        const std::vector<int>& active = tiles->GetActive();
+        for (int i = 0; i < config.num_iter; i++) {
+            for (size_t first = 0; first < active.size();) {
+                const int y0 = tiles->GetBounds(active[first]).y0;
+                size_t last = first;
+                while (last < active.size() && tiles->GetBounds(active[last]).y0 == y0) {
+                    last++;
+                }
+                const int y1 = std::min(tiles->GetBounds(active[first]).y1, cells_y - 1);
+                for (int y = std::max(y0, 1); y < y1; y++) {
+                    for (size_t t = first; t < last; t++) {
+                        const TileBounds bounds = tiles->GetBounds(active[t]);
+                        const int x1 = std::min(bounds.x1, cells_x - 1);
+                        for (int x = std::max(bounds.x0, 1); x < x1; x++) {
+                            S1[IndexOf(y, x)] = (S0[IndexOf(y, x)]
+                                    + a * (S1[IndexOf(y + 1, x)] + S1[IndexOf(y - 1, x)]
+                                         + S1[IndexOf(y, x + 1)] + S1[IndexOf(y, x - 1)])) * inv_b;
+                        }
+                    }
+                }
+                first = last;
             }
+            set_boundary_values(S1, kind);
         }
-        set_boundary_values(S1, key);
+        return;
+    }
+    for (int i = 0; i < config.num_iter; i++) {
+        for (int color = 0; color < 2; color++) {
+            for_each_tile([&](int y0, int y1, int x0, int x1) {
+                for (int y = y0; y < y1; y++) {
+                    for (int x = x0 + ((y + x0 + color) & 1); x < x1; x += 2) {
+                        S1[IndexOf(y, x)] = (S0[IndexOf(y, x)]
+                                + a * (S1[IndexOf(y + 1, x)] + S1[IndexOf(y - 1, x)]
+                                     + S1[IndexOf(y, x + 1)] + S1[IndexOf(y, x - 1)])) * inv_b;
+                    }
+                }
+            });
+        }
+        set_boundary_values(S1, kind);
     }
   }
 
-  void diffuse(std::vector<float> S1, std::vector<float> S0, float diff, int key) {
-    float a = DT * diff * num_cells;
-    lin_solve(S1, S0, a, 1.0f + 4.0f * a, key);
+  void diffuse(Field2D& S1, const Field2D& S0, float diff, FieldKind kind) {
+    Real a = config.dt * diff * num_cells;
+    if (diffusion_solver) {
+        // the backends treat every wall as Neumann; the field's own
+        // boundary condition is reapplied afterwards
+        diffusion_solver->Solve(S1, S0, a, 1.0f + 4.0f * a);
+        accumulate_stats(diffusion_stats, diffusion_solver->GetLastStats());
+        set_boundary_values(S1, kind);
+    } else {
+        lin_solve(S1, S0, a, 1.0f + 4.0f * a, kind);
+    }
   }
 
-  void project(std::vector<float> U1_y, std::vector<float> U1_x, std::vector<float> U0_y, std::vector<float> U0_x) {
-      // construct initial guess for the solution
-      std::vector<float> S(num_cells, 0.f);
-
-      // compute the divergence of the velocity field
-      std::vector<float> divergence(num_cells, 0.f);
-      for (int y = 1; y < CELLS_Y - 1; y++) {
-          for (int x = 1; x < CELLS_X - 1; x++) {
-              divergence[IndexOf(y, x)] = U0_y[IndexOf(y + 1, x)] - U0_y[IndexOf(y - 1, x)]
-                                      + U0_x[IndexOf(y, x + 1)] - U0_x[IndexOf(y, x - 1)];
-          }
+  // U1 may alias U0: the divergence is taken before U1 is written. The
+  // solid cells of U0 hold the mirrored fluid velocity, about the wall
+  // velocity for moving obstacles (see fill_obstacles), so the divergence
+  // next to a moving wall carries its motion into the pressure.
+  void project(Field2D& U1_y, Field2D& U1_x, const Field2D& U0_y, const Field2D& U0_x) {
+      // the negated divergence of the velocity field
+      if (tiles) {
+          for_each_tile([&](int y0, int y1, int x0, int x1) {
+              negative_divergence_block(divergence, U0_y, U0_x, y0, y1, x0, x1);
+          });
+      } else {
+          pool.ParallelFor(1, cells_y - 1, [&](int y0, int y1) {
+              negative_divergence_rows(divergence, U0_y, U0_x, y0, y1);
+          });
       }
-      set_boundary_values(divergence, 0);
+      set_boundary_values(divergence, FieldKind::Scalar);
 
       // solve the Poisson equation
-      negate_field(divergence);
-      lin_solve(S, divergence, 1.0f, 4.0f, 0);
+      solve_pressure();
 
       // subtract the gradient from the previous solution
-      for (int y = 1; y < CELLS_Y - 1; y++) {
-          for (int x = 1; x < CELLS_X - 1; x++) {
+      if (tiles) {
+          for_each_tile([&](int y0, int y1, int x0, int x1) {
+              subtract_gradient_block(U1_y, U1_x, U0_y, U0_x, y0, y1, x0, x1);
+          });
+      } else {
+          pool.ParallelFor(1, cells_y - 1, [&](int y0, int y1) {
+              subtract_gradient_rows(U1_y, U1_x, U0_y, U0_x, y0, y1);
+          });
+      }
+      set_boundary_values(U1_y, kind_y);
+      set_boundary_values(U1_x, kind_x);
+  }
+
+  // Right-hand side of the pressure solve on rows [y0, y1).
+  void negative_divergence_rows(Field2D& div, const Field2D& U0_y, const Field2D& U0_x, int y0, int y1) {
+      for_each_run(y0, y1, [&](int ya, int yb, int x0, int x1) {
+          negative_divergence_block(div, U0_y, U0_x, ya, yb, x0, x1);
+      });
+  }
+
+  // The same on columns [x0, x1) of those rows.
+  void negative_divergence_block(Field2D& div, const Field2D& U0_y, const Field2D& U0_x,
+                                 int y0, int y1, int x0, int x1) {
+      if (staggered) {
+          // net outflow through the four faces of each cell
+          for (int y = y0; y < y1; y++) {
+              for (int x = x0; x < x1; x++) {
+                  div[IndexOf(y, x)] = -(U0_y[IndexOf(y + 1, x)] - U0_y[IndexOf(y, x)]
+                                       + U0_x[IndexOf(y, x + 1)] - U0_x[IndexOf(y, x)]);
+              }
+          }
+          return;
+      }
+      for (int y = y0; y < y1; y++) {
+          for (int x = x0; x < x1; x++) {
+              div[IndexOf(y, x)] = -((U0_y[IndexOf(y + 1, x)] - U0_y[IndexOf(y - 1, x)]
+                                    + U0_x[IndexOf(y, x + 1)] - U0_x[IndexOf(y, x - 1)]) / 2.0f);
+          }
+      }
+  }
+
+  // Solves for the pressure from the negated divergence, starting from 0.
+  void solve_pressure() {
+      Field2D& S = pressure;
+      if (tiles) {
+          // the inactive tiles are zero already, and lin_solve_tiles keeps
+          // them so
+          for_each_tile([&](int y0, int y1, int x0, int x1) {
+              for (int y = y0; y < y1; y++) {
+                  std::fill(S.data() + IndexOf(y, x0), S.data() + IndexOf(y, x1), 0.f);
+              }
+          }, false);
+      } else {
+          S.fill(0.f);
+      }
+      if (pressure_solver) {
+          pressure_solver->Solve(S, divergence, 1.0f, 4.0f);
+          accumulate_stats(pressure_stats, pressure_solver->GetLastStats());
+      } else {
+          lin_solve(S, divergence, 1.0f, 4.0f, FieldKind::Scalar);
+      }
+  }
+
+  void subtract_gradient_rows(Field2D& U1_y, Field2D& U1_x, const Field2D& U0_y, const Field2D& U0_x,
+                              int y0, int y1) {
+      for_each_run(y0, y1, [&](int ya, int yb, int x0, int x1) {
+          subtract_gradient_block(U1_y, U1_x, U0_y, U0_x, ya, yb, x0, x1);
+      });
+  }
+
+  void subtract_gradient_block(Field2D& U1_y, Field2D& U1_x, const Field2D& U0_y, const Field2D& U0_x,
+                               int y0, int y1, int x0, int x1) {
+      const Field2D& S = pressure;
+      if (staggered) {
+          // the pressure difference across each face; the wall faces see
+          // none, since the solve mirrors the pressure into the boundary
+          for (int y = y0; y < y1; y++) {
+              for (int x = x0; x < x1; x++) {
+                  U1_y[IndexOf(y, x)] = U0_y[IndexOf(y, x)] - (S[IndexOf(y, x)] - S[IndexOf(y - 1, x)]);
+                  U1_x[IndexOf(y, x)] = U0_x[IndexOf(y, x)] - (S[IndexOf(y, x)] - S[IndexOf(y, x - 1)]);
+              }
+          }
+          return;
+      }
+      for (int y = y0; y < y1; y++) {
+          for (int x = x0; x < x1; x++) {
               U1_y[IndexOf(y, x)] = U0_y[IndexOf(y, x)] - (S[IndexOf(y + 1, x)] - S[IndexOf(y - 1, x)]) / 2.0f;
               U1_x[IndexOf(y, x)] = U0_x[IndexOf(y, x)] - (S[IndexOf(y, x + 1)] - S[IndexOf(y, x - 1)]) / 2.0f;
           }
       }
-      set_boundary_values(U1_y, 1);
-      set_boundary_values(U1_x, 2);
   }
 
-  void dissipate(std::vector<float> S1, std::vector<float> S0) {
-      for (int i = 0; i < num_cells; i++) {
-          S1[i] = S0[i] / (1.0f + DT * DISSIPATION);
+  // Advects, dissipates and diffuses every channel with the final
+  // velocity. The dissipation is a per-channel factor, so it commutes with
+  // the diffusion and is folded into the advection.
+  void step_channels(const Field2D& U_y, const Field2D& U_x) {
+      channels->swap();
+      pool.ParallelFor(1, cells_y - 1, [&](int y0, int y1) {
+          for_each_run(y0, y1, [&](int ya, int yb, int x0, int x1) {
+              channel_advect(channels->back(), channels->front(), U_y.data(), U_x.data(),
+                             channel_scale.data(), ya, yb, x0, x1, config.dt);
+          });
+      });
+      FillChannelWalls(channels->front(), obstacles.get());
+      if (channels_diffuse) {
+          channels->swap();
+          diffuse_channels(channels->front(), channels->back());
+      }
+  }
+
+  // lin_solve on every channel at once, with its red-black order applied
+  // to whole rows: the rows of one parity only read the other, so they
+  // are relaxed in parallel.
+  void diffuse_channels(BasicChannelField2D<Real>& S1, const BasicChannelField2D<Real>& S0) {
+      for (int i = 0; i < config.num_iter; i++) {
+          for (int parity = 0; parity < 2; parity++) {
+              const int first = 1 + parity;
+              const int rows = (cells_y - first) / 2;
+              pool.ParallelFor(0, rows, [&](int r0, int r1) {
+                  for (int r = r0; r < r1; r++) {
+                      const int y = first + 2 * r;
+                      for_each_run(y, y + 1, [&](int, int, int x0, int x1) {
+                          channel_relax(S1, S0, channel_a.data(), channel_inv_b.data(), y, x0, x1);
+                      });
+                  }
+              });
+              FillChannelWalls(S1, obstacles.get());
+          }
+      }
+  }
+
+  // U_y += dt * the buoyancy of the channels, on the fluid cells.
+  void add_buoyancy(Field2D& U_y) {
+      pool.ParallelFor(1, cells_y - 1, [&](int y0, int y1) {
+          for_each_run(y0, y1, [&](int ya, int yb, int x0, int x1) {
+              for (int y = ya; y < yb; y++) {
+                  AddChannelBuoyancy(channels->front(), channel_buoyancy.data(), U_y.data(), y, x0, x1,
+                                     config.dt);
+              }
+          });
+      });
+  }
+
+  void dissipate(Field2D& S1, const Field2D& S0) {
+      if (tiles) {
+          for_each_tile([&](int y0, int y1, int x0, int x1) {
+              for (int y = y0; y < y1; y++) {
+                  for (int x = x0; x < x1; x++) {
+                      S1[IndexOf(y, x)] = S0[IndexOf(y, x)] / (1.0f + config.dt * config.dissipation);
+                  }
+              }
+          }, false);
+          return;
       }
+      pool.ParallelFor(0, cells_y, [&](int y0, int y1) {
+          dissipate_rows(S1, S0, y0, y1);
+      });
   }
 
-  float curl(int y, int x, std::vector<float> U_y, std::vector<float> U_x) {
+  void dissipate_rows(Field2D& S1, const Field2D& S0, int y0, int y1) {
+      for (int i = IndexOf(y0, 0); i < IndexOf(y1, 0); i++) {
+          S1[i] = S0[i] / (1.0f + config.dt * config.dissipation);
+      }
+  }
+
+  Real curl(int y, int x, const Field2D& U_y, const Field2D& U_x) {
     return (U_y[IndexOf(y, x + 1)] - U_y[IndexOf(y, x - 1)]
             - U_x[IndexOf(y + 1, x)] + U_x[IndexOf(y - 1, x)]) / 2.0f;
   }
 
+  // U1 = U0 + dt * epsilon * (N x w), with w the curl and N the normalised
+  // gradient of |w|. U1 must not alias U0. The curl, its gradient and the
+  // force take one pass: each chunk of rows keeps the curl of three rows in
+  // a rolling buffer of its thread instead of storing the curl field.
+  void confine_vorticity(Field2D& U1_y, Field2D& U1_x, const Field2D& U0_y, const Field2D& U0_x) {
+      pool.ParallelForChunks(1, cells_y - 1, [&](int thread, int y0, int y1) {
+          confine_vorticity_rows(U1_y, U1_x, U0_y, U0_x, y0, y1, thread);
+      });
+  }
+
+  // The same on rows [y0, y1), with the rolling buffer of pool thread
+  // thread. The ghost rows and columns of the curl repeat their neighbour,
+  // so |w| has no gradient across the walls.
+  void confine_vorticity_rows(Field2D& U1_y, Field2D& U1_x, const Field2D& U0_y, const Field2D& U0_x,
+                              int y0, int y1, int thread) {
+      const Real scale = config.dt * config.vorticity_confinement;
+      Real* up = confine_rows.data() + static_cast<size_t>(3 * thread) * cells_x;
+      Real* mid = up + cells_x;
+      Real* down = mid + cells_x;
+      curl_row(up, std::max(y0 - 1, 1), U0_y, U0_x);
+      curl_row(mid, y0, U0_y, U0_x);
+      for (int y = y0; y < y1; y++) {
+          curl_row(down, std::min(y + 1, cells_y - 2), U0_y, U0_x);
+          for_each_run(y, y + 1, [&](int, int, int x0, int x1) {
+              confine_row(up + x0, mid + x0, down + x0, U0_y.data() + IndexOf(y, x0),
+                          U0_x.data() + IndexOf(y, x0), U1_y.data() + IndexOf(y, x0),
+                          U1_x.data() + IndexOf(y, x0), x1 - x0, scale);
+          });
+          Real* done = up;
+          up = mid;
+          mid = down;
+          down = done;
+      }
+  }
+
+  // curl() along row y, into the cells_x entries of row.
+  void curl_row(Real* row, int y, const Field2D& U_y, const Field2D& U_x) {
+      for (int x = 1; x < cells_x - 1; x++) {
+          row[x] = curl(y, x, U_y, U_x);
+      }
+      row[0] = row[1];
+      row[cells_x - 1] = row[cells_x - 2];
+  }
+
 };
+
+typedef BasicFluid<float> Fluid;
 }  // namespace GLOO
 
 #endif
@@ -0,0 +1,329 @@
+#include "Fluid3D.hpp"
+#include "gloo/utils.hpp"
+
+#include <cmath>
+#include <initializer_list>
+#include <stdexcept>
+
+namespace GLOO {
+namespace {
+// The solver backend of type, once CheckFluid3DConfig has ruled out all but
+// Gauss-Seidel (null) and multigrid.
+std::unique_ptr<Multigrid3DSolver> CreateSolver3D(LinearSolverType type,
+                                                  const SimulationConfig& config,
+                                                  ThreadPool& pool) {
+  if (type == LinearSolverType::GaussSeidel) {
+    return nullptr;
+  }
+  return make_unique<Multigrid3DSolver>(config, pool);
+}
+}  // namespace
+
+void CheckFluid3DConfig(const SimulationConfig& config) {
+  for (LinearSolverType type : {config.pressure_solver, config.diffusion_solver}) {
+    if (type != LinearSolverType::GaussSeidel && type != LinearSolverType::Multigrid) {
+      throw std::runtime_error("The volumetric mode solves with gauss-seidel or multigrid only.");
+    }
+  }
+  if (config.velocity_layout != VelocityLayout::Collocated || config.fused_advection ||
+      config.task_graph) {
+    throw std::runtime_error("The volumetric mode needs the collocated layout, unfused "
+                             "advection and the sequential step.");
+  }
+  if (config.velocity_advection != AdvectionScheme::SemiLagrangian ||
+      config.density_advection != AdvectionScheme::SemiLagrangian ||
+      config.advection_sampler != AdvectionSampler::Bilinear) {
+    throw std::runtime_error("The volumetric mode advects semi-Lagrangian with the linear sampler.");
+  }
+  if (config.walls != WallCondition::FreeSlip) {
+    throw std::runtime_error("The volumetric mode has free-slip walls only.");
+  }
+  if (config.sparse_tile_size > 0 || config.density_storage != ScalarStorage::Float32 ||
+      config.precision != Precision::Float) {
+    throw std::runtime_error("The volumetric mode runs dense and in float.");
+  }
+  if (!config.obstacle_image.empty() || !config.scalar_channels.empty() ||
+      config.vorticity_confinement > 0.f) {
+    throw std::runtime_error("The volumetric mode has no obstacles, scalar channels or vorticity "
+                             "confinement.");
+  }
+}
+
+// config is checked before any member is built from it.
+Fluid3D::Fluid3D(const SimulationConfig& config)
+    : config((CheckFluid3DConfig(config), config)),
+      cells_z(config.cells_z),
+      cells_y(config.cells_y),
+      cells_x(config.cells_x),
+      U_z(cells_z, cells_y, cells_x),
+      U_y(cells_z, cells_y, cells_x),
+      U_x(cells_z, cells_y, cells_x),
+      S(cells_z, cells_y, cells_x),
+      pressure(cells_z, cells_y, cells_x),
+      divergence(cells_z, cells_y, cells_x),
+      pool(config.num_threads, config.pin_threads, config.grain_size),
+      pressure_solver(CreateSolver3D(config.pressure_solver, config, pool)),
+      diffusion_solver(CreateSolver3D(config.diffusion_solver, config, pool)) {
+}
+
+void Fluid3D::step() {
+  pressure_stats = SolverStats();
+  diffusion_stats = SolverStats();
+  v_step();
+  s_step();
+}
+
+void Fluid3D::add_U_z_force_at(int z, int y, int x, float force) {
+    if (z > 0 && z < cells_z - 1 && y > 0 && y < cells_y - 1 && x > 0 && x < cells_x - 1) {
+        U_z.front()[IndexOf(z, y, x)] += force;
+    }
+}
+
+void Fluid3D::add_U_y_force_at(int z, int y, int x, float force) {
+    if (z > 0 && z < cells_z - 1 && y > 0 && y < cells_y - 1 && x > 0 && x < cells_x - 1) {
+        U_y.front()[IndexOf(z, y, x)] += force;
+    }
+}
+
+void Fluid3D::add_U_x_force_at(int z, int y, int x, float force) {
+    if (z > 0 && z < cells_z - 1 && y > 0 && y < cells_y - 1 && x > 0 && x < cells_x - 1) {
+        U_x.front()[IndexOf(z, y, x)] += force;
+    }
+}
+
+void Fluid3D::add_source_at(int z, int y, int x, float source) {
+    if (z > 0 && z < cells_z - 1 && y > 0 && y < cells_y - 1 && x > 0 && x < cells_x - 1) {
+        S.front()[IndexOf(z, y, x)] += source;
+    }
+}
+
+float Fluid3D::Uz_at(int z, int y, int x) {
+    return U_z.front()[IndexOf(z, y, x)];
+}
+
+float Fluid3D::Uy_at(int z, int y, int x) {
+    return U_y.front()[IndexOf(z, y, x)];
+}
+
+float Fluid3D::Ux_at(int z, int y, int x) {
+    return U_x.front()[IndexOf(z, y, x)];
+}
+
+float Fluid3D::S_at(int z, int y, int x) {
+    return S.front()[IndexOf(z, y, x)];
+}
+
+float Fluid3D::S_projected_at(int y, int x) {
+    float sum = 0.f;
+    for (int z = 1; z < cells_z - 1; z++) {
+        sum += S.front()[IndexOf(z, y, x)];
+    }
+    return sum / static_cast<float>(cells_z - 2);
+}
+
+void Fluid3D::v_step() {
+  set_boundary_values(U_z.front(), FieldKind3D::VelocityZ);
+  set_boundary_values(U_y.front(), FieldKind3D::VelocityY);
+  set_boundary_values(U_x.front(), FieldKind3D::VelocityX);
+
+  // diffuse
+  if (config.viscosity > 0.f) {
+    U_z.swap();
+    U_y.swap();
+    U_x.swap();
+    diffuse(U_z.front(), U_z.back(), config.viscosity, FieldKind3D::VelocityZ);
+    diffuse(U_y.front(), U_y.back(), config.viscosity, FieldKind3D::VelocityY);
+    diffuse(U_x.front(), U_x.back(), config.viscosity, FieldKind3D::VelocityX);
+  }
+  // pressure correction 1
+  project(U_z.front(), U_y.front(), U_x.front());
+
+  // advect
+  U_z.swap();
+  U_y.swap();
+  U_x.swap();
+  advect(U_z.front(), U_z.back(), U_z.back(), U_y.back(), U_x.back(), FieldKind3D::VelocityZ);
+  advect(U_y.front(), U_y.back(), U_z.back(), U_y.back(), U_x.back(), FieldKind3D::VelocityY);
+  advect(U_x.front(), U_x.back(), U_z.back(), U_y.back(), U_x.back(), FieldKind3D::VelocityX);
+
+  // pressure correction 2
+  project(U_z.front(), U_y.front(), U_x.front());
+}
+
+void Fluid3D::s_step() {
+  // advect according to velocity field
+  S.swap();
+  advect(S.front(), S.back(), U_z.front(), U_y.front(), U_x.front(), FieldKind3D::Scalar);
+
+  // diffuse
+  if (config.diffusion > 0.0f) {
+      S.swap();
+      diffuse(S.front(), S.back(), config.diffusion, FieldKind3D::Scalar);
+  }
+
+  // dissipate
+  S.swap();
+  dissipate(S.front(), S.back());
+}
+
+// Cells of one colour only couple to the other colour, so each colour is
+// split over slabs and the result does not depend on the thread count.
+void Fluid3D::lin_solve(Field3D& S1, const Field3D& S0, float a, float b, FieldKind3D kind) {
+  const size_t sy = cells_x;
+  const size_t sz = static_cast<size_t>(cells_y) * cells_x;
+  float* x = S1.data();
+  const float* rhs = S0.data();
+  for (int i = 0; i < config.num_iter; i++) {
+    for (int color = 0; color < 2; color++) {
+      pool.ParallelFor(1, cells_z - 1, [&](int z0, int z1) {
+        for (int z = z0; z < z1; z++) {
+          for (int y = 1; y < cells_y - 1; y++) {
+            const size_t row = IndexOf(z, y, 0);
+            for (size_t k = row + 1 + ((z + y + color) & 1); k < row + cells_x - 1; k += 2) {
+              x[k] = (rhs[k] + a * (x[k - sz] + x[k + sz] + x[k - sy] + x[k + sy]
+                                    + x[k - 1] + x[k + 1])) / b;
+            }
+          }
+        }
+      });
+    }
+    set_boundary_values(S1, kind);
+  }
+}
+
+void Fluid3D::diffuse(Field3D& S1, const Field3D& S0, float diff, FieldKind3D kind) {
+  // the same scale as the 2D solver, which uses its cell count
+  float a = config.dt * diff * cells_y * cells_x;
+  if (diffusion_solver) {
+    diffusion_solver->Solve(S1, S0, a, 1.0f + 6.0f * a);
+    accumulate_stats(diffusion_stats, diffusion_solver->GetLastStats());
+    set_boundary_values(S1, kind);
+  } else {
+    lin_solve(S1, S0, a, 1.0f + 6.0f * a, kind);
+  }
+}
+
+void Fluid3D::project(Field3D& U1_z, Field3D& U1_y, Field3D& U1_x) {
+  const size_t sy = cells_x;
+  const size_t sz = static_cast<size_t>(cells_y) * cells_x;
+
+  // the negated divergence of the velocity field
+  pool.ParallelFor(1, cells_z - 1, [&](int z0, int z1) {
+    for (int z = z0; z < z1; z++) {
+      for (int y = 1; y < cells_y - 1; y++) {
+        for (int x = 1; x < cells_x - 1; x++) {
+          const size_t k = IndexOf(z, y, x);
+          divergence[k] = -((U1_z[k + sz] - U1_z[k - sz] + U1_y[k + sy] - U1_y[k - sy]
+                             + U1_x[k + 1] - U1_x[k - 1]) / 2.0f);
+        }
+      }
+    }
+  });
+  set_boundary_values(divergence, FieldKind3D::Scalar);
+
+  // solve the Poisson equation, starting from 0
+  pressure.fill(0.f);
+  if (pressure_solver) {
+    pressure_solver->Solve(pressure, divergence, 1.0f, 6.0f);
+    accumulate_stats(pressure_stats, pressure_solver->GetLastStats());
+  } else {
+    lin_solve(pressure, divergence, 1.0f, 6.0f, FieldKind3D::Scalar);
+  }
+
+  // subtract the gradient from the previous solution
+  const Field3D& p = pressure;
+  pool.ParallelFor(1, cells_z - 1, [&](int z0, int z1) {
+    for (int z = z0; z < z1; z++) {
+      for (int y = 1; y < cells_y - 1; y++) {
+        for (int x = 1; x < cells_x - 1; x++) {
+          const size_t k = IndexOf(z, y, x);
+          U1_z[k] -= (p[k + sz] - p[k - sz]) / 2.0f;
+          U1_y[k] -= (p[k + sy] - p[k - sy]) / 2.0f;
+          U1_x[k] -= (p[k + 1] - p[k - 1]) / 2.0f;
+        }
+      }
+    }
+  });
+  set_boundary_values(U1_z, FieldKind3D::VelocityZ);
+  set_boundary_values(U1_y, FieldKind3D::VelocityY);
+  set_boundary_values(U1_x, FieldKind3D::VelocityX);
+}
+
+// Departure points are clamped to the interior like Fluid's advect_row, so
+// the eight taps never leave the grid.
+void Fluid3D::advect(Field3D& S1, const Field3D& S0, const Field3D& U_z, const Field3D& U_y,
+                     const Field3D& U_x, FieldKind3D kind) {
+  const float z_max = static_cast<float>(cells_z) - 2.0f;
+  const float y_max = static_cast<float>(cells_y) - 2.0f;
+  const float x_max = static_cast<float>(cells_x) - 2.0f;
+  const size_t sy = cells_x;
+  const size_t sz = static_cast<size_t>(cells_y) * cells_x;
+  pool.ParallelFor(1, cells_z - 1, [&](int z0, int z1) {
+    for (int z = z0; z < z1; z++) {
+      for (int y = 1; y < cells_y - 1; y++) {
+        for (int x = 1; x < cells_x - 1; x++) {
+          const size_t k = IndexOf(z, y, x);
+          float pz = std::max(1.0f, std::min(z_max, (static_cast<float>(z) + 0.5f) - config.dt * U_z[k]));
+          float py = std::max(1.0f, std::min(y_max, (static_cast<float>(y) + 0.5f) - config.dt * U_y[k]));
+          float px = std::max(1.0f, std::min(x_max, (static_cast<float>(x) + 0.5f) - config.dt * U_x[k]));
+          int zfloor = static_cast<int>(std::floor(pz - 0.5f));
+          int yfloor = static_cast<int>(std::floor(py - 0.5f));
+          int xfloor = static_cast<int>(std::floor(px - 0.5f));
+          float tz = (pz - 0.5f) - static_cast<float>(zfloor);
+          float ty = (py - 0.5f) - static_cast<float>(yfloor);
+          float tx = (px - 0.5f) - static_cast<float>(xfloor);
+
+          const float* t = S0.data() + IndexOf(zfloor, yfloor, xfloor);
+          float near_top = (1.0f - tx) * t[0] + tx * t[1];
+          float near_bottom = (1.0f - tx) * t[sy] + tx * t[sy + 1];
+          float far_top = (1.0f - tx) * t[sz] + tx * t[sz + 1];
+          float far_bottom = (1.0f - tx) * t[sz + sy] + tx * t[sz + sy + 1];
+          float near = (1.0f - ty) * near_top + ty * near_bottom;
+          float far = (1.0f - ty) * far_top + ty * far_bottom;
+          S1[k] = (1.0f - tz) * near + tz * far;
+        }
+      }
+    }
+  });
+  set_boundary_values(S1, kind);
+}
+
+void Fluid3D::dissipate(Field3D& S1, const Field3D& S0) {
+  const size_t sz = static_cast<size_t>(cells_y) * cells_x;
+  pool.ParallelFor(0, cells_z, [&](int z0, int z1) {
+    for (size_t i = z0 * sz; i < z1 * sz; i++) {
+      S1[i] = S0[i] / (1.0f + config.dt * config.dissipation);
+    }
+  });
+}
+
+// Each wall is copied from its interior neighbour, slab by slab; the edges
+// and corners copy from the walls filled before them.
+void Fluid3D::set_boundary_values(Field3D& field, FieldKind3D kind) {
+  const float z_sign = kind == FieldKind3D::VelocityZ ? -1.0f : 1.0f;
+  const float y_sign = kind == FieldKind3D::VelocityY ? -1.0f : 1.0f;
+  const float x_sign = kind == FieldKind3D::VelocityX ? -1.0f : 1.0f;
+  const size_t last_z = IndexOf(cells_z - 1, 0, 0);
+  const size_t sz = IndexOf(1, 0, 0);
+  pool.ParallelFor(1, cells_y - 1, [&](int y0, int y1) {
+    for (int y = y0; y < y1; y++) {
+      for (int x = 1; x < cells_x - 1; x++) {
+        field[IndexOf(0, y, x)] = z_sign * field[IndexOf(1, y, x)];
+        field[last_z + IndexOf(0, y, x)] = z_sign * field[last_z - sz + IndexOf(0, y, x)];
+      }
+    }
+  });
+  pool.ParallelFor(0, cells_z, [&](int z0, int z1) {
+    for (int z = z0; z < z1; z++) {
+      for (int x = 1; x < cells_x - 1; x++) {
+        field[IndexOf(z, 0, x)] = y_sign * field[IndexOf(z, 1, x)];
+        field[IndexOf(z, cells_y - 1, x)] = y_sign * field[IndexOf(z, cells_y - 2, x)];
+      }
+      for (int y = 0; y < cells_y; y++) {
+        field[IndexOf(z, y, 0)] = x_sign * field[IndexOf(z, y, 1)];
+        field[IndexOf(z, y, cells_x - 1)] = x_sign * field[IndexOf(z, y, cells_x - 2)];
+      }
+    }
+  });
+}
+}  // namespace GLOO
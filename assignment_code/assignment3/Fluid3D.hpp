@@ -0,0 +1,115 @@
+#ifndef FLUID3D_H_
+#define FLUID3D_H_
+
+#include "gloo/SceneNode.hpp"
+#include "Parameters.hpp"
+#include "BoundaryConditions.hpp"
+#include "Field3D.hpp"
+#include "Multigrid3D.hpp"
+#include "PoissonSolver.hpp"
+#include "ThreadPool.hpp"
+#include <algorithm>
+#include <memory>
+
+
+namespace GLOO {
+// Throws std::runtime_error when config asks Fluid3D for a setting it does
+// not support. The constructor and main.cpp both check through here.
+void CheckFluid3DConfig(const SimulationConfig& config);
+
+// Volumetric counterpart of Fluid, selected by config.cells_z > 1. The step
+// is the same: velocity walls, diffuse, project, advect, project, then the
+// density is advected, diffused and dissipated. Grids are slab-ordered
+// Field3Ds with a layer of boundary cells on every side, and every stencil
+// loop is split over z slabs on the pool.
+//
+// Only the collocated layout with free-slip walls and semi-Lagrangian
+// trilinear advection is supported, run densely in float by the sequential
+// step; the constructor throws for anything else (see CheckFluid3DConfig).
+// The Gauss-Seidel backend runs num_iter red-black sweeps whatever
+// gauss_seidel_order says, and the multigrid one uses Multigrid3DSolver.
+class Fluid3D : public SceneNode {
+private:
+  SimulationConfig config;
+
+  // grid dimensions, fixed at construction
+  const int cells_z;
+  const int cells_y;
+  const int cells_x;
+
+  // velocity grids; front() holds the current state
+  DoubleBuffer3D U_z;
+  DoubleBuffer3D U_y;
+  DoubleBuffer3D U_x;
+
+  // scalar grids - density values
+  DoubleBuffer3D S;
+
+  // scratch grids for the pressure projection
+  Field3D pressure;
+  Field3D divergence;
+
+  ThreadPool pool;
+
+  // linear solver backends; null selects lin_solve (Gauss-Seidel)
+  std::unique_ptr<Multigrid3DSolver> pressure_solver;
+  std::unique_ptr<Multigrid3DSolver> diffusion_solver;
+
+  // solver reports summed over the current step
+  SolverStats pressure_stats;
+  SolverStats diffusion_stats;
+
+public:
+  explicit Fluid3D(const SimulationConfig& config);
+
+  size_t IndexOf(int z, int y, int x) const {
+    return (static_cast<size_t>(z) * cells_y + y) * cells_x + x;
+  }
+  void step();
+
+  // setters
+  void add_U_z_force_at(int z, int y, int x, float force);
+  void add_U_y_force_at(int z, int y, int x, float force);
+  void add_U_x_force_at(int z, int y, int x, float force);
+  void add_source_at(int z, int y, int x, float source);
+
+  // getters
+  float Uz_at(int z, int y, int x);
+  float Uy_at(int z, int y, int x);
+  float Ux_at(int z, int y, int x);
+  float S_at(int z, int y, int x);
+  // mean density of the interior cells along z, for the frame images
+  float S_projected_at(int y, int x);
+
+  // see Fluid
+  const SolverStats& get_pressure_stats() const { return pressure_stats; }
+  const SolverStats& get_diffusion_stats() const { return diffusion_stats; }
+  bool has_pressure_solver() const { return pressure_solver != nullptr; }
+  bool has_diffusion_solver() const { return diffusion_solver != nullptr; }
+
+  void v_step();
+  void s_step();
+
+  void accumulate_stats(SolverStats& total, const SolverStats& solve) {
+    total.iterations += solve.iterations;
+    total.residual = std::max(total.residual, solve.residual);
+  }
+
+  // Copies the neighbour into every wall cell, negated on the walls normal
+  // to a velocity component (see FieldKind3D).
+  void set_boundary_values(Field3D& field, FieldKind3D kind);
+
+  // num_iter red-black sweeps of
+  //   b * S1 - a * (sum of the six neighbours of S1) = S0
+  void lin_solve(Field3D& S1, const Field3D& S0, float a, float b, FieldKind3D kind);
+  void diffuse(Field3D& S1, const Field3D& S0, float diff, FieldKind3D kind);
+  // In place: the divergence is taken before the velocity is written.
+  void project(Field3D& U1_z, Field3D& U1_y, Field3D& U1_x);
+  // Semi-Lagrangian advection of S0 along the velocity, sampled trilinearly.
+  void advect(Field3D& S1, const Field3D& S0, const Field3D& U_z, const Field3D& U_y,
+              const Field3D& U_x, FieldKind3D kind);
+  void dissipate(Field3D& S1, const Field3D& S0);
+};
+}  // namespace GLOO
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef HALF_FLOAT_H_
+#define HALF_FLOAT_H_
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+namespace GLOO {
+// Scalar conversions between float and the 16-bit storage formats, rounding
+// to nearest even like the F16C instructions and the vector kernels in
+// AdvectionKernels.cpp, so every path stores the same bits.
+
+// IEEE binary16: 5 exponent and 10 mantissa bits, subnormals included.
+// Values from 65520 up overflow to infinity.
+inline uint16_t FloatToHalf(float value) {
+  uint32_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  const uint16_t sign = static_cast<uint16_t>((bits >> 16) & 0x8000u);
+  uint32_t magnitude = bits & 0x7FFFFFFFu;
+  if (magnitude >= 0x7F800000u) {
+    // infinity, or a quiet NaN
+    return sign | 0x7C00u | (magnitude > 0x7F800000u ? 0x0200u : 0u);
+  }
+  if (magnitude >= 0x477FF000u) {
+    return sign | 0x7C00u;
+  }
+  if (magnitude < 0x38800000u) {
+    // subnormal: the magnitude in units of 2^-24, rounded to nearest even
+    float scaled;
+    std::memcpy(&scaled, &magnitude, sizeof(scaled));
+    return sign | static_cast<uint16_t>(std::nearbyint(scaled * 16777216.0f));
+  }
+  // rebias the exponent from 127 to 15 and round off 13 mantissa bits
+  magnitude -= 0x38000000u;
+  magnitude += 0x0FFFu + ((magnitude >> 13) & 1u);
+  return sign | static_cast<uint16_t>(magnitude >> 13);
+}
+
+inline float HalfToFloat(uint16_t half) {
+  const uint32_t sign = static_cast<uint32_t>(half & 0x8000u) << 16;
+  const uint32_t exponent = (half >> 10) & 0x1Fu;
+  const uint32_t mantissa = half & 0x3FFu;
+  uint32_t bits;
+  if (exponent == 0) {
+    float value = std::ldexp(static_cast<float>(mantissa), -24);
+    return sign ? -value : value;
+  } else if (exponent == 31) {
+    bits = sign | 0x7F800000u | (mantissa << 13);
+  } else {
+    bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+  }
+  float value;
+  std::memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+// bfloat16: the upper half of a float, with the float's exponent range and
+// 7 mantissa bits.
+inline uint16_t FloatToBFloat16(float value) {
+  uint32_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  if ((bits & 0x7FFFFFFFu) > 0x7F800000u) {
+    return static_cast<uint16_t>((bits >> 16) | 0x0040u);
+  }
+  bits += 0x7FFFu + ((bits >> 16) & 1u);
+  return static_cast<uint16_t>(bits >> 16);
+}
+
+inline float BFloat16ToFloat(uint16_t bfloat) {
+  const uint32_t bits = static_cast<uint32_t>(bfloat) << 16;
+  float value;
+  std::memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+}  // namespace GLOO
+
+#endif
@@ -0,0 +1,286 @@
+#include "Jacobi.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <utility>
+
+namespace GLOO {
+namespace {
+// Rows start on 64-byte boundaries.
+const int kAlignBytes = 64;
+// A sweep's update is w / c times the residual of the previous iterate, so
+// the residual norm costs one extra pass; it is taken every few sweeps.
+const int kCheckInterval = 8;
+
+int RoundUp(int value, int multiple) {
+  return (value + multiple - 1) / multiple * multiple;
+}
+
+// Row stride for n interior cells of type Real: one aligned block in front
+// of the interior holds the left wall.
+template <typename Real>
+int PaddedStride(int n) {
+  const int align = kAlignBytes / sizeof(Real);
+  return RoundUp(align + n + 1, align);
+}
+}  // namespace
+
+template <typename Real>
+JacobiSolver<Real>::JacobiSolver(const SimulationConfig& config, ThreadPool& pool)
+    : pool_(pool),
+      weight_(config.jacobi_weight),
+      tolerance_(config.solver_tolerance),
+      max_iter_(config.solver_max_iter),
+      ny_(config.cells_y - 2),
+      nx_(config.cells_x - 2),
+      stride_(PaddedStride<Real>(nx_)),
+      simd_level_(DetectSimdLevel()),
+      kernel_(GetJacobiRowKernel<Real>(simd_level_)),
+      tile_size_(std::max(config.jacobi_tile_size, 0)),
+      time_block_(std::max(config.jacobi_time_block, 1)),
+      tiles_y_(0),
+      tiles_x_(0),
+      tile_stride_(0) {
+  Allocate(x_[0], ny_ + 2, stride_);
+  Allocate(x_[1], ny_ + 2, stride_);
+  Allocate(rhs_, ny_ + 2, stride_);
+
+  if (tile_size_ > 0) {
+    tiles_y_ = (ny_ + tile_size_ - 1) / tile_size_;
+    tiles_x_ = (nx_ + tile_size_ - 1) / tile_size_;
+    const int span = tile_size_ + 2 * time_block_;
+    tile_stride_ = PaddedStride<Real>(span);
+    // sized once: the buffers' origins point into their own storage
+    tile_work_.resize(2 * pool_.GetNumThreads());
+    for (PaddedGrid& grid : tile_work_) {
+      Allocate(grid, span + 2, tile_stride_);
+    }
+    tile_update2_.assign(tiles_y_ * tiles_x_, 0.0);
+  }
+}
+
+template <typename Real>
+void JacobiSolver<Real>::Allocate(PaddedGrid& grid, int rows, int stride) {
+  const int align = kAlignBytes / sizeof(Real);
+  grid.storage.assign(static_cast<size_t>(rows) * stride + 2 * align, Real(0));
+  uintptr_t address = reinterpret_cast<uintptr_t>(grid.storage.data());
+  uintptr_t aligned = (address + kAlignBytes - 1) &
+                      ~static_cast<uintptr_t>(kAlignBytes - 1);
+  grid.origin = reinterpret_cast<Real*>(aligned) + align;
+}
+
+template <typename Real>
+void JacobiSolver<Real>::Solve(BasicField2D<Real>& x,
+                               const BasicField2D<Real>& rhs, Real a,
+                               Real c) {
+  const bool singular = c == 4.0f * a;
+  const int s = nx_ + 2;
+  const Real* b = rhs.data();
+  Real* xd = x.data();
+  Real* cur = x_[0].origin;
+  Real* next = x_[1].origin;
+  Real* r = rhs_.origin;
+
+  // A pure Neumann problem only sees the mean-free part of the right-hand
+  // side; without the mean the iterates do not drift.
+  double b_mean = 0.0;
+  if (singular) {
+    b_mean = pool_.ParallelSum(1, ny_ + 1, [&](int y0, int y1) {
+      double sum = 0.0;
+      for (int y = y0; y < y1; y++) {
+        for (int k = y * s + 1; k <= y * s + nx_; k++) {
+          sum += b[k];
+        }
+      }
+      return sum;
+    }) / (static_cast<double>(ny_) * nx_);
+  }
+  const Real mean = static_cast<Real>(b_mean);
+  double b_norm2 = pool_.ParallelSum(1, ny_ + 1, [&](int y0, int y1) {
+    double sum = 0.0;
+    for (int y = y0; y < y1; y++) {
+      for (int i = 0; i < nx_; i++) {
+        Real value = b[y * s + 1 + i] - mean;
+        r[y * stride_ + i] = value;
+        cur[y * stride_ + i] = xd[y * s + 1 + i];
+        sum += static_cast<double>(value) * value;
+      }
+    }
+    return sum;
+  });
+  if (b_norm2 == 0.0) {
+    x.fill(0.f);
+    this->stats_.iterations = 0;
+    this->stats_.residual = 0.f;
+    return;
+  }
+  const double b_norm = std::sqrt(b_norm2);
+
+  const Real inv_c = 1.0f / c;
+  double residual = 0.0;
+  this->stats_.iterations = 0;
+  while (this->stats_.iterations < max_iter_) {
+    bool check;
+    double update2;
+    if (tile_size_ > 0) {
+      // the last sweep of a block is measured in cache, so every block
+      // is checked
+      int depth = std::min(time_block_, max_iter_ - this->stats_.iterations);
+      update2 = SweepTiled(cur, next, a, inv_c, depth);
+      this->stats_.iterations += depth;
+      check = true;
+    } else {
+      this->stats_.iterations++;
+      check = this->stats_.iterations % kCheckInterval == 0 ||
+              this->stats_.iterations == max_iter_;
+      update2 = Sweep(cur, next, a, inv_c, check);
+    }
+    if (check) {
+      residual = c / weight_ * std::sqrt(update2) / b_norm;
+    }
+    std::swap(cur, next);
+    if (check && residual < tolerance_) {
+      break;
+    }
+  }
+
+  pool_.ParallelFor(1, ny_ + 1, [&](int y0, int y1) {
+    for (int y = y0; y < y1; y++) {
+      for (int i = 0; i < nx_; i++) {
+        xd[y * s + 1 + i] = cur[y * stride_ + i];
+      }
+    }
+  });
+  FillNeumannBoundary(xd, ny_ + 2, nx_ + 2);
+  this->stats_.residual = static_cast<float>(residual);
+}
+
+template <typename Real>
+double JacobiSolver<Real>::Sweep(Real* cur, Real* next, Real a, Real inv_c,
+                           bool measure) {
+  FillBoundary(cur);
+  const Real* r = rhs_.origin;
+  pool_.ParallelFor(1, ny_ + 1, [&](int y0, int y1) {
+    for (int y = y0; y < y1; y++) {
+      const Real* row = cur + y * stride_;
+      kernel_(row, row - stride_, row + stride_, r + y * stride_,
+              next + y * stride_, nx_, a, inv_c, weight_);
+    }
+  });
+  if (!measure) {
+    return 0.0;
+  }
+  return pool_.ParallelSum(1, ny_ + 1, [&](int y0, int y1) {
+    double sum = 0.0;
+    for (int y = y0; y < y1; y++) {
+      for (int i = y * stride_; i < y * stride_ + nx_; i++) {
+        Real d = next[i] - cur[i];
+        sum += static_cast<double>(d) * d;
+      }
+    }
+    return sum;
+  });
+}
+
+// Interior cells (gy, gx) are numbered from 0 here. The local buffers hold
+// the loaded region [ly0, ly1) x [lx0, lx1) with the same one-cell ring
+// and padding as the full grid, so (gy, gx) is at
+// origin[(gy - ly0 + 1) * tile_stride_ + gx - lx0].
+template <typename Real>
+double JacobiSolver<Real>::SweepTiled(const Real* cur, Real* next, Real a,
+                                Real inv_c, int depth) {
+  const Real* r = rhs_.origin;
+  const int ls = tile_stride_;
+  pool_.ParallelForChunks(0, tiles_y_ * tiles_x_, [&](int chunk, int t0,
+                                                      int t1) {
+    Real* work[2] = {tile_work_[2 * chunk].origin,
+                      tile_work_[2 * chunk + 1].origin};
+    for (int t = t0; t < t1; t++) {
+      const int ty0 = t / tiles_x_ * tile_size_;
+      const int tx0 = t % tiles_x_ * tile_size_;
+      const int ty1 = std::min(ny_, ty0 + tile_size_);
+      const int tx1 = std::min(nx_, tx0 + tile_size_);
+      const int ly0 = std::max(0, ty0 - depth);
+      const int lx0 = std::max(0, tx0 - depth);
+      const int ly1 = std::min(ny_, ty1 + depth);
+      const int lx1 = std::min(nx_, tx1 + depth);
+
+      for (int gy = ly0; gy < ly1; gy++) {
+        const Real* src = cur + (gy + 1) * stride_;
+        std::copy(src + lx0, src + lx1, work[0] + (gy - ly0 + 1) * ls);
+      }
+
+      for (int k = 1; k <= depth; k++) {
+        Real* src = work[(k - 1) & 1];
+        Real* dst = work[k & 1];
+        // The valid region shrinks by one cell per sweep, except along
+        // the walls, whose boundary cells are refilled every sweep.
+        const int ay0 = ly0 == 0 ? 0 : ly0 + k;
+        const int ax0 = lx0 == 0 ? 0 : lx0 + k;
+        const int ay1 = ly1 == ny_ ? ny_ : ly1 - k;
+        const int ax1 = lx1 == nx_ ? nx_ : lx1 - k;
+        if (ly0 == 0) {
+          std::copy(src + ls + ax0 - lx0, src + ls + ax1 - lx0,
+                    src + ax0 - lx0);
+        }
+        if (ly1 == ny_) {
+          Real* last = src + (ny_ - ly0) * ls;
+          std::copy(last + ax0 - lx0, last + ax1 - lx0, last + ls + ax0 - lx0);
+        }
+        for (int gy = ay0; gy < ay1; gy++) {
+          Real* row = src + (gy - ly0 + 1) * ls;
+          if (lx0 == 0) {
+            row[-1] = row[0];
+          }
+          if (lx1 == nx_) {
+            row[nx_ - lx0] = row[nx_ - lx0 - 1];
+          }
+        }
+        for (int gy = ay0; gy < ay1; gy++) {
+          const Real* row = src + (gy - ly0 + 1) * ls + ax0 - lx0;
+          kernel_(row, row - ls, row + ls, r + (gy + 1) * stride_ + ax0,
+                  dst + (gy - ly0 + 1) * ls + ax0 - lx0, ax1 - ax0, a, inv_c,
+                  weight_);
+        }
+      }
+
+      const Real* result = work[depth & 1];
+      const Real* previous = work[(depth - 1) & 1];
+      double sum = 0.0;
+      for (int gy = ty0; gy < ty1; gy++) {
+        const int local = (gy - ly0 + 1) * ls - lx0;
+        Real* out = next + (gy + 1) * stride_;
+        for (int gx = tx0; gx < tx1; gx++) {
+          Real d = result[local + gx] - previous[local + gx];
+          sum += static_cast<double>(d) * d;
+          out[gx] = result[local + gx];
+        }
+      }
+      tile_update2_[t] = sum;
+    }
+  });
+
+  double update2 = 0.0;
+  for (double sum : tile_update2_) {
+    update2 += sum;
+  }
+  return update2;
+}
+
+template <typename Real>
+void JacobiSolver<Real>::FillBoundary(Real* origin) {
+  for (int y = 1; y <= ny_; y++) {
+    Real* row = origin + y * stride_;
+    row[-1] = row[0];
+    row[nx_] = row[nx_ - 1];
+  }
+  for (int i = 0; i < nx_; i++) {
+    origin[i] = origin[stride_ + i];
+    origin[(ny_ + 1) * stride_ + i] = origin[ny_ * stride_ + i];
+  }
+}
+
+template class JacobiSolver<float>;
+template class JacobiSolver<double>;
+}  // namespace GLOO
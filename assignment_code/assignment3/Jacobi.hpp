@@ -0,0 +1,79 @@
+#ifndef JACOBI_H_
+#define JACOBI_H_
+
+#include "PoissonSolver.hpp"
+#include "JacobiKernels.hpp"
+#include <vector>
+
+namespace GLOO {
+// Weighted Jacobi iteration with vectorized row kernels, picked for the
+// CPU at run time. The solver keeps its own copies of the solution and
+// the right-hand side in padded rows whose interior starts on a 64-byte
+// boundary, and ping-pongs between two solution copies. Rows are split
+// over the thread pool.
+//
+// With a tile size set, the sweeps are also blocked in time: each tile is
+// copied with a halo as deep as the time block into a per-thread buffer
+// that fits in L2, swept there several times while the valid region
+// shrinks by one cell per sweep, and only the tile itself is written back.
+// The halo cells are computed redundantly by neighbouring tiles, but the
+// grid crosses the memory bus once per time block instead of once per
+// sweep.
+template <typename Real>
+class JacobiSolver : public BasicPoissonSolver<Real> {
+ public:
+  JacobiSolver(const SimulationConfig& config, ThreadPool& pool);
+
+  void Solve(BasicField2D<Real>& x, const BasicField2D<Real>& rhs, Real a,
+             Real c) override;
+
+  SimdLevel GetSimdLevel() const {
+    return simd_level_;
+  }
+
+ private:
+  // A grid stored in padded rows, with a ring of boundary cells like a
+  // field.
+  struct PaddedGrid {
+    std::vector<Real> storage;
+    // the first interior cell of row 0; cell (y, x) is at
+    // origin[y * stride + x - 1]
+    Real* origin;
+  };
+
+  static void Allocate(PaddedGrid& grid, int rows, int stride);
+  void FillBoundary(Real* origin);
+  // One sweep over the whole grid. Returns the squared norm of the update
+  // if measure is set.
+  double Sweep(Real* cur, Real* next, Real a, Real inv_c, bool measure);
+  // depth sweeps, tile by tile. Returns the squared norm of the last
+  // sweep's update.
+  double SweepTiled(const Real* cur, Real* next, Real a, Real inv_c,
+                    int depth);
+
+  ThreadPool& pool_;
+  float weight_;
+  float tolerance_;
+  int max_iter_;
+  int ny_;
+  int nx_;
+  int stride_;
+  SimdLevel simd_level_;
+  BasicJacobiRowKernel<Real> kernel_;
+
+  PaddedGrid x_[2];
+  PaddedGrid rhs_;
+
+  // temporal tiling; tile_size_ == 0 sweeps the whole grid at a time
+  int tile_size_;
+  int time_block_;
+  int tiles_y_;
+  int tiles_x_;
+  int tile_stride_;
+  // two buffers per pool thread, allocated once
+  std::vector<PaddedGrid> tile_work_;
+  std::vector<double> tile_update2_;
+};
+}  // namespace GLOO
+
+#endif
@@ -0,0 +1,189 @@
+#include "JacobiKernels.hpp"
+
+#ifdef GLOO_SIMD_X86
+#include <immintrin.h>
+#endif
+
+namespace GLOO {
+namespace {
+template <typename Real>
+void JacobiRowScalar(const Real* x, const Real* up, const Real* down,
+                     const Real* rhs, Real* out, int n, Real a, Real inv_c,
+                     Real w) {
+  for (int i = 0; i < n; i++) {
+    Real sum = up[i] + down[i] + x[i - 1] + x[i + 1];
+    out[i] = x[i] + w * ((rhs[i] + a * sum) * inv_c - x[i]);
+  }
+}
+
+#ifdef GLOO_SIMD_X86
+// Finishes cells [i, n) inside a vector kernel. It is inlined so the tail
+// is encoded like the rest of the kernel: calling non-VEX SSE code after
+// 256-bit instructions stalls on the AVX/SSE transition.
+template <typename Real>
+__attribute__((always_inline)) inline void JacobiRowTail(
+    const Real* x, const Real* up, const Real* down, const Real* rhs,
+    Real* out, int i, int n, Real a, Real inv_c, Real w) {
+  for (; i < n; i++) {
+    Real sum = up[i] + down[i] + x[i - 1] + x[i + 1];
+    out[i] = x[i] + w * ((rhs[i] + a * sum) * inv_c - x[i]);
+  }
+}
+
+__attribute__((target("sse4.2"))) void JacobiRowSse42(
+    const float* x, const float* up, const float* down, const float* rhs,
+    float* out, int n, float a, float inv_c, float w) {
+  const __m128 va = _mm_set1_ps(a);
+  const __m128 vinv = _mm_set1_ps(inv_c);
+  const __m128 vw = _mm_set1_ps(w);
+  int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m128 center = _mm_loadu_ps(x + i);
+    __m128 sum = _mm_add_ps(
+        _mm_add_ps(_mm_loadu_ps(up + i), _mm_loadu_ps(down + i)),
+        _mm_add_ps(_mm_loadu_ps(x + i - 1), _mm_loadu_ps(x + i + 1)));
+    __m128 target = _mm_mul_ps(
+        _mm_add_ps(_mm_loadu_ps(rhs + i), _mm_mul_ps(va, sum)), vinv);
+    __m128 step = _mm_mul_ps(vw, _mm_sub_ps(target, center));
+    _mm_storeu_ps(out + i, _mm_add_ps(center, step));
+  }
+  JacobiRowTail(x, up, down, rhs, out, i, n, a, inv_c, w);
+}
+
+__attribute__((target("avx2"))) void JacobiRowAvx2(
+    const float* x, const float* up, const float* down, const float* rhs,
+    float* out, int n, float a, float inv_c, float w) {
+  const __m256 va = _mm256_set1_ps(a);
+  const __m256 vinv = _mm256_set1_ps(inv_c);
+  const __m256 vw = _mm256_set1_ps(w);
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256 center = _mm256_loadu_ps(x + i);
+    __m256 sum = _mm256_add_ps(
+        _mm256_add_ps(_mm256_loadu_ps(up + i), _mm256_loadu_ps(down + i)),
+        _mm256_add_ps(_mm256_loadu_ps(x + i - 1), _mm256_loadu_ps(x + i + 1)));
+    __m256 target = _mm256_mul_ps(
+        _mm256_add_ps(_mm256_loadu_ps(rhs + i), _mm256_mul_ps(va, sum)), vinv);
+    __m256 step = _mm256_mul_ps(vw, _mm256_sub_ps(target, center));
+    _mm256_storeu_ps(out + i, _mm256_add_ps(center, step));
+  }
+  JacobiRowTail(x, up, down, rhs, out, i, n, a, inv_c, w);
+}
+
+__attribute__((target("avx512f"))) void JacobiRowAvx512(
+    const float* x, const float* up, const float* down, const float* rhs,
+    float* out, int n, float a, float inv_c, float w) {
+  const __m512 va = _mm512_set1_ps(a);
+  const __m512 vinv = _mm512_set1_ps(inv_c);
+  const __m512 vw = _mm512_set1_ps(w);
+  int i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m512 center = _mm512_loadu_ps(x + i);
+    __m512 sum = _mm512_add_ps(
+        _mm512_add_ps(_mm512_loadu_ps(up + i), _mm512_loadu_ps(down + i)),
+        _mm512_add_ps(_mm512_loadu_ps(x + i - 1), _mm512_loadu_ps(x + i + 1)));
+    __m512 target = _mm512_mul_ps(
+        _mm512_add_ps(_mm512_loadu_ps(rhs + i), _mm512_mul_ps(va, sum)), vinv);
+    __m512 step = _mm512_mul_ps(vw, _mm512_sub_ps(target, center));
+    _mm512_storeu_ps(out + i, _mm512_add_ps(center, step));
+  }
+  JacobiRowTail(x, up, down, rhs, out, i, n, a, inv_c, w);
+}
+
+__attribute__((target("sse4.2"))) void JacobiRowSse42(
+    const double* x, const double* up, const double* down, const double* rhs,
+    double* out, int n, double a, double inv_c, double w) {
+  const __m128d va = _mm_set1_pd(a);
+  const __m128d vinv = _mm_set1_pd(inv_c);
+  const __m128d vw = _mm_set1_pd(w);
+  int i = 0;
+  for (; i + 2 <= n; i += 2) {
+    __m128d center = _mm_loadu_pd(x + i);
+    __m128d sum = _mm_add_pd(
+        _mm_add_pd(_mm_loadu_pd(up + i), _mm_loadu_pd(down + i)),
+        _mm_add_pd(_mm_loadu_pd(x + i - 1), _mm_loadu_pd(x + i + 1)));
+    __m128d target = _mm_mul_pd(
+        _mm_add_pd(_mm_loadu_pd(rhs + i), _mm_mul_pd(va, sum)), vinv);
+    __m128d step = _mm_mul_pd(vw, _mm_sub_pd(target, center));
+    _mm_storeu_pd(out + i, _mm_add_pd(center, step));
+  }
+  JacobiRowTail(x, up, down, rhs, out, i, n, a, inv_c, w);
+}
+
+__attribute__((target("avx2"))) void JacobiRowAvx2(
+    const double* x, const double* up, const double* down, const double* rhs,
+    double* out, int n, double a, double inv_c, double w) {
+  const __m256d va = _mm256_set1_pd(a);
+  const __m256d vinv = _mm256_set1_pd(inv_c);
+  const __m256d vw = _mm256_set1_pd(w);
+  int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m256d center = _mm256_loadu_pd(x + i);
+    __m256d sum = _mm256_add_pd(
+        _mm256_add_pd(_mm256_loadu_pd(up + i), _mm256_loadu_pd(down + i)),
+        _mm256_add_pd(_mm256_loadu_pd(x + i - 1), _mm256_loadu_pd(x + i + 1)));
+    __m256d target = _mm256_mul_pd(
+        _mm256_add_pd(_mm256_loadu_pd(rhs + i), _mm256_mul_pd(va, sum)), vinv);
+    __m256d step = _mm256_mul_pd(vw, _mm256_sub_pd(target, center));
+    _mm256_storeu_pd(out + i, _mm256_add_pd(center, step));
+  }
+  JacobiRowTail(x, up, down, rhs, out, i, n, a, inv_c, w);
+}
+
+__attribute__((target("avx512f"))) void JacobiRowAvx512(
+    const double* x, const double* up, const double* down, const double* rhs,
+    double* out, int n, double a, double inv_c, double w) {
+  const __m512d va = _mm512_set1_pd(a);
+  const __m512d vinv = _mm512_set1_pd(inv_c);
+  const __m512d vw = _mm512_set1_pd(w);
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m512d center = _mm512_loadu_pd(x + i);
+    __m512d sum = _mm512_add_pd(
+        _mm512_add_pd(_mm512_loadu_pd(up + i), _mm512_loadu_pd(down + i)),
+        _mm512_add_pd(_mm512_loadu_pd(x + i - 1), _mm512_loadu_pd(x + i + 1)));
+    __m512d target = _mm512_mul_pd(
+        _mm512_add_pd(_mm512_loadu_pd(rhs + i), _mm512_mul_pd(va, sum)), vinv);
+    __m512d step = _mm512_mul_pd(vw, _mm512_sub_pd(target, center));
+    _mm512_storeu_pd(out + i, _mm512_add_pd(center, step));
+  }
+  JacobiRowTail(x, up, down, rhs, out, i, n, a, inv_c, w);
+}
+#endif
+}  // namespace
+
+template <>
+JacobiRowKernel GetJacobiRowKernel<float>(SimdLevel level) {
+#ifdef GLOO_SIMD_X86
+  switch (ClampSimdLevel(level)) {
+    case SimdLevel::Avx512:
+      return JacobiRowAvx512;
+    case SimdLevel::Avx2:
+      return JacobiRowAvx2;
+    case SimdLevel::Sse42:
+      return JacobiRowSse42;
+    case SimdLevel::Scalar:
+      break;
+  }
+#endif
+  return JacobiRowScalar<float>;
+}
+
+// The same kernels on half as many doubles per vector.
+template <>
+BasicJacobiRowKernel<double> GetJacobiRowKernel<double>(SimdLevel level) {
+#ifdef GLOO_SIMD_X86
+  switch (ClampSimdLevel(level)) {
+    case SimdLevel::Avx512:
+      return JacobiRowAvx512;
+    case SimdLevel::Avx2:
+      return JacobiRowAvx2;
+    case SimdLevel::Sse42:
+      return JacobiRowSse42;
+    case SimdLevel::Scalar:
+      break;
+  }
+#endif
+  return JacobiRowScalar<double>;
+}
+}  // namespace GLOO
@@ -0,0 +1,29 @@
+#ifndef JACOBI_KERNELS_H_
+#define JACOBI_KERNELS_H_
+
+#include "Simd.hpp"
+
+namespace GLOO {
+// One weighted-Jacobi update of n cells of a row:
+//
+//   out[i] = x[i] + w * ((rhs[i] + a * (up[i] + down[i] + x[i-1] + x[i+1])) * inv_c - x[i])
+//
+// x[-1] and x[n] must be readable. out must not alias x, up or down.
+template <typename Real>
+using BasicJacobiRowKernel = void (*)(const Real* x, const Real* up,
+                                      const Real* down, const Real* rhs,
+                                      Real* out, int n, Real a, Real inv_c,
+                                      Real w);
+typedef BasicJacobiRowKernel<float> JacobiRowKernel;
+
+// The kernel for level, or for the widest supported level below it, for
+// float or double rows.
+template <typename Real>
+BasicJacobiRowKernel<Real> GetJacobiRowKernel(SimdLevel level);
+template <>
+JacobiRowKernel GetJacobiRowKernel<float>(SimdLevel level);
+template <>
+BasicJacobiRowKernel<double> GetJacobiRowKernel<double>(SimdLevel level);
+}  // namespace GLOO
+
+#endif
@@ -0,0 +1,157 @@
+#include "MovingObstacle.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace GLOO {
+MovingObstacle::MovingObstacle(Shape shape, float half_y, float half_x)
+    : shape_(shape),
+      half_y_(half_y),
+      half_x_(half_x),
+      cells_y_(0),
+      cells_x_(0),
+      placed_(false),
+      pose_(1.0f),
+      previous_pose_(1.0f),
+      to_local_(1.0f),
+      stamp_(0) {
+}
+
+// Only the xy block of to_local is used, the rest being the identity for
+// poses turning about z.
+bool MovingObstacle::Contains(const glm::mat4& to_local, int y, int x) const {
+  const float cx = x + 0.5f;
+  const float cy = y + 0.5f;
+  const float lx = to_local[0][0] * cx + to_local[1][0] * cy + to_local[3][0];
+  const float ly = to_local[0][1] * cx + to_local[1][1] * cy + to_local[3][1];
+  if (shape_ == Shape::Disc) {
+    return lx * lx + ly * ly <= half_x_ * half_x_;
+  }
+  return std::fabs(lx) <= half_x_ && std::fabs(ly) <= half_y_;
+}
+
+float MovingObstacle::GetReach(const glm::mat4& pose) const {
+  const float local = shape_ == Shape::Disc ? half_x_
+                                            : std::sqrt(half_x_ * half_x_ + half_y_ * half_y_);
+  const float scale = std::max(glm::length(glm::vec3(pose[0])), glm::length(glm::vec3(pose[1])));
+  return local * scale;
+}
+
+void MovingObstacle::GetBounds(const glm::mat4& pose, int& y0, int& y1, int& x0, int& x1) const {
+  const float reach = GetReach(pose);
+  const glm::vec4 centre = pose[3];
+  y0 = std::max(1, static_cast<int>(std::floor(centre.y - reach - 0.5f)));
+  y1 = std::min(cells_y_ - 1, static_cast<int>(std::ceil(centre.y + reach)) + 1);
+  x0 = std::max(1, static_cast<int>(std::floor(centre.x - reach - 0.5f)));
+  x1 = std::min(cells_x_ - 1, static_cast<int>(std::ceil(centre.x + reach)) + 1);
+}
+
+// A cell can only change sides if the boundary passed over it, and no
+// point of the shape moved further than the translation plus the reach
+// times the change of the linear part. Every such cell lies within that
+// distance, plus one cell, of a cell on the previous rim. When that band would cost more than the two
+// bounding boxes, as on the first call or after a jump, the boxes are
+// scanned instead.
+void MovingObstacle::Rasterize(ObstacleMap& map) {
+  const glm::mat4 pose = GetTransform().GetLocalToParentMatrix();
+  const bool had_pose = placed_;
+  if (!placed_) {
+    cells_y_ = map.cells_y();
+    cells_x_ = map.cells_x();
+    visited_.assign(static_cast<size_t>(cells_y_) * cells_x_, 0);
+    inside_.assign(visited_.size(), 0);
+    placed_ = true;
+  }
+  const glm::mat4 old_to_local = to_local_;
+  previous_pose_ = had_pose ? pose_ : pose;
+  pose_ = pose;
+  to_local_ = glm::inverse(pose);
+  released_.clear();
+  stamp_++;
+
+  std::vector<int> visited;
+  auto visit = [&](int y, int x) {
+    const int i = y * cells_x_ + x;
+    if (visited_[i] == stamp_) {
+      return;
+    }
+    visited_[i] = stamp_;
+    visited.push_back(i);
+    const bool was = had_pose && Contains(old_to_local, y, x);
+    const bool now = Contains(to_local_, y, x);
+    inside_[i] = now ? 1 : 0;
+    if (was && !now) {
+      map.RemoveMovingCell(i);
+      released_.push_back(i);
+    } else if (now && !was) {
+      map.AddMovingCell(i);
+    }
+  };
+
+  const glm::vec3 shift = glm::vec3(pose[3]) - glm::vec3(previous_pose_[3]);
+  const glm::vec3 turn_x = glm::vec3(pose[0]) - glm::vec3(previous_pose_[0]);
+  const glm::vec3 turn_y = glm::vec3(pose[1]) - glm::vec3(previous_pose_[1]);
+  const float unit_reach = GetReach(glm::mat4(1.0f));
+  const float moved = glm::length(shift) + std::sqrt(2.0f) * unit_reach *
+                      std::max(glm::length(turn_x), glm::length(turn_y));
+  const int band = static_cast<int>(std::ceil(moved)) + 1;
+
+  int y0, y1, x0, x1;
+  GetBounds(pose, y0, y1, x0, x1);
+  if (had_pose) {
+    int py0, py1, px0, px1;
+    GetBounds(previous_pose_, py0, py1, px0, px1);
+    y0 = std::min(y0, py0);
+    y1 = std::max(y1, py1);
+    x0 = std::min(x0, px0);
+    x1 = std::max(x1, px1);
+  }
+  const double box_cells = static_cast<double>(std::max(0, y1 - y0)) * std::max(0, x1 - x0);
+  const double band_cells = static_cast<double>(rim_.size()) * (2 * band + 1) * (2 * band + 1);
+  if (!had_pose || band_cells >= box_cells) {
+    for (int y = y0; y < y1; y++) {
+      for (int x = x0; x < x1; x++) {
+        visit(y, x);
+      }
+    }
+  } else {
+    for (int c : rim_) {
+      const int cy = c / cells_x_;
+      const int cx = c % cells_x_;
+      for (int y = std::max(1, cy - band); y < std::min(cells_y_ - 1, cy + band + 1); y++) {
+        for (int x = std::max(1, cx - band); x < std::min(cells_x_ - 1, cx + band + 1); x++) {
+          visit(y, x);
+        }
+      }
+    }
+  }
+
+  // the rim of the new pose lies among the visited cells; their
+  // neighbours were mostly visited too
+  auto covered = [&](int y, int x) {
+    const int i = y * cells_x_ + x;
+    if (visited_[i] == stamp_) {
+      return inside_[i] != 0;
+    }
+    return y > 0 && y < cells_y_ - 1 && x > 0 && x < cells_x_ - 1 && Contains(to_local_, y, x);
+  };
+  rim_.clear();
+  for (int i : visited) {
+    if (!inside_[i]) {
+      continue;
+    }
+    const int y = i / cells_x_;
+    const int x = i % cells_x_;
+    if (!covered(y - 1, x) || !covered(y + 1, x) || !covered(y, x - 1) || !covered(y, x + 1)) {
+      rim_.push_back(i);
+    }
+  }
+}
+
+void MovingObstacle::GetVelocityAt(int y, int x, float dt, float& u_y, float& u_x) const {
+  const glm::vec4 p(x + 0.5f, y + 0.5f, 0.0f, 1.0f);
+  const glm::vec4 before = previous_pose_ * (to_local_ * p);
+  u_y = (p.y - before.y) / dt;
+  u_x = (p.x - before.x) / dt;
+}
+}  // namespace GLOO
@@ -0,0 +1,75 @@
+#ifndef MOVING_OBSTACLE_H_
+#define MOVING_OBSTACLE_H_
+
+#include "gloo/SceneNode.hpp"
+#include "Obstacles.hpp"
+#include <vector>
+
+#include <glm/glm.hpp>
+
+namespace GLOO {
+// A rigid obstacle moving through the grid of the Fluid it is added to
+// (see BasicFluid::add_moving_obstacle). Its Transform, relative to the
+// fluid, places the shape in cell units: x along the columns, y along the
+// rows, with cell (y, x) centred at (x + 0.5, y + 0.5); rotations turn it
+// about z. Move it between steps through GetTransform().
+class MovingObstacle : public SceneNode {
+ public:
+  enum class Shape {
+    Box,
+    Disc,
+  };
+
+  // A box with half extents half_y and half_x, or a disc of radius half_x,
+  // centred on the origin of the node.
+  MovingObstacle(Shape shape, float half_y, float half_x);
+
+  // Moves the cells the obstacle covers in map from its pose at the last
+  // call to its current pose. The first call covers the whole shape; after
+  // that only cells within the distance the shape moved of its previous
+  // rim are tested, so the cost follows the perimeter, not the area.
+  void Rasterize(ObstacleMap& map);
+
+  // Covered cells next to an uncovered one, as of the last Rasterize().
+  const std::vector<int>& GetRim() const {
+    return rim_;
+  }
+
+  // Cells the last Rasterize() uncovered.
+  const std::vector<int>& GetReleased() const {
+    return released_;
+  }
+
+  // Velocity of the obstacle at the centre of cell (y, x) over the last
+  // Rasterize(), taken to span dt; zero before the second call.
+  void GetVelocityAt(int y, int x, float dt, float& u_y, float& u_x) const;
+
+ private:
+  // Whether the centre of cell (y, x) lies inside the shape, mapped to its
+  // own frame by to_local.
+  bool Contains(const glm::mat4& to_local, int y, int x) const;
+  // Bounding cells of the shape at pose, clipped to the interior.
+  void GetBounds(const glm::mat4& pose, int& y0, int& y1, int& x0, int& x1) const;
+  // Distance from the origin to the farthest point of the shape at pose.
+  float GetReach(const glm::mat4& pose) const;
+
+  Shape shape_;
+  float half_y_;
+  float half_x_;
+  int cells_y_;
+  int cells_x_;
+  bool placed_;
+  glm::mat4 pose_;
+  glm::mat4 previous_pose_;
+  glm::mat4 to_local_;
+  std::vector<int> rim_;
+  std::vector<int> released_;
+  // cells visited by the current Rasterize() carry its stamp, and whether
+  // they are inside its pose
+  std::vector<int> visited_;
+  std::vector<unsigned char> inside_;
+  int stamp_;
+};
+}  // namespace GLOO
+
+#endif
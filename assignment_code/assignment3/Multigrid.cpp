@@ -0,0 +1,366 @@
+#include "Multigrid.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace GLOO {
+namespace {
+// Coarsening stops once either axis has at most this many cells; the
+// other may still be long.
+const int kCoarsestCells = 4;
+// The coarsest level is solved until its residual has dropped by this
+// factor.
+const double kCoarsestReduction = 1e-6;
+
+void ComputeCouplings(std::vector<float>& minus, std::vector<float>& plus,
+                      const std::vector<float>& width,
+                      const std::vector<float>& center) {
+  int n = static_cast<int>(width.size());
+  minus.assign(n, 0.f);
+  plus.assign(n, 0.f);
+  for (int i = 0; i < n; i++) {
+    if (i > 0) {
+      minus[i] = 1.0f / (width[i] * (center[i] - center[i - 1]));
+    }
+    if (i + 1 < n) {
+      plus[i] = 1.0f / (width[i] * (center[i + 1] - center[i]));
+    }
+  }
+}
+}  // namespace
+
+MultigridAxis MakeFineMultigridAxis(int n) {
+  MultigridAxis axis;
+  axis.n = n;
+  axis.width.assign(n, 1.0f);
+  axis.center.resize(n);
+  for (int i = 0; i < n; i++) {
+    axis.center[i] = i + 0.5f;
+  }
+  ComputeCouplings(axis.minus, axis.plus, axis.width, axis.center);
+  return axis;
+}
+
+MultigridAxis MakeCoarseMultigridAxis(const MultigridAxis& fine) {
+  MultigridAxis axis;
+  axis.n = (fine.n + 1) / 2;
+  axis.width.resize(axis.n);
+  axis.center.resize(axis.n);
+  float start = 0.f;
+  for (int i = 0; i < axis.n; i++) {
+    float w = fine.width[2 * i];
+    if (2 * i + 1 < fine.n) {
+      w += fine.width[2 * i + 1];
+    }
+    axis.width[i] = w;
+    axis.center[i] = start + 0.5f * w;
+    start += w;
+  }
+  ComputeCouplings(axis.minus, axis.plus, axis.width, axis.center);
+  return axis;
+}
+
+void LinkMultigridAxes(MultigridAxis& fine, const MultigridAxis& coarse) {
+  fine.lo.resize(fine.n);
+  fine.hi.resize(fine.n);
+  fine.t.resize(fine.n);
+  for (int i = 0; i < fine.n; i++) {
+    int parent = i / 2;
+    float p = fine.center[i];
+    int other = p < coarse.center[parent] ? parent - 1 : parent + 1;
+    if (other < 0 || other >= coarse.n) {
+      // next to a wall the correction is extended flat
+      fine.lo[i] = fine.hi[i] = parent;
+      fine.t[i] = 0.f;
+      continue;
+    }
+    fine.lo[i] = std::min(parent, other);
+    fine.hi[i] = std::max(parent, other);
+    fine.t[i] = (p - coarse.center[fine.lo[i]]) /
+                (coarse.center[fine.hi[i]] - coarse.center[fine.lo[i]]);
+  }
+}
+
+template <typename Real>
+MultigridSolver<Real>::MultigridSolver(const SimulationConfig& config)
+    : cycle_(config.multigrid_cycle),
+      smooth_steps_(config.multigrid_smooth_steps),
+      tolerance_(config.solver_tolerance),
+      max_cycles_(config.solver_max_iter),
+      a_(1.f),
+      shift_(0.f) {
+  Axis ay = MakeFineMultigridAxis(config.cells_y - 2);
+  Axis ax = MakeFineMultigridAxis(config.cells_x - 2);
+  while (true) {
+    Level level;
+    level.ay = ay;
+    level.ax = ax;
+    level.stride = ax.n + 2;
+    int size = (ay.n + 2) * (ax.n + 2);
+    level.b.assign(size, 0.f);
+    level.r.assign(size, 0.f);
+    if (!levels_.empty()) {
+      level.x_storage.assign(size, 0.f);
+    }
+    level.x = nullptr;
+    levels_.push_back(std::move(level));
+    if (std::min(ay.n, ax.n) <= kCoarsestCells) {
+      break;
+    }
+    ay = MakeCoarseMultigridAxis(ay);
+    ax = MakeCoarseMultigridAxis(ax);
+    LinkMultigridAxes(levels_.back().ay, ay);
+    LinkMultigridAxes(levels_.back().ax, ax);
+  }
+  for (size_t l = 1; l < levels_.size(); l++) {
+    levels_[l].x = levels_[l].x_storage.data();
+  }
+  const Level& coarsest = levels_.back();
+  coarsest_p_.assign(coarsest.r.size(), 0.f);
+  coarsest_q_.assign(coarsest.r.size(), 0.f);
+}
+
+template <typename Real>
+void MultigridSolver<Real>::Solve(BasicField2D<Real>& x,
+                                  const BasicField2D<Real>& rhs, Real a,
+                                  Real c) {
+  a_ = a;
+  shift_ = c - 4.0f * a;
+
+  Level& top = levels_[0];
+  top.x = x.data();
+  std::copy(rhs.data(), rhs.data() + rhs.size(), top.b.begin());
+  if (shift_ == 0.f) {
+    RemoveMean(top, top.b);
+  }
+
+  double b_sum = 0.0;
+  for (int y = 1; y <= top.ay.n; y++) {
+    for (int xi = 1; xi <= top.ax.n; xi++) {
+      Real b = top.b[y * top.stride + xi];
+      b_sum += b * b;
+    }
+  }
+  Real b_norm =
+      static_cast<Real>(std::sqrt(b_sum / (top.ay.n * top.ax.n)));
+  if (b_norm == 0.f) {
+    x.fill(0.f);
+    this->stats_.iterations = 0;
+    this->stats_.residual = 0.f;
+    return;
+  }
+
+  this->stats_.iterations = 0;
+  while (true) {
+    this->stats_.residual = static_cast<float>(ComputeResidual(top) / b_norm);
+    if (this->stats_.residual < tolerance_ || this->stats_.iterations >= max_cycles_) {
+      break;
+    }
+    Cycle(0);
+    this->stats_.iterations++;
+  }
+  FillNeumannBoundary(top.x, top.ay.n + 2, top.ax.n + 2);
+}
+
+template <typename Real>
+void MultigridSolver<Real>::Cycle(int l) {
+  Level& level = levels_[l];
+  if (l + 1 == static_cast<int>(levels_.size())) {
+    if (shift_ == 0.f) {
+      RemoveMean(level, level.b);
+    }
+    SolveCoarsest(level);
+    return;
+  }
+
+  Level& coarse = levels_[l + 1];
+  Smooth(level, smooth_steps_);
+  ComputeResidual(level);
+  Restrict(level, coarse);
+  std::fill(coarse.x_storage.begin(), coarse.x_storage.end(), 0.f);
+  int visits = cycle_ == MultigridCycle::W ? 2 : 1;
+  for (int i = 0; i < visits; i++) {
+    Cycle(l + 1);
+  }
+  ProlongateAdd(coarse, level);
+  Smooth(level, smooth_steps_);
+}
+
+template <typename Real>
+void MultigridSolver<Real>::Smooth(Level& level, int sweeps) {
+  const int s = level.stride;
+  const Axis& ay = level.ay;
+  const Axis& ax = level.ax;
+  Real* x = level.x;
+  const Real* b = level.b.data();
+  for (int i = 0; i < sweeps; i++) {
+    for (int color = 0; color < 2; color++) {
+      for (int y = 1; y <= ay.n; y++) {
+        Real cn = a_ * ay.minus[y - 1];
+        Real cs = a_ * ay.plus[y - 1];
+        for (int xi = 1 + ((y + color) & 1); xi <= ax.n; xi += 2) {
+          Real cw = a_ * ax.minus[xi - 1];
+          Real ce = a_ * ax.plus[xi - 1];
+          int k = y * s + xi;
+          x[k] = (b[k] + cn * x[k - s] + cs * x[k + s] + cw * x[k - 1] +
+                  ce * x[k + 1]) /
+                 (shift_ + cn + cs + cw + ce);
+        }
+      }
+    }
+  }
+}
+
+template <typename Real>
+Real MultigridSolver<Real>::ComputeResidual(Level& level) {
+  const int s = level.stride;
+  const Axis& ay = level.ay;
+  const Axis& ax = level.ax;
+  const Real* x = level.x;
+  double sum = 0.0;
+  for (int y = 1; y <= ay.n; y++) {
+    Real cn = a_ * ay.minus[y - 1];
+    Real cs = a_ * ay.plus[y - 1];
+    for (int xi = 1; xi <= ax.n; xi++) {
+      Real cw = a_ * ax.minus[xi - 1];
+      Real ce = a_ * ax.plus[xi - 1];
+      int k = y * s + xi;
+      Real r = level.b[k] - ((shift_ + cn + cs + cw + ce) * x[k] -
+                              (cn * x[k - s] + cs * x[k + s] + cw * x[k - 1] +
+                               ce * x[k + 1]));
+      level.r[k] = r;
+      sum += r * r;
+    }
+  }
+  return static_cast<Real>(std::sqrt(sum / (ay.n * ax.n)));
+}
+
+// Conjugate gradients from the current x. The operator is symmetric in the
+// inner product weighted by cell area, which the dot products use; with
+// shift_ == 0 it is singular, but b has zero mean, so the system stays
+// consistent. Smoothing alone cannot solve this level, as one axis of it
+// may still be long.
+template <typename Real>
+void MultigridSolver<Real>::SolveCoarsest(Level& level) {
+  const int s = level.stride;
+  const Axis& ay = level.ay;
+  const Axis& ax = level.ax;
+  Real* x = level.x;
+  Real* r = level.r.data();
+  Real* p = coarsest_p_.data();
+  Real* q = coarsest_q_.data();
+  auto dot = [&](const Real* u, const Real* v) {
+    double sum = 0.0;
+    for (int y = 1; y <= ay.n; y++) {
+      for (int xi = 1; xi <= ax.n; xi++) {
+        int k = y * s + xi;
+        sum += ay.width[y - 1] * ax.width[xi - 1] * u[k] * v[k];
+      }
+    }
+    return sum;
+  };
+
+  ComputeResidual(level);
+  std::copy(level.r.begin(), level.r.end(), coarsest_p_.begin());
+  double rr = dot(r, r);
+  const double target = rr * kCoarsestReduction * kCoarsestReduction;
+  const int max_iterations = ay.n * ax.n;
+  for (int i = 0; i < max_iterations && rr > target; i++) {
+    for (int y = 1; y <= ay.n; y++) {
+      Real cn = a_ * ay.minus[y - 1];
+      Real cs = a_ * ay.plus[y - 1];
+      for (int xi = 1; xi <= ax.n; xi++) {
+        Real cw = a_ * ax.minus[xi - 1];
+        Real ce = a_ * ax.plus[xi - 1];
+        int k = y * s + xi;
+        q[k] = (shift_ + cn + cs + cw + ce) * p[k] -
+               (cn * p[k - s] + cs * p[k + s] + cw * p[k - 1] + ce * p[k + 1]);
+      }
+    }
+    const double pq = dot(p, q);
+    if (pq <= 0.0) {
+      break;
+    }
+    const Real alpha = static_cast<Real>(rr / pq);
+    for (int y = 1; y <= ay.n; y++) {
+      for (int xi = 1; xi <= ax.n; xi++) {
+        int k = y * s + xi;
+        x[k] += alpha * p[k];
+        r[k] -= alpha * q[k];
+      }
+    }
+    const double rr_next = dot(r, r);
+    const Real beta = static_cast<Real>(rr_next / rr);
+    rr = rr_next;
+    for (int y = 1; y <= ay.n; y++) {
+      for (int xi = 1; xi <= ax.n; xi++) {
+        int k = y * s + xi;
+        p[k] = r[k] + beta * p[k];
+      }
+    }
+  }
+}
+
+template <typename Real>
+void MultigridSolver<Real>::Restrict(const Level& fine, Level& coarse) {
+  for (int y = 0; y < coarse.ay.n; y++) {
+    int y_end = std::min(2 * y + 2, fine.ay.n);
+    for (int x = 0; x < coarse.ax.n; x++) {
+      int x_end = std::min(2 * x + 2, fine.ax.n);
+      Real sum = 0.f;
+      for (int fy = 2 * y; fy < y_end; fy++) {
+        for (int fx = 2 * x; fx < x_end; fx++) {
+          sum += fine.ay.width[fy] * fine.ax.width[fx] *
+                 fine.r[(fy + 1) * fine.stride + fx + 1];
+        }
+      }
+      coarse.b[(y + 1) * coarse.stride + x + 1] =
+          sum / (coarse.ay.width[y] * coarse.ax.width[x]);
+    }
+  }
+}
+
+template <typename Real>
+void MultigridSolver<Real>::ProlongateAdd(const Level& coarse, Level& fine) {
+  const int cs = coarse.stride;
+  const Real* cx = coarse.x;
+  for (int y = 0; y < fine.ay.n; y++) {
+    const Real* lo_row = cx + (fine.ay.lo[y] + 1) * cs + 1;
+    const Real* hi_row = cx + (fine.ay.hi[y] + 1) * cs + 1;
+    Real ty = fine.ay.t[y];
+    Real* out = fine.x + (y + 1) * fine.stride + 1;
+    for (int x = 0; x < fine.ax.n; x++) {
+      int lo = fine.ax.lo[x];
+      int hi = fine.ax.hi[x];
+      Real tx = fine.ax.t[x];
+      Real top = (1.0f - tx) * lo_row[lo] + tx * lo_row[hi];
+      Real bottom = (1.0f - tx) * hi_row[lo] + tx * hi_row[hi];
+      out[x] += (1.0f - ty) * top + ty * bottom;
+    }
+  }
+}
+
+// Subtracts the area-weighted interior mean, so a pure Neumann problem is
+// solvable.
+template <typename Real>
+void MultigridSolver<Real>::RemoveMean(Level& level, std::vector<Real>& field) {
+  double sum = 0.0;
+  double area = 0.0;
+  for (int y = 0; y < level.ay.n; y++) {
+    for (int x = 0; x < level.ax.n; x++) {
+      double w = level.ay.width[y] * level.ax.width[x];
+      sum += w * field[(y + 1) * level.stride + x + 1];
+      area += w;
+    }
+  }
+  Real mean = static_cast<Real>(sum / area);
+  for (int y = 1; y <= level.ay.n; y++) {
+    for (int x = 1; x <= level.ax.n; x++) {
+      field[y * level.stride + x] -= mean;
+    }
+  }
+}
+
+template class MultigridSolver<float>;
+template class MultigridSolver<double>;
+}  // namespace GLOO
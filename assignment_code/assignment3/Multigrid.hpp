@@ -0,0 +1,91 @@
+#ifndef MULTIGRID_H_
+#define MULTIGRID_H_
+
+#include "PoissonSolver.hpp"
+#include <vector>
+
+namespace GLOO {
+// Per-axis geometry of one multigrid level, shared by the 2D and 3D
+// solvers.
+struct MultigridAxis {
+  int n;
+  // cell widths and centres, in finest-level cells
+  std::vector<float> width;
+  std::vector<float> center;
+  // coupling to the previous/next cell, zero at a wall
+  std::vector<float> minus;
+  std::vector<float> plus;
+  // interpolation from the next coarser level: a fine cell takes
+  // (1 - t) * coarse[lo] + t * coarse[hi]
+  std::vector<int> lo;
+  std::vector<int> hi;
+  std::vector<float> t;
+};
+
+// n unit cells.
+MultigridAxis MakeFineMultigridAxis(int n);
+// Merges pairs of cells of fine; an odd last cell stays on its own.
+MultigridAxis MakeCoarseMultigridAxis(const MultigridAxis& fine);
+// Fills the interpolation of fine from coarse.
+void LinkMultigridAxes(MultigridAxis& fine, const MultigridAxis& coarse);
+
+// Cell-centred geometric multigrid. Each coarser level merges pairs of cells
+// along both axes. Levels are smoothed with red-black Gauss-Seidel.
+// Residuals are restricted by area-weighted averaging and corrections are
+// prolongated bilinearly. Coarsening stops when the shorter axis is small,
+// and the coarsest level is solved by conjugate gradients, so a long thin
+// grid converges like a square one. The whole hierarchy is allocated in
+// the constructor.
+//
+// When a level has an odd number of cells, the last coarse cell covers a
+// single fine cell. The coarse operators are finite-volume discretizations
+// on these non-uniform cells, so every level sees the same domain.
+template <typename Real>
+class MultigridSolver : public BasicPoissonSolver<Real> {
+ public:
+  explicit MultigridSolver(const SimulationConfig& config);
+
+  void Solve(BasicField2D<Real>& x, const BasicField2D<Real>& rhs, Real a,
+             Real c) override;
+
+ private:
+  typedef MultigridAxis Axis;
+
+  struct Level {
+    Axis ay;
+    Axis ax;
+    // arrays carry an extra ring of cells so level 0 can alias a field
+    int stride;
+    std::vector<Real> x_storage;
+    std::vector<Real> b;
+    std::vector<Real> r;
+    // points into x_storage, or at the caller's field on level 0
+    Real* x;
+  };
+
+  void Cycle(int l);
+  void Smooth(Level& level, int sweeps);
+  // Solves the coarsest level to kCoarsestReduction.
+  void SolveCoarsest(Level& level);
+  // Writes b - A x into level.r and returns its RMS over the interior.
+  Real ComputeResidual(Level& level);
+  void Restrict(const Level& fine, Level& coarse);
+  void ProlongateAdd(const Level& coarse, Level& fine);
+  void RemoveMean(Level& level, std::vector<Real>& field);
+
+  std::vector<Level> levels_;
+  // search direction and its image of SolveCoarsest
+  std::vector<Real> coarsest_p_;
+  std::vector<Real> coarsest_q_;
+  MultigridCycle cycle_;
+  int smooth_steps_;
+  float tolerance_;
+  int max_cycles_;
+  // operator coefficients of the current solve: a scales the couplings and
+  // shift = c - 4a is the identity part (zero for pressure)
+  Real a_;
+  Real shift_;
+};
+}  // namespace GLOO
+
+#endif
@@ -0,0 +1,326 @@
+#include "Multigrid3D.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace GLOO {
+namespace {
+// Sweeps used to solve the coarsest level.
+const int kCoarsestSweeps = 50;
+// Coarsening stops once any axis has at most this many cells.
+const int kCoarsestCells = 4;
+}  // namespace
+
+Multigrid3DSolver::Multigrid3DSolver(const SimulationConfig& config,
+                                     ThreadPool& pool)
+    : pool_(pool),
+      cycle_(config.multigrid_cycle),
+      smooth_steps_(config.multigrid_smooth_steps),
+      tolerance_(config.solver_tolerance),
+      max_cycles_(config.solver_max_iter),
+      a_(1.f),
+      shift_(0.f) {
+  Axis az = MakeFineMultigridAxis(config.cells_z - 2);
+  Axis ay = MakeFineMultigridAxis(config.cells_y - 2);
+  Axis ax = MakeFineMultigridAxis(config.cells_x - 2);
+  while (true) {
+    Level level;
+    level.az = az;
+    level.ay = ay;
+    level.ax = ax;
+    level.stride_y = ax.n + 2;
+    level.stride_z = (ay.n + 2) * (ax.n + 2);
+    size_t size = static_cast<size_t>(az.n + 2) * level.stride_z;
+    level.b.assign(size, 0.f);
+    level.r.assign(size, 0.f);
+    if (!levels_.empty()) {
+      level.x_storage.assign(size, 0.f);
+    }
+    level.x = nullptr;
+    levels_.push_back(std::move(level));
+    if (std::min(az.n, std::min(ay.n, ax.n)) <= kCoarsestCells) {
+      break;
+    }
+    az = MakeCoarseMultigridAxis(az);
+    ay = MakeCoarseMultigridAxis(ay);
+    ax = MakeCoarseMultigridAxis(ax);
+    LinkMultigridAxes(levels_.back().az, az);
+    LinkMultigridAxes(levels_.back().ay, ay);
+    LinkMultigridAxes(levels_.back().ax, ax);
+  }
+  for (size_t l = 1; l < levels_.size(); l++) {
+    levels_[l].x = levels_[l].x_storage.data();
+  }
+}
+
+void Multigrid3DSolver::Solve(Field3D& x, const Field3D& rhs, float a,
+                              float c) {
+  a_ = a;
+  shift_ = c - 6.0f * a;
+
+  Level& top = levels_[0];
+  top.x = x.data();
+  const int sz = top.stride_z;
+  pool_.ParallelFor(0, top.az.n + 2, [&](int z0, int z1) {
+    std::copy(rhs.data() + static_cast<size_t>(z0) * sz,
+              rhs.data() + static_cast<size_t>(z1) * sz,
+              top.b.begin() + static_cast<size_t>(z0) * sz);
+  });
+  if (shift_ == 0.f) {
+    RemoveMean(top, top.b);
+  }
+
+  const double b_sum = pool_.ParallelSum(1, top.az.n + 1, [&](int z0, int z1) {
+    double sum = 0.0;
+    for (int z = z0; z < z1; z++) {
+      for (int y = 1; y <= top.ay.n; y++) {
+        const float* row = top.b.data() + static_cast<size_t>(z) * sz +
+                           y * top.stride_y;
+        for (int xi = 1; xi <= top.ax.n; xi++) {
+          sum += row[xi] * row[xi];
+        }
+      }
+    }
+    return sum;
+  });
+  const double cells =
+      static_cast<double>(top.az.n) * top.ay.n * top.ax.n;
+  float b_norm = static_cast<float>(std::sqrt(b_sum / cells));
+  if (b_norm == 0.f) {
+    x.fill(0.f);
+    stats_.iterations = 0;
+    stats_.residual = 0.f;
+    return;
+  }
+
+  stats_.iterations = 0;
+  while (true) {
+    stats_.residual = ComputeResidual(top) / b_norm;
+    if (stats_.residual < tolerance_ || stats_.iterations >= max_cycles_) {
+      break;
+    }
+    Cycle(0);
+    stats_.iterations++;
+  }
+  FillNeumannBoundary3D(top.x, top.az.n + 2, top.ay.n + 2, top.ax.n + 2);
+}
+
+void Multigrid3DSolver::Cycle(int l) {
+  Level& level = levels_[l];
+  if (l + 1 == static_cast<int>(levels_.size())) {
+    if (shift_ == 0.f) {
+      RemoveMean(level, level.b);
+    }
+    Smooth(level, kCoarsestSweeps);
+    return;
+  }
+
+  Level& coarse = levels_[l + 1];
+  Smooth(level, smooth_steps_);
+  ComputeResidual(level);
+  Restrict(level, coarse);
+  std::fill(coarse.x_storage.begin(), coarse.x_storage.end(), 0.f);
+  int visits = cycle_ == MultigridCycle::W ? 2 : 1;
+  for (int i = 0; i < visits; i++) {
+    Cycle(l + 1);
+  }
+  ProlongateAdd(coarse, level);
+  Smooth(level, smooth_steps_);
+}
+
+// Cells of one colour only couple to the other colour, so the slabs of a
+// colour are updated in parallel.
+void Multigrid3DSolver::Smooth(Level& level, int sweeps) {
+  const int sy = level.stride_y;
+  const int sz = level.stride_z;
+  const Axis& az = level.az;
+  const Axis& ay = level.ay;
+  const Axis& ax = level.ax;
+  float* x = level.x;
+  const float* b = level.b.data();
+  for (int i = 0; i < sweeps; i++) {
+    for (int color = 0; color < 2; color++) {
+      pool_.ParallelFor(1, az.n + 1, [&](int z0, int z1) {
+        for (int z = z0; z < z1; z++) {
+          float cd = a_ * az.minus[z - 1];
+          float cu = a_ * az.plus[z - 1];
+          for (int y = 1; y <= ay.n; y++) {
+            float cn = a_ * ay.minus[y - 1];
+            float cs = a_ * ay.plus[y - 1];
+            const size_t row = static_cast<size_t>(z) * sz + y * sy;
+            for (int xi = 1 + ((z + y + color) & 1); xi <= ax.n; xi += 2) {
+              float cw = a_ * ax.minus[xi - 1];
+              float ce = a_ * ax.plus[xi - 1];
+              size_t k = row + xi;
+              x[k] = (b[k] + cd * x[k - sz] + cu * x[k + sz] + cn * x[k - sy] +
+                      cs * x[k + sy] + cw * x[k - 1] + ce * x[k + 1]) /
+                     (shift_ + cd + cu + cn + cs + cw + ce);
+            }
+          }
+        }
+      });
+    }
+  }
+}
+
+float Multigrid3DSolver::ComputeResidual(Level& level) {
+  const int sy = level.stride_y;
+  const int sz = level.stride_z;
+  const Axis& az = level.az;
+  const Axis& ay = level.ay;
+  const Axis& ax = level.ax;
+  const float* x = level.x;
+  double sum = pool_.ParallelSum(1, az.n + 1, [&](int z0, int z1) {
+    double part = 0.0;
+    for (int z = z0; z < z1; z++) {
+      float cd = a_ * az.minus[z - 1];
+      float cu = a_ * az.plus[z - 1];
+      for (int y = 1; y <= ay.n; y++) {
+        float cn = a_ * ay.minus[y - 1];
+        float cs = a_ * ay.plus[y - 1];
+        const size_t row = static_cast<size_t>(z) * sz + y * sy;
+        for (int xi = 1; xi <= ax.n; xi++) {
+          float cw = a_ * ax.minus[xi - 1];
+          float ce = a_ * ax.plus[xi - 1];
+          size_t k = row + xi;
+          float r = level.b[k] -
+                    ((shift_ + cd + cu + cn + cs + cw + ce) * x[k] -
+                     (cd * x[k - sz] + cu * x[k + sz] + cn * x[k - sy] +
+                      cs * x[k + sy] + cw * x[k - 1] + ce * x[k + 1]));
+          level.r[k] = r;
+          part += r * r;
+        }
+      }
+    }
+    return part;
+  });
+  return static_cast<float>(
+      std::sqrt(sum / (static_cast<double>(az.n) * ay.n * ax.n)));
+}
+
+void Multigrid3DSolver::Restrict(const Level& fine, Level& coarse) {
+  pool_.ParallelFor(0, coarse.az.n, [&](int z0, int z1) {
+    for (int z = z0; z < z1; z++) {
+      int z_end = std::min(2 * z + 2, fine.az.n);
+      for (int y = 0; y < coarse.ay.n; y++) {
+        int y_end = std::min(2 * y + 2, fine.ay.n);
+        for (int x = 0; x < coarse.ax.n; x++) {
+          int x_end = std::min(2 * x + 2, fine.ax.n);
+          float sum = 0.f;
+          for (int fz = 2 * z; fz < z_end; fz++) {
+            for (int fy = 2 * y; fy < y_end; fy++) {
+              const float* row = fine.r.data() +
+                                 static_cast<size_t>(fz + 1) * fine.stride_z +
+                                 (fy + 1) * fine.stride_y + 1;
+              for (int fx = 2 * x; fx < x_end; fx++) {
+                sum += fine.az.width[fz] * fine.ay.width[fy] *
+                       fine.ax.width[fx] * row[fx];
+              }
+            }
+          }
+          coarse.b[static_cast<size_t>(z + 1) * coarse.stride_z +
+                   (y + 1) * coarse.stride_y + x + 1] =
+              sum / (coarse.az.width[z] * coarse.ay.width[y] *
+                     coarse.ax.width[x]);
+        }
+      }
+    }
+  });
+}
+
+void Multigrid3DSolver::ProlongateAdd(const Level& coarse, Level& fine) {
+  const int csy = coarse.stride_y;
+  const int csz = coarse.stride_z;
+  const float* cx = coarse.x;
+  pool_.ParallelFor(0, fine.az.n, [&](int z0, int z1) {
+    for (int z = z0; z < z1; z++) {
+      const float* lo_slab =
+          cx + static_cast<size_t>(fine.az.lo[z] + 1) * csz + csy + 1;
+      const float* hi_slab =
+          cx + static_cast<size_t>(fine.az.hi[z] + 1) * csz + csy + 1;
+      float tz = fine.az.t[z];
+      for (int y = 0; y < fine.ay.n; y++) {
+        const int lo_row = fine.ay.lo[y] * csy;
+        const int hi_row = fine.ay.hi[y] * csy;
+        float ty = fine.ay.t[y];
+        float* out = fine.x + static_cast<size_t>(z + 1) * fine.stride_z +
+                     (y + 1) * fine.stride_y + 1;
+        for (int x = 0; x < fine.ax.n; x++) {
+          int lo = fine.ax.lo[x];
+          int hi = fine.ax.hi[x];
+          float tx = fine.ax.t[x];
+          float near_top = (1.0f - tx) * lo_slab[lo_row + lo] +
+                           tx * lo_slab[lo_row + hi];
+          float near_bottom = (1.0f - tx) * lo_slab[hi_row + lo] +
+                              tx * lo_slab[hi_row + hi];
+          float far_top = (1.0f - tx) * hi_slab[lo_row + lo] +
+                          tx * hi_slab[lo_row + hi];
+          float far_bottom = (1.0f - tx) * hi_slab[hi_row + lo] +
+                             tx * hi_slab[hi_row + hi];
+          float near = (1.0f - ty) * near_top + ty * near_bottom;
+          float far = (1.0f - ty) * far_top + ty * far_bottom;
+          out[x] += (1.0f - tz) * near + tz * far;
+        }
+      }
+    }
+  });
+}
+
+// Subtracts the volume-weighted interior mean, so a pure Neumann problem is
+// solvable.
+void Multigrid3DSolver::RemoveMean(Level& level, std::vector<float>& field) {
+  const int sy = level.stride_y;
+  const int sz = level.stride_z;
+  double sum = pool_.ParallelSum(0, level.az.n, [&](int z0, int z1) {
+    double part = 0.0;
+    for (int z = z0; z < z1; z++) {
+      for (int y = 0; y < level.ay.n; y++) {
+        const float* row =
+            field.data() + static_cast<size_t>(z + 1) * sz + (y + 1) * sy + 1;
+        double w = level.az.width[z] * level.ay.width[y];
+        for (int x = 0; x < level.ax.n; x++) {
+          part += w * level.ax.width[x] * row[x];
+        }
+      }
+    }
+    return part;
+  });
+  // the widths of each axis add up to the finest cell count
+  double volume = static_cast<double>(levels_[0].az.n) * levels_[0].ay.n *
+                  levels_[0].ax.n;
+  float mean = static_cast<float>(sum / volume);
+  pool_.ParallelFor(1, level.az.n + 1, [&](int z0, int z1) {
+    for (int z = z0; z < z1; z++) {
+      for (int y = 1; y <= level.ay.n; y++) {
+        float* row = field.data() + static_cast<size_t>(z) * sz + y * sy;
+        for (int x = 1; x <= level.ax.n; x++) {
+          row[x] -= mean;
+        }
+      }
+    }
+  });
+}
+
+void FillNeumannBoundary3D(float* x, int cells_z, int cells_y, int cells_x) {
+  const size_t sy = cells_x;
+  const size_t sz = static_cast<size_t>(cells_y) * cells_x;
+  const size_t last_z = static_cast<size_t>(cells_z - 1) * sz;
+  for (int y = 1; y < cells_y - 1; y++) {
+    for (int xi = 1; xi < cells_x - 1; xi++) {
+      x[y * sy + xi] = x[sz + y * sy + xi];
+      x[last_z + y * sy + xi] = x[last_z - sz + y * sy + xi];
+    }
+  }
+  for (int z = 0; z < cells_z; z++) {
+    float* slab = x + z * sz;
+    for (int xi = 1; xi < cells_x - 1; xi++) {
+      slab[xi] = slab[sy + xi];
+      slab[(cells_y - 1) * sy + xi] = slab[(cells_y - 2) * sy + xi];
+    }
+    for (int y = 0; y < cells_y; y++) {
+      slab[y * sy] = slab[y * sy + 1];
+      slab[y * sy + cells_x - 1] = slab[y * sy + cells_x - 2];
+    }
+  }
+}
+}  // namespace GLOO
@@ -0,0 +1,79 @@
+#ifndef MULTIGRID3D_H_
+#define MULTIGRID3D_H_
+
+#include "Field3D.hpp"
+#include "Multigrid.hpp"
+#include "ThreadPool.hpp"
+#include <vector>
+
+namespace GLOO {
+// The 3D counterpart of MultigridSolver, for Fluid3D: the same cell-centred
+// hierarchy with cells merged in pairs along all three axes, 7-point
+// finite-volume operators, red-black Gauss-Seidel smoothing, volume-weighted
+// restriction and trilinear prolongation. Every level loop is split over z
+// slabs on the pool, and the whole hierarchy is allocated in the
+// constructor.
+class Multigrid3DSolver {
+ public:
+  Multigrid3DSolver(const SimulationConfig& config, ThreadPool& pool);
+
+  Multigrid3DSolver(const Multigrid3DSolver&) = delete;
+  Multigrid3DSolver& operator=(const Multigrid3DSolver&) = delete;
+
+  // Solves
+  //
+  //   c * x - a * (sum of the six neighbours of x) = rhs
+  //
+  // on the interior cells with Neumann walls. x holds the initial guess on
+  // entry; on return its boundary cells are filled in as well.
+  void Solve(Field3D& x, const Field3D& rhs, float a, float c);
+
+  const SolverStats& GetLastStats() const {
+    return stats_;
+  }
+
+ private:
+  typedef MultigridAxis Axis;
+
+  struct Level {
+    Axis az;
+    Axis ay;
+    Axis ax;
+    // arrays carry an extra layer of cells so level 0 can alias a Field3D
+    int stride_y;
+    int stride_z;
+    std::vector<float> x_storage;
+    std::vector<float> b;
+    std::vector<float> r;
+    // points into x_storage, or at the caller's field on level 0
+    float* x;
+  };
+
+  void Cycle(int l);
+  void Smooth(Level& level, int sweeps);
+  // Writes b - A x into level.r and returns its RMS over the interior.
+  float ComputeResidual(Level& level);
+  void Restrict(const Level& fine, Level& coarse);
+  void ProlongateAdd(const Level& coarse, Level& fine);
+  void RemoveMean(Level& level, std::vector<float>& field);
+
+  ThreadPool& pool_;
+  std::vector<Level> levels_;
+  MultigridCycle cycle_;
+  int smooth_steps_;
+  float tolerance_;
+  int max_cycles_;
+  // operator coefficients of the current solve: a scales the couplings and
+  // shift = c - 6a is the identity part (zero for pressure)
+  float a_;
+  float shift_;
+  SolverStats stats_;
+};
+
+// Copies the interior neighbour of every boundary cell into it, for a grid
+// of cells_z * cells_y * cells_x values. Edges and corners copy from the
+// faces filled before them.
+void FillNeumannBoundary3D(float* x, int cells_z, int cells_y, int cells_x);
+}  // namespace GLOO
+
+#endif
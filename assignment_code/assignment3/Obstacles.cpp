@@ -0,0 +1,180 @@
+#include "Obstacles.hpp"
+
+#include "gloo/Image.hpp"
+#include "gloo/utils.hpp"
+
+#include <algorithm>
+
+namespace GLOO {
+ObstacleMap::ObstacleMap(int cells_y, int cells_x)
+    : cells_y_(cells_y),
+      cells_x_(cells_x),
+      num_solid_(0),
+      static_(static_cast<size_t>(cells_y) * cells_x, 0),
+      moving_(static_.size(), 0),
+      solid_(static_.size(), 0),
+      runs_(cells_y),
+      bucket_(static_.size(), 0),
+      slot_(static_.size(), -1),
+      dirty_flag_(static_.size(), 0) {
+  Build();
+}
+
+std::unique_ptr<ObstacleMap> ObstacleMap::FromImage(const Image& image,
+                                                    int cells_y, int cells_x,
+                                                    bool y_reversed) {
+  auto map = make_unique<ObstacleMap>(cells_y, cells_x);
+  const size_t width = image.GetWidth();
+  const size_t height = image.GetHeight();
+  for (int y = 1; y < cells_y - 1; y++) {
+    const size_t row = y * height / cells_y;
+    for (int x = 1; x < cells_x - 1; x++) {
+      const glm::vec3& pixel = image.GetPixel(x * width / cells_x,
+                                              y_reversed ? height - 1 - row : row);
+      if ((pixel.r + pixel.g + pixel.b) / 3.0f < 0.5f) {
+        map->SetSolid(y, x, true);
+      }
+    }
+  }
+  map->Build();
+  return map;
+}
+
+void ObstacleMap::SetSolid(int y, int x, bool solid) {
+  if (y > 0 && y < cells_y_ - 1 && x > 0 && x < cells_x_ - 1) {
+    const int i = y * cells_x_ + x;
+    static_[i] = solid ? 1 : 0;
+    MarkDirty(i);
+  }
+}
+
+void ObstacleMap::AddMovingCell(int i) {
+  moving_[i]++;
+  MarkDirty(i);
+}
+
+void ObstacleMap::RemoveMovingCell(int i) {
+  moving_[i]--;
+  MarkDirty(i);
+}
+
+void ObstacleMap::MarkDirty(int i) {
+  if (!dirty_flag_[i]) {
+    dirty_flag_[i] = 1;
+    dirty_.push_back(i);
+  }
+}
+
+int ObstacleMap::OpenFaces(int i) const {
+  if (!solid_[i]) {
+    return 0;
+  }
+  const int y = i / cells_x_;
+  const int x = i % cells_x_;
+  return (IsFluid(y - 1, x) ? kOpenUp : 0) | (IsFluid(y + 1, x) ? kOpenDown : 0) |
+         (IsFluid(y, x - 1) ? kOpenLeft : 0) | (IsFluid(y, x + 1) ? kOpenRight : 0);
+}
+
+// Buckets are unordered, so a cell leaves its bucket by swapping the last
+// cell of the bucket into its slot.
+void ObstacleMap::Rebucket(int i) {
+  const int open = OpenFaces(i);
+  const int old = bucket_[i];
+  if (open == old) {
+    return;
+  }
+  if (old != 0) {
+    std::vector<int>& from = buckets_[old];
+    const int moved = from.back();
+    from[slot_[i]] = moved;
+    slot_[moved] = slot_[i];
+    from.pop_back();
+  }
+  bucket_[i] = static_cast<unsigned char>(open);
+  slot_[i] = -1;
+  if (open != 0) {
+    slot_[i] = static_cast<int>(buckets_[open].size());
+    buckets_[open].push_back(i);
+  }
+}
+
+void ObstacleMap::BuildRuns(int y) {
+  std::vector<CellRun>& runs = runs_[y];
+  runs.clear();
+  int x = 1;
+  while (x < cells_x_ - 1) {
+    if (!IsFluid(y, x)) {
+      x++;
+      continue;
+    }
+    CellRun run;
+    run.x0 = x;
+    while (x < cells_x_ - 1 && IsFluid(y, x)) {
+      x++;
+    }
+    run.x1 = x;
+    runs.push_back(run);
+  }
+}
+
+void ObstacleMap::Build() {
+  num_solid_ = 0;
+  for (size_t i = 0; i < solid_.size(); i++) {
+    solid_[i] = static_[i] || moving_[i] ? 1 : 0;
+    num_solid_ += solid_[i];
+    dirty_flag_[i] = 0;
+  }
+  dirty_.clear();
+  uncovered_.clear();
+  covered_.clear();
+  for (int y = 1; y < cells_y_ - 1; y++) {
+    BuildRuns(y);
+  }
+  for (int open = 0; open < kNumBuckets; open++) {
+    buckets_[open].clear();
+  }
+  std::fill(bucket_.begin(), bucket_.end(), 0);
+  std::fill(slot_.begin(), slot_.end(), -1);
+  for (int y = 1; y < cells_y_ - 1; y++) {
+    for (int x = 1; x < cells_x_ - 1; x++) {
+      Rebucket(y * cells_x_ + x);
+    }
+  }
+}
+
+void ObstacleMap::Update() {
+  uncovered_.clear();
+  covered_.clear();
+  std::vector<int> rows;
+  for (int i : dirty_) {
+    dirty_flag_[i] = 0;
+    const unsigned char solid = static_[i] || moving_[i] ? 1 : 0;
+    if (solid == solid_[i]) {
+      continue;
+    }
+    solid_[i] = solid;
+    num_solid_ += solid ? 1 : -1;
+    (solid ? covered_ : uncovered_).push_back(i);
+    rows.push_back(i / cells_x_);
+  }
+  dirty_.clear();
+
+  // a flip changes the open faces of the cell and of its four neighbours
+  for (const std::vector<int>* flipped : {&covered_, &uncovered_}) {
+    for (int i : *flipped) {
+      for (int k : {i, i - cells_x_, i + cells_x_, i - 1, i + 1}) {
+        const int y = k / cells_x_;
+        const int x = k % cells_x_;
+        if (y > 0 && y < cells_y_ - 1 && x > 0 && x < cells_x_ - 1) {
+          Rebucket(k);
+        }
+      }
+    }
+  }
+  std::sort(rows.begin(), rows.end());
+  rows.erase(std::unique(rows.begin(), rows.end()), rows.end());
+  for (int y : rows) {
+    BuildRuns(y);
+  }
+}
+}  // namespace GLOO
@@ -0,0 +1,195 @@
+#ifndef OBSTACLES_H_
+#define OBSTACLES_H_
+
+#include "BoundaryConditions.hpp"
+#include <memory>
+#include <vector>
+
+namespace GLOO {
+class Image;
+
+// Cells [x0, x1) of one row.
+struct CellRun {
+  int x0;
+  int x1;
+};
+
+// The runs of one row, for range-based for loops.
+struct CellRunRange {
+  const CellRun* first;
+  const CellRun* last;
+
+  const CellRun* begin() const {
+    return first;
+  }
+
+  const CellRun* end() const {
+    return last;
+  }
+};
+
+// Solid cells inside the box of a cells_y x cells_x grid, for Fluid. The
+// ghost ring is the box wall and is never solid. A cell is solid while it
+// is marked static with SetSolid() or covered by at least one moving
+// obstacle (see MovingObstacle).
+//
+// The mask is kept as two compact lists. The fluid cells of each interior
+// row form runs, so stencil loops visit only fluid without a test per
+// cell. The solid cells next to the fluid are bucketed by which of their
+// four faces are open to it. They then act as ghost cells for the fluid
+// beside them, like the ring does for the box, and Fill() sets them bucket
+// by bucket in O(boundary cells).
+//
+// Build() derives both lists from the whole mask. After that, Update()
+// only revisits the cells changed since the last call and their
+// neighbours, plus one scan of each row with a changed cell.
+class ObstacleMap {
+ public:
+  // faces of a solid cell that border a fluid cell
+  static const int kOpenUp = 1;
+  static const int kOpenDown = 2;
+  static const int kOpenLeft = 4;
+  static const int kOpenRight = 8;
+  static const int kNumBuckets = 16;
+
+  ObstacleMap(int cells_y, int cells_x);
+
+  // The image is scaled to the grid by nearest sampling, and cells whose
+  // pixel is darker than mid-grey are solid. With y_reversed the last row
+  // of the image is row 0 of the grid, which lines a PNG up with the
+  // frames SavePNG writes.
+  static std::unique_ptr<ObstacleMap> FromImage(const Image& image,
+                                                int cells_y, int cells_x,
+                                                bool y_reversed);
+
+  int cells_y() const {
+    return cells_y_;
+  }
+
+  int cells_x() const {
+    return cells_x_;
+  }
+
+  // Changes to the mask take effect at the next Build() or Update(). Cells
+  // on the ghost ring are ignored.
+  void SetSolid(int y, int x, bool solid);
+
+  // Counts a moving obstacle in or out of interior cell i (a grid index).
+  void AddMovingCell(int i);
+  void RemoveMovingCell(int i);
+
+  bool IsSolid(int y, int x) const {
+    return solid_[y * cells_x_ + x] != 0;
+  }
+
+  // Whether cell i is solid only because of moving obstacles.
+  bool IsMovingOnly(int i) const {
+    return !static_[i] && moving_[i] > 0;
+  }
+
+  // Recomputes the runs and the boundary buckets from the whole mask.
+  void Build();
+
+  // Brings the lists up to date with the cells changed since the last
+  // Build() or Update().
+  void Update();
+
+  // Cells that turned fluid, or solid, in the last Update().
+  const std::vector<int>& GetUncovered() const {
+    return uncovered_;
+  }
+
+  const std::vector<int>& GetCovered() const {
+    return covered_;
+  }
+
+  // Fluid runs of interior row y.
+  CellRunRange GetRuns(int y) const {
+    const std::vector<CellRun>& runs = runs_[y];
+    return CellRunRange{runs.data(), runs.data() + runs.size()};
+  }
+
+  // Grid indices of the solid cells with exactly the open faces open, in
+  // no particular order.
+  const std::vector<int>& GetBoundaryCells(int open) const {
+    return buckets_[open];
+  }
+
+  int GetNumSolid() const {
+    return num_solid_;
+  }
+
+  // Sets every boundary cell of field from its open neighbours with the
+  // signs of Policy: kEnd for the cells above and below, kSide for those to
+  // the left and right, averaged over the open faces. A face whose sign is
+  // -1 mirrors the fluid through the wall; given the velocity of the wall
+  // in each cell, it mirrors the fluid about that instead, so a moving
+  // wall drags the fluid along. Within a bucket the weights are fixed, so
+  // the loop has no branches.
+  template <class Policy, typename Real>
+  void Fill(Real* field, const Real* wall = nullptr) const {
+    const int s = cells_x_;
+    for (int open = 1; open < kNumBuckets; open++) {
+      const std::vector<int>& cells = buckets_[open];
+      if (cells.empty()) {
+        continue;
+      }
+      const int ends = ((open & kOpenUp) != 0) + ((open & kOpenDown) != 0);
+      const int sides = ((open & kOpenLeft) != 0) + ((open & kOpenRight) != 0);
+      const Real share = Real(1) / static_cast<Real>(ends + sides);
+      const Real end = static_cast<Real>(Policy::kEnd) * share;
+      const Real side = static_cast<Real>(Policy::kSide) * share;
+      const Real up = (open & kOpenUp) ? end : Real(0);
+      const Real down = (open & kOpenDown) ? end : Real(0);
+      const Real left = (open & kOpenLeft) ? side : Real(0);
+      const Real right = (open & kOpenRight) ? side : Real(0);
+      const Real drag = static_cast<Real>(ends * (1 - Policy::kEnd) +
+                                          sides * (1 - Policy::kSide)) * share;
+      if (wall && drag != Real(0)) {
+        for (int k : cells) {
+          field[k] = up * field[k - s] + down * field[k + s] + left * field[k - 1] +
+                     right * field[k + 1] + drag * wall[k];
+        }
+      } else {
+        for (int k : cells) {
+          field[k] = up * field[k - s] + down * field[k + s] + left * field[k - 1] +
+                     right * field[k + 1];
+        }
+      }
+    }
+  }
+
+ private:
+  bool IsFluid(int y, int x) const {
+    return y > 0 && y < cells_y_ - 1 && x > 0 && x < cells_x_ - 1 &&
+           !solid_[y * cells_x_ + x];
+  }
+
+  // Open faces of cell i; 0 for fluid cells.
+  int OpenFaces(int i) const;
+  // Moves cell i into the bucket of its current open faces.
+  void Rebucket(int i);
+  void BuildRuns(int y);
+  void MarkDirty(int i);
+
+  int cells_y_;
+  int cells_x_;
+  int num_solid_;
+  std::vector<unsigned char> static_;
+  std::vector<unsigned char> moving_;
+  // the mask as of the last Build() or Update()
+  std::vector<unsigned char> solid_;
+  std::vector<std::vector<CellRun>> runs_;
+  std::vector<int> buckets_[kNumBuckets];
+  // bucket of each cell (0 for none) and its index in there
+  std::vector<unsigned char> bucket_;
+  std::vector<int> slot_;
+  // cells changed since the last Build() or Update()
+  std::vector<unsigned char> dirty_flag_;
+  std::vector<int> dirty_;
+  std::vector<int> uncovered_;
+  std::vector<int> covered_;
+};
+}  // namespace GLOO
+
+#endif
@@ -0,0 +1,102 @@
+#ifndef PACKED_FIELD2D_H_
+#define PACKED_FIELD2D_H_
+
+#include "HalfFloat.hpp"
+#include "Parameters.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+namespace GLOO {
+// A Field2D stored in one of the 16-bit ScalarStorage formats. Kernels read
+// and write the raw words and convert in registers; Get() and Set() are
+// for single cells.
+class PackedField2D {
+ public:
+  PackedField2D(int cells_y, int cells_x, ScalarStorage storage)
+      : cells_y_(cells_y),
+        cells_x_(cells_x),
+        storage_(storage),
+        data_(static_cast<size_t>(cells_y) * cells_x, 0) {
+  }
+
+  PackedField2D(const PackedField2D&) = delete;
+  PackedField2D& operator=(const PackedField2D&) = delete;
+
+  int cells_y() const {
+    return cells_y_;
+  }
+
+  int cells_x() const {
+    return cells_x_;
+  }
+
+  ScalarStorage storage() const {
+    return storage_;
+  }
+
+  float Get(int i) const {
+    return storage_ == ScalarStorage::BFloat16 ? BFloat16ToFloat(data_[i])
+                                               : HalfToFloat(data_[i]);
+  }
+
+  void Set(int i, float value) {
+    data_[i] = storage_ == ScalarStorage::BFloat16 ? FloatToBFloat16(value)
+                                                   : FloatToHalf(value);
+  }
+
+  uint16_t* data() {
+    return data_.data();
+  }
+
+  const uint16_t* data() const {
+    return data_.data();
+  }
+
+ private:
+  int cells_y_;
+  int cells_x_;
+  ScalarStorage storage_;
+  std::vector<uint16_t> data_;
+};
+
+// DoubleBuffer for PackedField2D.
+class PackedDoubleBuffer {
+ public:
+  PackedDoubleBuffer(int cells_y, int cells_x, ScalarStorage storage)
+      : buffers_{{cells_y, cells_x, storage}, {cells_y, cells_x, storage}},
+        front_(&buffers_[0]),
+        back_(&buffers_[1]) {
+  }
+
+  PackedDoubleBuffer(const PackedDoubleBuffer&) = delete;
+  PackedDoubleBuffer& operator=(const PackedDoubleBuffer&) = delete;
+
+  PackedField2D& front() {
+    return *front_;
+  }
+
+  const PackedField2D& front() const {
+    return *front_;
+  }
+
+  PackedField2D& back() {
+    return *back_;
+  }
+
+  const PackedField2D& back() const {
+    return *back_;
+  }
+
+  void swap() {
+    std::swap(front_, back_);
+  }
+
+ private:
+  PackedField2D buffers_[2];
+  PackedField2D* front_;
+  PackedField2D* back_;
+};
+}  // namespace GLOO
+
+#endif
@@ -1,22 +1,231 @@
 #ifndef PARAMETERS_H
 #define PARAMETERS_H
 
-// Grid parameters
-#define CELLS_Y    120
-#define CELLS_X    120
-#define num_cells (CELLS_Y * CELLS_X)
-
-// Fluid parameters
-#define VISCOSITY      0
-#define DIFFUSION      0
-#define DISSIPATION 0.02
-
-// Simulation parameters
-#define NUM_ITER              5
-#define DT                  0.1
-#define CLEANUP           false
-
-// indexing function
-inline int IndexOf(int y, int x) { return y * CELLS_X + x; }
+#include <string>
+#include <vector>
+
+namespace GLOO {
+// Backend for the linear solves in Fluid::project() and Fluid::diffuse().
+enum class LinearSolverType {
+  GaussSeidel,
+  Multigrid,
+  ConjugateGradient,
+  // weighted Jacobi with SIMD row kernels
+  Jacobi,
+  // exact DCT solve; obstacle-free boxes only
+  Spectral,
+};
+
+enum class Preconditioner {
+  Jacobi,
+  IncompleteCholesky,
+  ModifiedIncompleteCholesky,
+};
+
+// Cell ordering of the Gauss-Seidel sweeps in Fluid::lin_solve. Red-black
+// updates all cells of one checkerboard colour, then the other, so rows can
+// be split over threads.
+enum class SweepOrder {
+  Lexicographic,
+  RedBlack,
+};
+
+enum class MultigridCycle {
+  V,
+  W,
+};
+
+// Advection of a field in Fluid::transport. MacCormack and BFECC trace the
+// semi-Lagrangian result back along the velocity to estimate its error and
+// cancel it, which keeps the scheme second order in smooth regions; the
+// corrected value is clamped to the four samples around the departure point
+// so it cannot overshoot.
+enum class AdvectionScheme {
+  SemiLagrangian,
+  MacCormack,
+  Bfecc,
+};
+
+// Where Fluid stores the velocity. Collocated keeps both components at the
+// cell centres, so the projection uses central differences that leave the
+// odd and even cells decoupled. Staggered is a MAC grid: U_y[y][x] is the
+// vertical velocity on the face between cells (y - 1, x) and (y, x), and
+// U_x[y][x] the horizontal velocity between (y, x - 1) and (y, x), so the
+// divergence and the gradient are compact one-cell differences.
+enum class VelocityLayout {
+  Collocated,
+  Staggered,
+};
+
+// What the walls of the 2D box do to the velocity (see
+// BoundaryConditions.hpp). FreeSlip reflects the normal component and keeps
+// the tangential one, NoSlip reflects both, and Periodic wraps every field
+// around, so there are no walls at all. Scalars have zero-gradient walls
+// unless periodic.
+enum class WallCondition {
+  FreeSlip,
+  NoSlip,
+  Periodic,
+};
+
+// Interpolation of the advected fields at the departure points. Cubic is a
+// Catmull-Rom spline clamped to the bilinear taps, so it stays monotone.
+enum class AdvectionSampler {
+  Bilinear,
+  Cubic,
+};
+
+// Storage format of a scalar field. The 16-bit formats halve the memory
+// traffic; the kernels convert to float in registers and compute in float.
+// Float16 keeps 10 mantissa bits over [6e-8, 65504], BFloat16 keeps 7
+// mantissa bits over the whole float range.
+enum class ScalarStorage {
+  Float32,
+  Float16,
+  BFloat16,
+};
+
+// Precision of the 2D solver's grids and arithmetic (BasicFluid<float> or
+// BasicFluid<double>).
+enum class Precision {
+  Float,
+  Double,
+};
+
+// A scalar carried by the flow besides the density, such as one colour of
+// a dye, a temperature or a fuel. Each step it is advected, diffused with
+// its own coefficient and scaled by 1 / (1 + dt * dissipation). buoyancy
+// adds dt * buoyancy * value to U_y, so a positive value rises.
+struct ScalarChannel {
+  ScalarChannel(const std::string& name, float diffusion = 0.f,
+                float dissipation = 0.f, float buoyancy = 0.f)
+      : name(name), diffusion(diffusion), dissipation(dissipation), buoyancy(buoyancy) {
+  }
+
+  std::string name;
+  float diffusion;
+  float dissipation;
+  float buoyancy;
+};
+
+// Run-time parameters of a Fluid. The defaults reproduce the original
+// 120x120 setup; grids are allocated once from cells_y/cells_x.
+struct SimulationConfig {
+  // Grid parameters (the outermost ring of cells holds boundary values).
+  // cells_z > 1 runs the volumetric Fluid3D instead, with boundary layers
+  // on every side, so it needs at least 3.
+  int cells_z = 1;
+  int cells_y = 120;
+  int cells_x = 120;
+
+  // Fluid parameters
+  float viscosity = 0.f;
+  float diffusion = 0.f;
+  float dissipation = 0.02f;
+  // Strength epsilon of the vorticity confinement force, which restores
+  // the small swirls the grid smooths out; 0 skips the stage. Applied by
+  // the 2D solver on the collocated layout only.
+  float vorticity_confinement = 0.f;
+
+  // Simulation parameters
+  int num_iter = 5;
+  float dt = 0.1f;
+  bool cleanup = false;
+  // Advect the density in the same sweep as the velocity, sharing the
+  // departure points. The density then moves with the velocity from before
+  // the second projection instead of after it.
+  bool fused_advection = false;
+  // Advection scheme of the velocity and of the density.
+  AdvectionScheme velocity_advection = AdvectionScheme::SemiLagrangian;
+  AdvectionScheme density_advection = AdvectionScheme::SemiLagrangian;
+  AdvectionSampler advection_sampler = AdvectionSampler::Bilinear;
+  // Fused advection needs the collocated layout, where the velocity and
+  // the density share their departure points.
+  VelocityLayout velocity_layout = VelocityLayout::Collocated;
+  // Periodic needs the collocated layout and the Gauss-Seidel backends, as
+  // the others assume walls, and the bilinear sampler. It rules out the
+  // block-sparse mode and the 16-bit density.
+  WallCondition walls = WallCondition::FreeSlip;
+  // PNG whose dark pixels are solid obstacles inside the box (see
+  // ObstacleMap); empty for none. Obstacles need the collocated layout.
+  // Their walls follow walls, free slip when that is Periodic, and like
+  // periodic walls they need the Gauss-Seidel backends and rule out the
+  // block-sparse mode and the 16-bit density.
+  std::string obstacle_image;
+  // Extra scalars of the 2D solver, stored together (see ChannelField2D);
+  // empty for none. They need the collocated layout and non-periodic
+  // walls, and rule out the block-sparse mode.
+  std::vector<ScalarChannel> scalar_channels;
+  // Run each step as a dependency graph of row-band tasks (graph_tiles
+  // bands; 0 uses four per thread) and keep its critical path.
+  bool task_graph = false;
+  int graph_tiles = 0;
+  // Block-sparse mode: with a tile size > 0, the grid loops only visit the
+  // sparse_tile_size^2 tiles holding a density or velocity above
+  // sparse_threshold, and the tiles within sparse_dilation of them; the
+  // rest of the grid is kept at zero. Smoke must not travel further than
+  // the dilation band in one step. Needs the uniform 2D grid with the
+  // collocated layout, non-periodic walls, no obstacles or channels,
+  // semi-Lagrangian advection without fusion, the sequential step and the
+  // Gauss-Seidel solver, whose sweeps hold the inactive cells at zero and
+  // run in gauss_seidel_order. Only the loops are sparse: every grid is
+  // still stored densely, so memory scales with the whole domain.
+  int sparse_tile_size = 0;
+  float sparse_threshold = 1e-3f;
+  int sparse_dilation = 1;
+  // Adaptive mode: quadtree_levels > 0 runs QuadtreeFluid, whose leaves
+  // range from single cells to 2^quadtree_levels-cell blocks. Every
+  // quadtree_interval steps, leaves with a vorticity above refine_curl or a
+  // density gradient above refine_density_gradient (per cell) split, and
+  // sibling leaves below half of both merge. Fields are stored per leaf,
+  // so a step costs O(leaves) apart from the tree's cell-to-leaf map (see
+  // QuadtreeFluid).
+  int quadtree_levels = 0;
+  int quadtree_interval = 2;
+  float refine_curl = 0.01f;
+  float refine_density_gradient = 0.01f;
+  // Storage of the density between steps. The 16-bit formats need the
+  // collocated layout, bilinear semi-Lagrangian advection of both fields
+  // without fusion, the sequential dense step, no density diffusion,
+  // non-periodic walls and no obstacles (see CheckFluidConfig).
+  ScalarStorage density_storage = ScalarStorage::Float32;
+  // Precision of the 2D solver. The volumetric and quadtree modes need
+  // Float.
+  Precision precision = Precision::Float;
+
+  // Linear solves. The Gauss-Seidel backend always runs num_iter sweeps
+  // and the spectral one solves directly; the others iterate until the
+  // residual, relative to the right-hand side, drops below solver_tolerance
+  // or solver_max_iter is reached.
+  LinearSolverType pressure_solver = LinearSolverType::GaussSeidel;
+  LinearSolverType diffusion_solver = LinearSolverType::GaussSeidel;
+  SweepOrder gauss_seidel_order = SweepOrder::Lexicographic;
+  float solver_tolerance = 1e-4f;
+  int solver_max_iter = 200;
+
+  // Multigrid parameters (solver_max_iter counts cycles)
+  MultigridCycle multigrid_cycle = MultigridCycle::V;
+  int multigrid_smooth_steps = 2;
+
+  // Jacobi parameters (solver_max_iter counts sweeps); the weight is in
+  // (0, 1], and weights below 1 damp the checkerboard modes
+  float jacobi_weight = 1.0f;
+  // Temporal tiling: with a tile size > 0, each tile of tile_size^2 cells
+  // runs jacobi_time_block sweeps in cache before the next one is loaded.
+  int jacobi_tile_size = 0;
+  int jacobi_time_block = 4;
+
+  // Conjugate gradient parameters
+  Preconditioner pcg_preconditioner = Preconditioner::ModifiedIncompleteCholesky;
+
+  // Worker threads for the parallel kernels; 0 uses every core.
+  int num_threads = 0;
+  // Bind worker i to core i (Linux only). The thread that builds the pool
+  // takes part as worker 0 but is not pinned.
+  bool pin_threads = false;
+  // Rows per parallel-for task; 0 sizes the tasks from the loop length.
+  int grain_size = 0;
+};
+}  // namespace GLOO
 
 #endif
@@ -0,0 +1,53 @@
+#include "PoissonSolver.hpp"
+#include "Multigrid.hpp"
+#include "ConjugateGradient.hpp"
+#include "Jacobi.hpp"
+#include "Spectral.hpp"
+#include "gloo/utils.hpp"
+
+namespace GLOO {
+template <typename Real>
+std::unique_ptr<BasicPoissonSolver<Real>> CreatePoissonSolver(
+    LinearSolverType type, const SimulationConfig& config, ThreadPool& pool) {
+  switch (type) {
+    case LinearSolverType::Multigrid:
+      return make_unique<MultigridSolver<Real>>(config);
+    case LinearSolverType::ConjugateGradient:
+      return make_unique<ConjugateGradientSolver<Real>>(config, pool);
+    case LinearSolverType::Jacobi:
+      return make_unique<JacobiSolver<Real>>(config, pool);
+    case LinearSolverType::Spectral:
+      return make_unique<SpectralSolver<Real>>(config, pool);
+    case LinearSolverType::GaussSeidel:
+      break;
+  }
+  return nullptr;
+}
+
+template <typename Real>
+void FillNeumannBoundary(Real* x, int cells_y, int cells_x) {
+  const int s = cells_x;
+  for (int y = 1; y < cells_y - 1; y++) {
+    x[y * s] = x[y * s + 1];
+    x[y * s + cells_x - 1] = x[y * s + cells_x - 2];
+  }
+  for (int i = 1; i < cells_x - 1; i++) {
+    x[i] = x[s + i];
+    x[(cells_y - 1) * s + i] = x[(cells_y - 2) * s + i];
+  }
+
+  // corner values
+  x[0] = (x[1] + x[s]) / 2.0f;
+  x[cells_x - 1] = (x[cells_x - 2] + x[s + cells_x - 1]) / 2.0f;
+  x[(cells_y - 1) * s] = (x[(cells_y - 1) * s + 1] + x[(cells_y - 2) * s]) / 2.0f;
+  x[(cells_y - 1) * s + cells_x - 1] = (x[(cells_y - 1) * s + cells_x - 2] +
+                                        x[(cells_y - 2) * s + cells_x - 1]) / 2.0f;
+}
+
+template std::unique_ptr<BasicPoissonSolver<float>> CreatePoissonSolver<float>(
+    LinearSolverType, const SimulationConfig&, ThreadPool&);
+template std::unique_ptr<BasicPoissonSolver<double>> CreatePoissonSolver<double>(
+    LinearSolverType, const SimulationConfig&, ThreadPool&);
+template void FillNeumannBoundary<float>(float*, int, int);
+template void FillNeumannBoundary<double>(double*, int, int);
+}  // namespace GLOO
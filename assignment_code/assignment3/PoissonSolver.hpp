@@ -0,0 +1,60 @@
+#ifndef POISSON_SOLVER_H_
+#define POISSON_SOLVER_H_
+
+#include "Parameters.hpp"
+#include "Field2D.hpp"
+#include "ThreadPool.hpp"
+#include <memory>
+
+namespace GLOO {
+// Convergence report of the last Solve().
+struct SolverStats {
+  int iterations = 0;
+  // RMS residual relative to the RMS of the right-hand side
+  float residual = 0.f;
+};
+
+// Interface of the pluggable linear solvers. Every backend solves the same
+// system as Fluid::lin_solve(x, rhs, a, c):
+//
+//   c * x[y][x] - a * (x[y-1][x] + x[y+1][x] + x[y][x-1] + x[y][x+1]) = rhs[y][x]
+//
+// on the interior cells, with Neumann walls (each boundary cell equals its
+// interior neighbour). x holds the initial guess on entry. On return the
+// boundary ring of x is filled in as well.
+//
+// Every backend is a template over the type of the grids it solves, with
+// explicit instantiations for float and double.
+template <typename Real>
+class BasicPoissonSolver {
+ public:
+  virtual ~BasicPoissonSolver() {
+  }
+
+  virtual void Solve(BasicField2D<Real>& x, const BasicField2D<Real>& rhs,
+                     Real a, Real c) = 0;
+
+  const SolverStats& GetLastStats() const {
+    return stats_;
+  }
+
+ protected:
+  SolverStats stats_;
+};
+
+typedef BasicPoissonSolver<float> PoissonSolverBase;
+
+// Returns the backend selected by type, sized for config's grid. Returns
+// nullptr for LinearSolverType::GaussSeidel, which is Fluid::lin_solve.
+// Threaded backends run their loops on pool.
+template <typename Real>
+std::unique_ptr<BasicPoissonSolver<Real>> CreatePoissonSolver(
+    LinearSolverType type, const SimulationConfig& config, ThreadPool& pool);
+
+// Copies the interior neighbour of every boundary cell into it, and averages
+// the corners, for a grid of cells_y * cells_x values.
+template <typename Real>
+void FillNeumannBoundary(Real* x, int cells_y, int cells_x);
+}  // namespace GLOO
+
+#endif
@@ -0,0 +1,168 @@
+#include "Quadtree.hpp"
+
+namespace GLOO {
+Quadtree::Quadtree(int rows, int cols, int levels)
+    : rows_(rows), cols_(cols), max_size_(1 << levels), num_leaves_(0),
+      owner_(static_cast<size_t>(rows) * cols, -1) {
+  for (int y = 0; y < rows; y += max_size_) {
+    for (int x = 0; x < cols; x += max_size_) {
+      AddFitting(y, x, max_size_);
+    }
+  }
+  num_leaves_ = GetNumSlots();
+  faces_.resize(leaves_.size());
+  is_rebuilt_.assign(leaves_.size(), 0);
+  for (int i = 0; i < GetNumSlots(); i++) {
+    SetOwner(i);
+  }
+  for (int i = 0; i < GetNumSlots(); i++) {
+    BuildFaces(i);
+  }
+}
+
+void Quadtree::AddFitting(int y0, int x0, int size) {
+  if (y0 + size <= rows_ && x0 + size <= cols_) {
+    leaves_.push_back({y0, x0, size});
+    return;
+  }
+  const int half = size / 2;
+  for (int y = y0; y < y0 + size && y < rows_; y += half) {
+    for (int x = x0; x < x0 + size && x < cols_; x += half) {
+      AddFitting(y, x, half);
+    }
+  }
+}
+
+int Quadtree::NewSlot() {
+  if (!free_.empty()) {
+    const int i = free_.back();
+    free_.pop_back();
+    return i;
+  }
+  leaves_.push_back({0, 0, 0});
+  faces_.emplace_back();
+  is_rebuilt_.push_back(0);
+  return GetNumSlots() - 1;
+}
+
+void Quadtree::Adapt(const std::vector<signed char>& action) {
+  const int count = GetNumSlots();
+  merges_.clear();
+  splits_.clear();
+  for (int i = 0; i < count; i++) {
+    const QuadtreeLeaf& leaf = leaves_[i];
+    const int s = leaf.size;
+    if (s == 0) {
+      continue;
+    }
+    if (action[i] > 0 && s > 1) {
+      splits_.push_back({i, {-1, -1, -1}});
+    }
+    // the top-left sibling decides for its group
+    if (action[i] >= 0 || 2 * s > max_size_ || leaf.y0 % (2 * s) != 0 ||
+        leaf.x0 % (2 * s) != 0 || leaf.y0 + 2 * s > rows_ || leaf.x0 + 2 * s > cols_) {
+      continue;
+    }
+    const QuadtreeChange group = {i, {GetLeafAt(leaf.y0, leaf.x0 + s), GetLeafAt(leaf.y0 + s, leaf.x0),
+                                      GetLeafAt(leaf.y0 + s, leaf.x0 + s)}};
+    bool whole = true;
+    for (int j : group.siblings) {
+      whole = whole && leaves_[j].size == s && action[j] < 0;
+    }
+    if (whole) {
+      merges_.push_back(group);
+    }
+  }
+
+  rebuilt_.clear();
+  for (const QuadtreeChange& merge : merges_) {
+    leaves_[merge.leaf].size *= 2;
+    for (int j : merge.siblings) {
+      leaves_[j].size = 0;
+      faces_[j].clear();
+      free_.push_back(j);
+    }
+    SetOwner(merge.leaf);
+    rebuilt_.push_back(merge.leaf);
+  }
+  for (QuadtreeChange& split : splits_) {
+    QuadtreeLeaf& leaf = leaves_[split.leaf];
+    const int h = leaf.size / 2;
+    leaf.size = h;
+    const QuadtreeLeaf children[3] = {{leaf.y0, leaf.x0 + h, h}, {leaf.y0 + h, leaf.x0, h},
+                                      {leaf.y0 + h, leaf.x0 + h, h}};
+    rebuilt_.push_back(split.leaf);
+    for (int c = 0; c < 3; c++) {
+      // NewSlot() may grow leaves_, so leaf is not used past this point
+      const int j = NewSlot();
+      leaves_[j] = children[c];
+      split.siblings[c] = j;
+      SetOwner(j);
+      rebuilt_.push_back(j);
+    }
+  }
+  num_leaves_ += 3 * static_cast<int>(splits_.size()) - 3 * static_cast<int>(merges_.size());
+
+  // the changed leaves, then every leaf next to them
+  const int changed = static_cast<int>(rebuilt_.size());
+  for (int k = 0; k < changed; k++) {
+    is_rebuilt_[rebuilt_[k]] = 1;
+    BuildFaces(rebuilt_[k]);
+  }
+  for (int k = 0; k < changed; k++) {
+    for (const QuadtreeFace& face : faces_[rebuilt_[k]]) {
+      if (face.neighbour >= 0 && !is_rebuilt_[face.neighbour]) {
+        is_rebuilt_[face.neighbour] = 1;
+        rebuilt_.push_back(face.neighbour);
+        BuildFaces(face.neighbour);
+      }
+    }
+  }
+  for (int i : rebuilt_) {
+    is_rebuilt_[i] = 0;
+  }
+}
+
+void Quadtree::SetOwner(int i) {
+  const QuadtreeLeaf& leaf = leaves_[i];
+  for (int y = leaf.y0; y < leaf.y0 + leaf.size; y++) {
+    for (int x = leaf.x0; x < leaf.x0 + leaf.size; x++) {
+      owner_[y * cols_ + x] = i;
+    }
+  }
+}
+
+void Quadtree::BuildFaces(int i) {
+  std::vector<QuadtreeFace>& faces = faces_[i];
+  faces.clear();
+  AddSideFaces(i, 0, -1.0f, faces);
+  AddSideFaces(i, 0, 1.0f, faces);
+  AddSideFaces(i, 1, -1.0f, faces);
+  AddSideFaces(i, 1, 1.0f, faces);
+}
+
+void Quadtree::AddSideFaces(int i, int axis, float sign,
+                            std::vector<QuadtreeFace>& out) const {
+  const QuadtreeLeaf& leaf = leaves_[i];
+  const int start = axis == 0 ? leaf.y0 : leaf.x0;
+  const int outside = sign < 0.f ? start - 1 : start + leaf.size;
+  if (outside < 0 || outside >= (axis == 0 ? rows_ : cols_)) {
+    out.push_back({-1, axis, sign, static_cast<float>(leaf.size), 0.f});
+    return;
+  }
+  // the neighbours along the side, one face per run of cells
+  int k = 0;
+  while (k < leaf.size) {
+    const int j = axis == 0 ? GetLeafAt(outside, leaf.x0 + k) : GetLeafAt(leaf.y0 + k, outside);
+    int run = 1;
+    while (k + run < leaf.size &&
+           (axis == 0 ? GetLeafAt(outside, leaf.x0 + k + run)
+                      : GetLeafAt(leaf.y0 + k + run, outside)) == j) {
+      run++;
+    }
+    const float distance = 0.5f * static_cast<float>(leaf.size + leaves_[j].size);
+    out.push_back({j, axis, sign, static_cast<float>(run), static_cast<float>(run) / distance});
+    k += run;
+  }
+}
+}  // namespace GLOO
@@ -0,0 +1,119 @@
+#ifndef QUADTREE_H_
+#define QUADTREE_H_
+
+#include <cstddef>
+#include <vector>
+
+namespace GLOO {
+// A square block of size x size cells starting at cell (y0, x0). A size of
+// 0 marks a free leaf slot.
+struct QuadtreeLeaf {
+  int y0;
+  int x0;
+  int size;
+};
+
+// One side of a leaf, or the part of it shared with one neighbour.
+struct QuadtreeFace {
+  // neighbouring leaf, or -1 on a wall
+  int neighbour;
+  // normal along y (0) or x (1), pointing out of the leaf when sign is 1
+  int axis;
+  float sign;
+  float length;
+  // length over the distance between the two leaf centres
+  float coupling;
+};
+
+// A leaf that split in four, or four siblings that merged. The parent and
+// its top-left child share the slot leaf; the other three children are in
+// siblings, new slots after a split and freed ones after a merge.
+struct QuadtreeChange {
+  int leaf;
+  int siblings[3];
+};
+
+// Linear quadtree over a rows x cols grid: the leaves are the blocks of a
+// dyadic subdivision of 2^levels-cell root blocks, and every cell knows the
+// leaf that covers it. Root blocks that stick out of the grid are split
+// until their leaves fit.
+//
+// The tree changes by at most one level per Adapt() call: leaves split in
+// four, or four sibling leaves merge back into their parent. Leaves keep
+// their slot while they exist, freed slots are reused by later splits, and
+// an Adapt() only rewrites the cells of the leaves that changed and the
+// faces around them. Leaves of any size may be neighbours, so the tree is
+// not 2:1 balanced; the faces list a leaf's neighbours run by run along
+// each side.
+class Quadtree {
+ public:
+  Quadtree(int rows, int cols, int levels);
+
+  Quadtree(const Quadtree&) = delete;
+  Quadtree& operator=(const Quadtree&) = delete;
+
+  // action[i] > 0 splits leaf i, action[i] < 0 lets it merge with its
+  // siblings when all four ask for it, 0 keeps it; action has a value per
+  // slot.
+  void Adapt(const std::vector<signed char>& action);
+
+  // Indexed by slot, free slots included.
+  const std::vector<QuadtreeLeaf>& GetLeaves() const {
+    return leaves_;
+  }
+
+  int GetNumSlots() const {
+    return static_cast<int>(leaves_.size());
+  }
+
+  int GetNumLeaves() const {
+    return num_leaves_;
+  }
+
+  // Splits and merges of the last Adapt(). The merges were applied first,
+  // so a split may reuse the slot of a merged sibling.
+  const std::vector<QuadtreeChange>& GetSplits() const {
+    return splits_;
+  }
+
+  const std::vector<QuadtreeChange>& GetMerges() const {
+    return merges_;
+  }
+
+  int GetLeafAt(int y, int x) const {
+    return owner_[y * cols_ + x];
+  }
+
+  // Empty for a free slot.
+  const std::vector<QuadtreeFace>& GetFaces(int i) const {
+    return faces_[i];
+  }
+
+ private:
+  void AddFitting(int y0, int x0, int size);
+  int NewSlot();
+  // Points the cells of leaf i at it.
+  void SetOwner(int i);
+  // Rebuilds the face list of leaf i from owner_.
+  void BuildFaces(int i);
+  // Appends the faces of leaf i on one side to out.
+  void AddSideFaces(int i, int axis, float sign,
+                    std::vector<QuadtreeFace>& out) const;
+
+  int rows_;
+  int cols_;
+  int max_size_;
+  int num_leaves_;
+  std::vector<QuadtreeLeaf> leaves_;
+  std::vector<int> free_;
+  std::vector<int> owner_;
+  std::vector<std::vector<QuadtreeFace>> faces_;
+  std::vector<QuadtreeChange> splits_;
+  std::vector<QuadtreeChange> merges_;
+  // leaves whose faces the current Adapt() rebuilt, and a flag per slot
+  std::vector<int> rebuilt_;
+  std::vector<char> is_rebuilt_;
+};
+}  // namespace GLOO
+
+#endif
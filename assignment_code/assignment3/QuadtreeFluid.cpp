@@ -0,0 +1,369 @@
+#include "QuadtreeFluid.hpp"
+
+#include <cmath>
+
+namespace GLOO {
+QuadtreeFluid::QuadtreeFluid(const SimulationConfig& config)
+    : config(config),
+      cells_y(config.cells_y),
+      cells_x(config.cells_x),
+      tree(cells_y - 2, cells_x - 2, config.quadtree_levels),
+      pool(config.num_threads, config.pin_threads, config.grain_size),
+      steps_taken(0) {
+  for (LeafBuffer* buffer : {&U_y, &U_x, &S}) {
+    buffer->resize(tree.GetNumSlots());
+  }
+}
+
+void QuadtreeFluid::step() {
+  pressure_stats = SolverStats();
+  diffusion_stats = SolverStats();
+  if (steps_taken % std::max(1, config.quadtree_interval) == 0) {
+    adapt();
+  }
+  steps_taken++;
+  v_step();
+  s_step();
+}
+
+void QuadtreeFluid::add_to_leaf_at(std::vector<float>& field, int y, int x, float value) {
+    if (y > 0 && y < cells_y - 1 && x > 0 && x < cells_x - 1) {
+        const int i = tree.GetLeafAt(y - 1, x - 1);
+        const int size = tree.GetLeaves()[i].size;
+        field[i] += value / static_cast<float>(size * size);
+    }
+}
+
+void QuadtreeFluid::add_U_y_force_at(int y, int x, float force) {
+    add_to_leaf_at(U_y.front(), y, x, force);
+}
+
+void QuadtreeFluid::add_U_x_force_at(int y, int x, float force) {
+    add_to_leaf_at(U_x.front(), y, x, force);
+}
+
+void QuadtreeFluid::add_source_at(int y, int x, float source) {
+    add_to_leaf_at(S.front(), y, x, source);
+}
+
+float QuadtreeFluid::Uy_at(int y, int x) {
+    return cell_value<FreeSlipY>(U_y.front(), y, x);
+}
+
+float QuadtreeFluid::Ux_at(int y, int x) {
+    return cell_value<FreeSlipX>(U_x.front(), y, x);
+}
+
+float QuadtreeFluid::S_at(int y, int x) {
+    return cell_value<NeumannScalar>(S.front(), y, x);
+}
+
+void QuadtreeFluid::v_step() {
+  // diffuse
+  if (config.viscosity > 0.f) {
+    U_y.swap();
+    U_x.swap();
+    diffuse(U_y.front(), U_y.back(), config.viscosity);
+    diffuse(U_x.front(), U_x.back(), config.viscosity);
+  }
+  // pressure correction 1
+  project(U_y.front(), U_x.front());
+
+  // advect
+  U_y.swap();
+  U_x.swap();
+  advect(U_y.front(), U_y.back(), U_y.back(), U_x.back(), FieldKind::VelocityY);
+  advect(U_x.front(), U_x.back(), U_y.back(), U_x.back(), FieldKind::VelocityX);
+
+  // pressure correction 2
+  project(U_y.front(), U_x.front());
+}
+
+void QuadtreeFluid::s_step() {
+  // advect according to velocity field
+  S.swap();
+  advect(S.front(), S.back(), U_y.front(), U_x.front(), FieldKind::Scalar);
+
+  // diffuse
+  if (config.diffusion > 0.0f) {
+      S.swap();
+      diffuse(S.front(), S.back(), config.diffusion);
+  }
+
+  // dissipate
+  S.swap();
+  dissipate(S.front(), S.back());
+}
+
+// The indicators are face sums like the divergence in project(): the
+// circulation around the leaf and the density flux through its sides,
+// over its area. A wall face takes the leaf's own value.
+void QuadtreeFluid::adapt() {
+  const std::vector<float>& u_y = U_y.front();
+  const std::vector<float>& u_x = U_x.front();
+  const std::vector<float>& density = S.front();
+  leaf_action.resize(tree.GetNumSlots());
+  pool.ParallelFor(0, tree.GetNumSlots(), [&](int i0, int i1) {
+    for (int i = i0; i < i1; i++) {
+      const int size = tree.GetLeaves()[i].size;
+      if (size == 0) {
+        leaf_action[i] = 0;
+        continue;
+      }
+      float curl = 0.f;
+      float grad_y = 0.f;
+      float grad_x = 0.f;
+      for (const QuadtreeFace& face : tree.GetFaces(i)) {
+        const int j = face.neighbour >= 0 ? face.neighbour : i;
+        const float w = face.sign * face.length * 0.5f;
+        if (face.axis == 1) {
+          curl += w * (u_y[i] + u_y[j]);
+          grad_x += w * (density[i] + density[j]);
+        } else {
+          curl -= w * (u_x[i] + u_x[j]);
+          grad_y += w * (density[i] + density[j]);
+        }
+      }
+      const float area = static_cast<float>(size * size);
+      curl = std::fabs(curl) / area;
+      const float grad = std::sqrt(grad_y * grad_y + grad_x * grad_x) / area;
+      if (curl > config.refine_curl || grad > config.refine_density_gradient) {
+        leaf_action[i] = 1;
+      } else if (2.0f * curl < config.refine_curl && 2.0f * grad < config.refine_density_gradient) {
+        leaf_action[i] = -1;
+      } else {
+        leaf_action[i] = 0;
+      }
+    }
+  });
+  tree.Adapt(leaf_action);
+
+  // a merged leaf takes the mean of its four children, and split children
+  // their parent's value; the merges come first since a split may reuse a
+  // merged sibling's slot
+  for (LeafBuffer* buffer : {&U_y, &U_x, &S}) {
+    buffer->resize(tree.GetNumSlots());
+    std::vector<float>& field = buffer->front();
+    for (const QuadtreeChange& merge : tree.GetMerges()) {
+      const int* s = merge.siblings;
+      field[merge.leaf] = 0.25f * (field[merge.leaf] + field[s[0]] + field[s[1]] + field[s[2]]);
+    }
+    for (const QuadtreeChange& split : tree.GetSplits()) {
+      for (int j : split.siblings) {
+        field[j] = field[split.leaf];
+      }
+    }
+  }
+}
+
+void QuadtreeFluid::advect(std::vector<float>& S1, const std::vector<float>& S0,
+                           const std::vector<float>& U_y, const std::vector<float>& U_x,
+                           FieldKind kind) {
+  switch (kind) {
+    case FieldKind::VelocityY:
+      advect_leaves<FreeSlipY>(S1, S0, U_y, U_x);
+      break;
+    case FieldKind::VelocityX:
+      advect_leaves<FreeSlipX>(S1, S0, U_y, U_x);
+      break;
+    default:
+      advect_leaves<NeumannScalar>(S1, S0, U_y, U_x);
+      break;
+  }
+}
+
+// Each leaf traces its centre back; the sample blends the leaves around
+// the departure point.
+template <class Policy>
+void QuadtreeFluid::advect_leaves(std::vector<float>& S1, const std::vector<float>& S0,
+                                  const std::vector<float>& U_y, const std::vector<float>& U_x) {
+  const float y_max = static_cast<float>(cells_y) - 2.0f;
+  const float x_max = static_cast<float>(cells_x) - 2.0f;
+  pool.ParallelFor(0, tree.GetNumSlots(), [&](int i0, int i1) {
+    for (int i = i0; i < i1; i++) {
+      const QuadtreeLeaf& leaf = tree.GetLeaves()[i];
+      if (leaf.size == 0) {
+        continue;
+      }
+      const float half = 0.5f * static_cast<float>(leaf.size);
+      float py = static_cast<float>(leaf.y0 + 1) + half - config.dt * U_y[i];
+      float px = static_cast<float>(leaf.x0 + 1) + half - config.dt * U_x[i];
+      py = std::max(1.0f, std::min(y_max, py));
+      px = std::max(1.0f, std::min(x_max, px));
+      S1[i] = lin_interp<Policy>(py, px, S0);
+    }
+  });
+}
+
+void QuadtreeFluid::diffuse(std::vector<float>& S1, const std::vector<float>& S0, float diff) {
+  // the same scale as Fluid::diffuse
+  float a = config.dt * diff * cells_y * cells_x;
+  const int n = tree.GetNumSlots();
+  leaf_solution.assign(S0.begin(), S0.end());
+  leaf_rhs.resize(n);
+  for (int i = 0; i < n; i++) {
+    const int size = tree.GetLeaves()[i].size;
+    leaf_rhs[i] = static_cast<float>(size * size) * leaf_solution[i];
+  }
+  solve_leaves(1.0f, a, diffusion_stats);
+  S1.assign(leaf_solution.begin(), leaf_solution.end());
+}
+
+void QuadtreeFluid::project(std::vector<float>& U_y, std::vector<float>& U_x) {
+  const int n = tree.GetNumSlots();
+
+  // the negated outflow of each leaf; no flow crosses the walls
+  leaf_rhs.resize(n);
+  pool.ParallelFor(0, n, [&](int i0, int i1) {
+    for (int i = i0; i < i1; i++) {
+      float outflow = 0.f;
+      for (const QuadtreeFace& face : tree.GetFaces(i)) {
+        if (face.neighbour < 0) {
+          continue;
+        }
+        const std::vector<float>& u = face.axis == 0 ? U_y : U_x;
+        outflow += face.sign * face.length * 0.5f * (u[i] + u[face.neighbour]);
+      }
+      leaf_rhs[i] = -outflow;
+    }
+  });
+
+  leaf_solution.assign(n, 0.f);
+  solve_leaves(0.f, 1.0f, pressure_stats);
+
+  // subtract the pressure gradient, with the pressure mirrored at the walls
+  const std::vector<float>& p = leaf_solution;
+  pool.ParallelFor(0, n, [&](int i0, int i1) {
+    for (int i = i0; i < i1; i++) {
+      const int size = tree.GetLeaves()[i].size;
+      if (size == 0) {
+        continue;
+      }
+      float grad_y = 0.f;
+      float grad_x = 0.f;
+      for (const QuadtreeFace& face : tree.GetFaces(i)) {
+        const int j = face.neighbour >= 0 ? face.neighbour : i;
+        const float flux = face.sign * face.length * 0.5f * (p[i] + p[j]);
+        if (face.axis == 0) {
+          grad_y += flux;
+        } else {
+          grad_x += flux;
+        }
+      }
+      const float area = static_cast<float>(size * size);
+      U_y[i] -= grad_y / area;
+      U_x[i] -= grad_x / area;
+    }
+  });
+}
+
+void QuadtreeFluid::dissipate(std::vector<float>& S1, const std::vector<float>& S0) {
+  pool.ParallelFor(0, tree.GetNumSlots(), [&](int i0, int i1) {
+    for (int i = i0; i < i1; i++) {
+      S1[i] = S0[i] / (1.0f + config.dt * config.dissipation);
+    }
+  });
+}
+
+void QuadtreeFluid::apply_leaf_operator(const std::vector<float>& in, std::vector<float>& out,
+                                        float shift, float a) {
+  pool.ParallelFor(0, tree.GetNumSlots(), [&](int i0, int i1) {
+    for (int i = i0; i < i1; i++) {
+      const int size = tree.GetLeaves()[i].size;
+      float sum = 0.f;
+      for (const QuadtreeFace& face : tree.GetFaces(i)) {
+        if (face.neighbour >= 0) {
+          sum += face.coupling * (in[i] - in[face.neighbour]);
+        }
+      }
+      out[i] = shift * static_cast<float>(size * size) * in[i] + a * sum;
+    }
+  });
+}
+
+void QuadtreeFluid::solve_leaves(float shift, float a, SolverStats& stats) {
+  const int n = tree.GetNumSlots();
+  const std::vector<QuadtreeLeaf>& leaves = tree.GetLeaves();
+  std::vector<float>& x = leaf_solution;
+  std::vector<float>& b = leaf_rhs;
+  auto dot = [&](const std::vector<float>& u, const std::vector<float>& v) {
+    return pool.ParallelSum(0, n, [&](int i0, int i1) {
+      double sum = 0.0;
+      for (int i = i0; i < i1; i++) {
+        sum += static_cast<double>(u[i]) * v[i];
+      }
+      return sum;
+    });
+  };
+
+  if (shift == 0.f) {
+    // pure Neumann: the right-hand side must add up to zero
+    double total = 0.0;
+    double area = 0.0;
+    for (int i = 0; i < n; i++) {
+      total += b[i];
+      area += static_cast<double>(leaves[i].size) * leaves[i].size;
+    }
+    const float mean = static_cast<float>(total / area);
+    for (int i = 0; i < n; i++) {
+      b[i] -= mean * static_cast<float>(leaves[i].size * leaves[i].size);
+    }
+  }
+  const double b_norm = std::sqrt(dot(b, b));
+  if (b_norm == 0.0) {
+    std::fill(x.begin(), x.end(), 0.f);
+    return;
+  }
+
+  cg_r.resize(n);
+  cg_z.resize(n);
+  cg_p.resize(n);
+  cg_q.resize(n);
+  cg_inverse_diagonal.resize(n);
+  std::vector<float>& inverse_diagonal = cg_inverse_diagonal;
+  for (int i = 0; i < n; i++) {
+    float coupling = 0.f;
+    for (const QuadtreeFace& face : tree.GetFaces(i)) {
+      coupling += face.coupling;
+    }
+    const float diagonal = shift * static_cast<float>(leaves[i].size * leaves[i].size) + a * coupling;
+    inverse_diagonal[i] = diagonal > 0.f ? 1.0f / diagonal : 1.0f;
+  }
+
+  apply_leaf_operator(x, cg_q, shift, a);
+  for (int i = 0; i < n; i++) {
+    cg_r[i] = b[i] - cg_q[i];
+    cg_z[i] = inverse_diagonal[i] * cg_r[i];
+    cg_p[i] = cg_z[i];
+  }
+  double rz = dot(cg_r, cg_z);
+  int iterations = 0;
+  float residual;
+  while (true) {
+    residual = static_cast<float>(std::sqrt(dot(cg_r, cg_r)) / b_norm);
+    if (residual < config.solver_tolerance || iterations >= config.solver_max_iter) {
+      break;
+    }
+    apply_leaf_operator(cg_p, cg_q, shift, a);
+    const float alpha = static_cast<float>(rz / dot(cg_p, cg_q));
+    pool.ParallelFor(0, n, [&](int i0, int i1) {
+      for (int i = i0; i < i1; i++) {
+        x[i] += alpha * cg_p[i];
+        cg_r[i] -= alpha * cg_q[i];
+        cg_z[i] = inverse_diagonal[i] * cg_r[i];
+      }
+    });
+    const double rz_next = dot(cg_r, cg_z);
+    const float beta = static_cast<float>(rz_next / rz);
+    rz = rz_next;
+    pool.ParallelFor(0, n, [&](int i0, int i1) {
+      for (int i = i0; i < i1; i++) {
+        cg_p[i] = cg_z[i] + beta * cg_p[i];
+      }
+    });
+    iterations++;
+  }
+  stats.iterations += iterations;
+  stats.residual = std::max(stats.residual, residual);
+}
+}  // namespace GLOO
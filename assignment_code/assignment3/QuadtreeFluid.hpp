@@ -0,0 +1,195 @@
+#ifndef QUADTREE_FLUID_H_
+#define QUADTREE_FLUID_H_
+
+#include "gloo/SceneNode.hpp"
+#include "Parameters.hpp"
+#include "BoundaryConditions.hpp"
+#include "PoissonSolver.hpp"
+#include "Quadtree.hpp"
+#include "ThreadPool.hpp"
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+
+namespace GLOO {
+// One value per leaf slot of a Quadtree, double-buffered like DoubleBuffer;
+// front() holds the current state.
+class LeafBuffer {
+ public:
+  std::vector<float>& front() {
+    return *front_;
+  }
+
+  std::vector<float>& back() {
+    return *back_;
+  }
+
+  void swap() {
+    std::swap(front_, back_);
+  }
+
+  // New slots start at 0.
+  void resize(int slots) {
+    buffers_[0].resize(slots, 0.f);
+    buffers_[1].resize(slots, 0.f);
+  }
+
+ private:
+  std::vector<float> buffers_[2];
+  std::vector<float>* front_ = &buffers_[0];
+  std::vector<float>* back_ = &buffers_[1];
+};
+
+// Fluid on an adaptive quadtree, selected by config.quadtree_levels > 0.
+// The unknowns are the leaves of a Quadtree over the interior cells, from
+// single cells up to 2^quadtree_levels-cell blocks, and every field holds
+// one value per leaf. Every config.quadtree_interval steps, leaves whose
+// vorticity or density gradient exceeds refine_curl or
+// refine_density_gradient split, and quadruples of leaves below half of
+// both merge; a split copies the parent's values into its children and a
+// merge averages them.
+//
+// The step is the same as Fluid's, computed once per leaf:
+// - advection traces the leaf centre back along the leaf velocity and
+//   samples bilinearly between the cell centres around the departure
+//   point, each cell taking the value of the leaf that covers it and each
+//   ghost the free-slip policy of its field.
+// - divergence, gradient and vorticity are finite-volume sums over the
+//   leaf faces, with face values averaged from the two leaves; on a
+//   uniform tree they are Fluid's central differences.
+// - pressure and diffusion solve the finite-volume Laplacian of the leaves
+//   with Jacobi-preconditioned conjugate gradients, up to solver_tolerance
+//   and solver_max_iter; main.cpp rejects the other solver settings.
+// Only the collocated layout with free-slip walls and semi-Lagrangian
+// advection in float is supported. The only per-cell storage is the
+// tree's map from cells to leaves.
+class QuadtreeFluid : public SceneNode {
+private:
+  SimulationConfig config;
+
+  // grid dimensions, fixed at construction
+  const int cells_y;
+  const int cells_x;
+
+  // leaves over the interior cells, so leaf cell (y, x) is grid cell
+  // (y + 1, x + 1)
+  Quadtree tree;
+
+  // velocity and density per leaf
+  LeafBuffer U_y;
+  LeafBuffer U_x;
+  LeafBuffer S;
+
+  ThreadPool pool;
+
+  // split (> 0), keep or merge (< 0) per leaf, for Quadtree::Adapt
+  std::vector<signed char> leaf_action;
+  // right-hand side and solution of the current solve
+  std::vector<float> leaf_rhs;
+  std::vector<float> leaf_solution;
+  // conjugate gradient vectors
+  std::vector<float> cg_r;
+  std::vector<float> cg_z;
+  std::vector<float> cg_p;
+  std::vector<float> cg_q;
+  std::vector<float> cg_inverse_diagonal;
+
+  SolverStats pressure_stats;
+  SolverStats diffusion_stats;
+
+  int steps_taken;
+
+public:
+  explicit QuadtreeFluid(const SimulationConfig& config);
+
+  void step();
+
+  // setters; a force or source on a cell is spread over its leaf
+  void add_U_y_force_at(int y, int x, float force);
+  void add_U_x_force_at(int y, int x, float force);
+  void add_source_at(int y, int x, float source);
+
+  // getters, ghosts included
+  float Uy_at(int y, int x);
+  float Ux_at(int y, int x);
+  float S_at(int y, int x);
+
+  // see Fluid
+  const SolverStats& get_pressure_stats() const { return pressure_stats; }
+  const SolverStats& get_diffusion_stats() const { return diffusion_stats; }
+  int get_num_leaves() const { return tree.GetNumLeaves(); }
+
+  void v_step();
+  void s_step();
+
+  // Splits and merges leaves from the current state.
+  void adapt();
+
+  // Adds value, spread over the leaf, to the leaf covering grid cell (y, x).
+  void add_to_leaf_at(std::vector<float>& field, int y, int x, float value);
+
+  // Value of grid cell (y, x) of field: the value of its leaf, or for a
+  // ghost the one Policy (see BoundaryConditions.hpp) copies in from the
+  // interior.
+  template <class Policy>
+  float cell_value(const std::vector<float>& field, int y, int x) const {
+    const int inner_y = std::max(1, std::min(cells_y - 2, y));
+    const int inner_x = std::max(1, std::min(cells_x - 2, x));
+    const float value = field[tree.GetLeafAt(inner_y - 1, inner_x - 1)];
+    const bool end = inner_y != y;
+    const bool side = inner_x != x;
+    if (end && side) {
+      // a corner averages the two ghosts next to it
+      return 0.5f * static_cast<float>(Policy::kEnd + Policy::kSide) * value;
+    } else if (end) {
+      return static_cast<float>(Policy::kEnd) * value;
+    } else if (side) {
+      return static_cast<float>(Policy::kSide) * value;
+    }
+    return value;
+  }
+
+  // Bilinear sample at (y, x), in cell units, like Fluid::lin_interp.
+  template <class Policy>
+  float lin_interp(float y, float x, const std::vector<float>& field) const {
+    int yfloor = floor(y - 0.5f);
+    int xfloor = floor(x - 0.5f);
+
+    float ydiff = (y - 0.5f) - (float) yfloor;
+    float xdiff = (x - 0.5f) - (float) xfloor;
+
+    float tl = cell_value<Policy>(field, yfloor, xfloor);
+    float bl = cell_value<Policy>(field, yfloor + 1, xfloor);
+    float tr = cell_value<Policy>(field, yfloor, xfloor + 1);
+    float br = cell_value<Policy>(field, yfloor + 1, xfloor + 1);
+
+    float vl = (1.0f - ydiff) * tl + ydiff * bl;
+    float vr = (1.0f - ydiff) * tr + ydiff * br;
+
+    return (1.0f - xdiff) * vl + xdiff * vr;
+  }
+
+  void advect(std::vector<float>& S1, const std::vector<float>& S0, const std::vector<float>& U_y,
+              const std::vector<float>& U_x, FieldKind kind);
+  template <class Policy>
+  void advect_leaves(std::vector<float>& S1, const std::vector<float>& S0,
+                     const std::vector<float>& U_y, const std::vector<float>& U_x);
+  void diffuse(std::vector<float>& S1, const std::vector<float>& S0, float diff);
+  // In place.
+  void project(std::vector<float>& U_y, std::vector<float>& U_x);
+  void dissipate(std::vector<float>& S1, const std::vector<float>& S0);
+
+  // Solves
+  //   shift * area_i * x_i + a * sum over faces of coupling * (x_i - x_j) = b_i
+  // for leaf_solution from leaf_rhs, starting from leaf_solution. With
+  // shift 0 the mean of b is removed first. Free slots have no area and no
+  // faces, so they stay out of the solve.
+  void solve_leaves(float shift, float a, SolverStats& stats);
+  // out = the operator above applied to in.
+  void apply_leaf_operator(const std::vector<float>& in, std::vector<float>& out, float shift, float a);
+};
+}  // namespace GLOO
+
+#endif
@@ -0,0 +1,39 @@
+#include "Simd.hpp"
+
+namespace GLOO {
+SimdLevel DetectSimdLevel() {
+#ifdef GLOO_SIMD_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) {
+    return SimdLevel::Avx512;
+  }
+  if (__builtin_cpu_supports("avx2")) {
+    return SimdLevel::Avx2;
+  }
+  if (__builtin_cpu_supports("sse4.2")) {
+    return SimdLevel::Sse42;
+  }
+#endif
+  return SimdLevel::Scalar;
+}
+
+SimdLevel ClampSimdLevel(SimdLevel level) {
+  SimdLevel supported = DetectSimdLevel();
+  return static_cast<int>(level) > static_cast<int>(supported) ? supported
+                                                               : level;
+}
+
+const char* GetSimdLevelName(SimdLevel level) {
+  switch (level) {
+    case SimdLevel::Avx512:
+      return "avx512";
+    case SimdLevel::Avx2:
+      return "avx2";
+    case SimdLevel::Sse42:
+      return "sse4.2";
+    case SimdLevel::Scalar:
+      break;
+  }
+  return "scalar";
+}
+}  // namespace GLOO
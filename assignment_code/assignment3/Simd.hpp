@@ -0,0 +1,31 @@
+#ifndef SIMD_H_
+#define SIMD_H_
+
+// The vector kernels are compiled for their own instruction set with target
+// attributes, so the rest of the program keeps the default flags and the
+// fastest kernel is picked at run time. Other compilers and architectures
+// only get the scalar kernels.
+#if (defined(__GNUC__) || defined(__clang__)) && \
+    (defined(__x86_64__) || defined(__i386__))
+#define GLOO_SIMD_X86 1
+#endif
+
+namespace GLOO {
+// Instruction sets the vector kernels are compiled for, slowest first.
+enum class SimdLevel {
+  Scalar,
+  Sse42,
+  Avx2,
+  Avx512,
+};
+
+// The widest level this CPU and the compiler both support.
+SimdLevel DetectSimdLevel();
+
+// level, lowered to DetectSimdLevel() if the CPU lacks it.
+SimdLevel ClampSimdLevel(SimdLevel level);
+
+const char* GetSimdLevelName(SimdLevel level);
+}  // namespace GLOO
+
+#endif
@@ -15,53 +15,193 @@
 #include "gloo/debug/AxisNode.hpp"
 
 #include "Fluid.hpp"
+#include "Fluid3D.hpp"
+#include "QuadtreeFluid.hpp"
 #include "gloo/Image.hpp"
+#include <iostream>
 #include <string>
-#include "Parameters.hpp"
 
 
 
 namespace GLOO {
-SimulationApp::SimulationApp(const std::string& app_name,
-                             glm::ivec2 window_size)
-    : Application(app_name, window_size) {
+namespace {
+// Iterations of one kind of solve in step i.
+void PrintSolve(int i, const char* name, const SolverStats& stats) {
+  std::cout << "step " << i << ": " << name << " " << stats.iterations
+            << " iterations, residual " << stats.residual << std::endl;
+}
+
+// Iterations of the backends fluid, a Fluid or a Fluid3D, ran in its last
+// step; its Gauss-Seidel solves report nothing.
+template <class F>
+void PrintSolverStats(int i, const SimulationConfig& config, const F& fluid) {
+  if (fluid.has_pressure_solver()) {
+    PrintSolve(i, "pressure", fluid.get_pressure_stats());
+  }
+  if (fluid.has_diffusion_solver() && (config.viscosity > 0.f || config.diffusion > 0.f)) {
+    PrintSolve(i, "diffusion", fluid.get_diffusion_stats());
+  }
+}
+
+// The 2D setup below on a volume; the frames show the density averaged
+// along z.
+void RunVolume(const SimulationConfig& config) {
+  auto fluid = make_unique<Fluid3D>(config);
+  float add_amount = 0.3f * fmax(config.cells_x, config.cells_y);
+  for (int z = 0; z < config.cells_z; z++) {
+    for (int y = 0; y < config.cells_y; y++) {
+      for (int x = 0; x < config.cells_x; x++) {
+        fluid->add_U_y_force_at(z, y, x, 10.f * 20);
+        fluid->add_U_x_force_at(z, y, x, 10.f * 20);
+        fluid->add_source_at(z, y, x, add_amount);
+      }
+    }
+  }
+
+  for (int i = 0; i < 24; i++) {
+    fluid->step();
+    PrintSolverStats(i, config, *fluid);
+    Image image(config.cells_x, config.cells_y);
+    for (int y = 0; y < config.cells_y; y++) {
+      for (int x = 0; x < config.cells_x; x++) {
+        image.SetPixel(x, y, glm::vec3(fluid->S_projected_at(y, x)));
+      }
+    }
+    image.SavePNG("frame"+ std::to_string(i) + ".png");
+  }
+}
+
+// The 2D setup below on an adaptive quadtree.
+void RunQuadtree(const SimulationConfig& config) {
+  auto fluid = make_unique<QuadtreeFluid>(config);
+  float add_amount = 0.3f * fmax(config.cells_x, config.cells_y);
+  for (int y = 0; y < config.cells_y; y++) {
+    for (int x = 0; x < config.cells_x; x++) {
+      fluid->add_U_y_force_at(y, x, 10.f * 20);
+      fluid->add_U_x_force_at(y, x, 10.f * 20);
+      fluid->add_source_at(y, x, add_amount);
+    }
+  }
+
+  for (int i = 0; i < 24; i++) {
+    fluid->step();
+    // the leaves are always solved with conjugate gradients
+    PrintSolve(i, "pressure", fluid->get_pressure_stats());
+    if (config.viscosity > 0.f || config.diffusion > 0.f) {
+      PrintSolve(i, "diffusion", fluid->get_diffusion_stats());
+    }
+    std::cout << "step " << i << ": " << fluid->get_num_leaves() << " leaves for "
+              << (config.cells_y - 2) * (config.cells_x - 2) << " cells" << std::endl;
+    Image image(config.cells_x, config.cells_y);
+    for (int y = 0; y < config.cells_y; y++) {
+      for (int x = 0; x < config.cells_x; x++) {
+        image.SetPixel(x, y, glm::vec3(fluid->S_at(y, x)));
+      }
+    }
+    image.SavePNG("frame"+ std::to_string(i) + ".png");
+  }
+}
+
+// The 2D scene, in the configured precision.
+template <typename Real>
+void RunPlanar(const SimulationConfig& config) {
   // TODO: use integrator type and step to create integrators;
   // the lines below exist only to suppress compiler warnings.
 
   // SceneNode& root = scene_->GetRootNode();
-  auto fluid = make_unique<Fluid>();
+  auto fluid = make_unique<BasicFluid<Real>>(config);
   // root.AddChild(std::move(fluid));
 
-  float add_amount = 0.3f * fmax(CELLS_X, CELLS_Y); //ADD_AMT_INIT=0.3f
+  float add_amount = 0.3f * fmax(config.cells_x, config.cells_y); //ADD_AMT_INIT=0.3f
   float cr = 0.f;
   float cg = 0.f;
   float cb = 0.f;
 
+  // dye in three vertical bands, red to blue, and a warm layer at the
+  // bottom, when those channels are configured
+  const int dye[3] = {fluid->find_channel("dye_r"), fluid->find_channel("dye_g"),
+                      fluid->find_channel("dye_b")};
+  const bool has_dye = dye[0] >= 0 && dye[1] >= 0 && dye[2] >= 0;
+  const int temperature = fluid->find_channel("temperature");
+
   //TODO: NOT WORKING (add vector field/forces)
-  for (int y=0; y<CELLS_Y; y++){
-    for (int x=0; x<CELLS_X; x++){
+  for (int y=0; y<config.cells_y; y++){
+    for (int x=0; x<config.cells_x; x++){
       fluid->add_U_y_force_at(y, x, 10.f * 20); // FORCE_SCALE = 10.f
       fluid->add_U_x_force_at(y, x, 10.f * 20);
       fluid->add_source_at(y, x, add_amount);
+      if (has_dye) {
+        fluid->add_channel_at(dye[std::min(2, 3 * x / config.cells_x)], y, x, add_amount);
+      }
+      if (temperature >= 0 && y < config.cells_y / 4) {
+        fluid->add_channel_at(temperature, y, x, 10.f);
+      }
     }
   }
 
   //TODO: making 24 images and saving them
   for (int i=0; i<24; i++){
     fluid->step();
-    Image image(CELLS_X, CELLS_Y);
-    for (size_t y = 0; y < CELLS_Y; y++) {
-      for (size_t x = 0; x < CELLS_X; x++) {
+    PrintSolverStats(i, config, *fluid);
+    if (fluid->get_num_tiles() > 0) {
+      std::cout << "step " << i << ": " << fluid->get_active_tiles() << " of "
+                << fluid->get_num_tiles() << " tiles active" << std::endl;
+    }
+    if (config.task_graph) {
+      const TaskGraphReport& report = fluid->get_step_report();
+      std::cout << "step " << i << ": critical path " << report.critical_path_ms
+                << " ms of " << report.wall_ms << " ms wall, work "
+                << report.work_ms << " ms:";
+      const char* separator = " ";
+      for (const std::string& name : report.critical_path) {
+        std::cout << separator << name;
+        separator = ", ";
+      }
+      std::cout << std::endl;
+    }
+    Image image(config.cells_x, config.cells_y);
+    for (int y = 0; y < config.cells_y; y++) {
+      for (int x = 0; x < config.cells_x; x++) {
         cr = fluid->S_at(y, x);
         cg = fluid->S_at(y, x);
         cb = fluid->S_at(y, x);
+        if (has_dye) {
+          cr = fluid->channel_at(dye[0], y, x);
+          cg = fluid->channel_at(dye[1], y, x);
+          cb = fluid->channel_at(dye[2], y, x);
+        }
         glm::vec3 mycolor{cr, cg, cb};
-        image.SetPixel(y, x, mycolor);
+        if (fluid->is_solid_at(y, x)) {
+          // obstacles in blue
+          mycolor = glm::vec3(0.1f, 0.2f, 0.5f);
+        }
+        image.SetPixel(x, y, mycolor);
       }
     }
     image.SavePNG("frame"+ std::to_string(i) + ".png");
   }
 }
+}  // namespace
+
+SimulationApp::SimulationApp(const std::string& app_name,
+                             glm::ivec2 window_size,
+                             const SimulationConfig& config)
+    : Application(app_name, window_size) {
+  if (config.cells_z > 1) {
+    RunVolume(config);
+    return;
+  }
+  if (config.quadtree_levels > 0) {
+    RunQuadtree(config);
+    return;
+  }
+
+  if (config.precision == Precision::Double) {
+    RunPlanar<double>(config);
+  } else {
+    RunPlanar<float>(config);
+  }
+}
 
 void SimulationApp::SetupScene() {
   SceneNode& root = scene_->GetRootNode();
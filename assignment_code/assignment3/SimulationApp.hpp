@@ -2,13 +2,15 @@
 #define SIMULATION_APP_H_
 
 #include "gloo/Application.hpp"
+#include "Parameters.hpp"
 
 
 namespace GLOO {
 class SimulationApp : public Application {
  public:
   SimulationApp(const std::string& app_name,
-                glm::ivec2 window_size);
+                glm::ivec2 window_size,
+                const SimulationConfig& config = SimulationConfig());
   void SetupScene() override;
 
  // private:
@@ -0,0 +1,109 @@
+#include "Spectral.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace GLOO {
+namespace {
+// Edge of the square blocks used by the transpose.
+const int kTransposeBlock = 32;
+
+template <typename Real>
+std::vector<Real> SecondDifferenceEigenvalues(int n) {
+  std::vector<Real> lambda(n);
+  for (int k = 0; k < n; k++) {
+    lambda[k] = static_cast<Real>(
+        2.0 - 2.0 * std::cos(3.14159265358979323846 * k / n));
+  }
+  return lambda;
+}
+}  // namespace
+
+template <typename Real>
+SpectralSolver<Real>::SpectralSolver(const SimulationConfig& config,
+                                     ThreadPool& pool)
+    : pool_(pool),
+      ny_(config.cells_y - 2),
+      nx_(config.cells_x - 2),
+      stride_(config.cells_x),
+      row_plan_(nx_),
+      column_plan_(ny_),
+      lambda_y_(SecondDifferenceEigenvalues<Real>(ny_)),
+      lambda_x_(SecondDifferenceEigenvalues<Real>(nx_)),
+      rows_(ny_ * nx_, 0.f),
+      columns_(ny_ * nx_, 0.f) {
+  for (int i = 0; i < pool_.GetNumThreads(); i++) {
+    row_work_.push_back(row_plan_.MakeWorkspace());
+    column_work_.push_back(column_plan_.MakeWorkspace());
+  }
+}
+
+template <typename Real>
+void SpectralSolver<Real>::Solve(BasicField2D<Real>& x,
+                                 const BasicField2D<Real>& rhs, Real a,
+                                 Real c) {
+  const Real shift = c - 4.0f * a;
+  const Real* b = rhs.data();
+  Real* out = x.data();
+
+  // forward transform along x, straight out of the right-hand side
+  pool_.ParallelForChunks(0, ny_, [&](int chunk, int y0, int y1) {
+    for (int y = y0; y < y1; y++) {
+      row_plan_.Forward(b + (y + 1) * stride_ + 1, &rows_[y * nx_],
+                        row_work_[chunk]);
+    }
+  });
+  Transpose(rows_.data(), columns_.data(), ny_, nx_);
+
+  // forward along y, divide by the eigenvalues, and back along y
+  pool_.ParallelForChunks(0, nx_, [&](int chunk, int kx0, int kx1) {
+    for (int kx = kx0; kx < kx1; kx++) {
+      Real* column = &columns_[kx * ny_];
+      column_plan_.Forward(column, column, column_work_[chunk]);
+      for (int ky = 0; ky < ny_; ky++) {
+        Real eigenvalue = shift + a * (lambda_y_[ky] + lambda_x_[kx]);
+        // the constant mode of a pure Neumann problem is left at zero
+        column[ky] = eigenvalue == 0.f ? 0.f : column[ky] / eigenvalue;
+      }
+      column_plan_.Inverse(column, column, column_work_[chunk]);
+    }
+  });
+  Transpose(columns_.data(), rows_.data(), nx_, ny_);
+
+  // back along x, straight into the solution
+  pool_.ParallelForChunks(0, ny_, [&](int chunk, int y0, int y1) {
+    for (int y = y0; y < y1; y++) {
+      row_plan_.Inverse(&rows_[y * nx_], out + (y + 1) * stride_ + 1,
+                        row_work_[chunk]);
+    }
+  });
+  FillNeumannBoundary(out, ny_ + 2, nx_ + 2);
+
+  // a direct solve: one pass, no residual left beyond rounding
+  this->stats_.iterations = 1;
+  this->stats_.residual = 0.f;
+}
+
+template <typename Real>
+void SpectralSolver<Real>::Transpose(const Real* src, Real* dst, int rows,
+                                     int cols) {
+  int row_blocks = (rows + kTransposeBlock - 1) / kTransposeBlock;
+  pool_.ParallelFor(0, row_blocks, [&](int rb0, int rb1) {
+    for (int r0 = rb0 * kTransposeBlock;
+         r0 < std::min(rb1 * kTransposeBlock, rows); r0 += kTransposeBlock) {
+      int r1 = std::min(r0 + kTransposeBlock, rows);
+      for (int c0 = 0; c0 < cols; c0 += kTransposeBlock) {
+        int c1 = std::min(c0 + kTransposeBlock, cols);
+        for (int r = r0; r < r1; r++) {
+          for (int col = c0; col < c1; col++) {
+            dst[col * rows + r] = src[r * cols + col];
+          }
+        }
+      }
+    }
+  });
+}
+
+template class SpectralSolver<float>;
+template class SpectralSolver<double>;
+}  // namespace GLOO
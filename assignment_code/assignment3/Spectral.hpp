@@ -0,0 +1,44 @@
+#ifndef SPECTRAL_H_
+#define SPECTRAL_H_
+
+#include "PoissonSolver.hpp"
+#include "Dct.hpp"
+#include <vector>
+
+namespace GLOO {
+// Direct solver for obstacle-free boxes. The cosine basis diagonalizes the
+// 5-point operator with Neumann walls, so a solve is a 2D DCT-II, a division
+// by the operator's eigenvalues and the inverse DCT: exact up to rounding,
+// in O(N log N). Rows of each pass are transformed in parallel; the columns
+// are transformed as rows of a transposed copy.
+template <typename Real>
+class SpectralSolver : public BasicPoissonSolver<Real> {
+ public:
+  SpectralSolver(const SimulationConfig& config, ThreadPool& pool);
+
+  void Solve(BasicField2D<Real>& x, const BasicField2D<Real>& rhs, Real a,
+             Real c) override;
+
+ private:
+  // dst (cols x rows) = transpose of src (rows x cols)
+  void Transpose(const Real* src, Real* dst, int rows, int cols);
+
+  ThreadPool& pool_;
+  int ny_;
+  int nx_;
+  int stride_;
+  DctPlan<Real> row_plan_;
+  DctPlan<Real> column_plan_;
+  // one workspace per pool thread and plan
+  std::vector<typename DctPlan<Real>::Workspace> row_work_;
+  std::vector<typename DctPlan<Real>::Workspace> column_work_;
+  // eigenvalues of the 1D second difference, 2 - 2 cos(pi k / n)
+  std::vector<Real> lambda_y_;
+  std::vector<Real> lambda_x_;
+  // ny x nx, then nx x ny after the transpose
+  std::vector<Real> rows_;
+  std::vector<Real> columns_;
+};
+}  // namespace GLOO
+
+#endif
@@ -0,0 +1,169 @@
+#include "TaskGraph.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+
+namespace GLOO {
+namespace {
+double NowMs() {
+  using namespace std::chrono;
+  return duration<double, std::milli>(
+             steady_clock::now().time_since_epoch()).count();
+}
+}  // namespace
+
+int TaskGraph::AddTask(const std::string& name, Kind kind,
+                       const std::function<void()>& work) {
+  Task task;
+  task.name = name;
+  task.kind = kind;
+  task.work = work;
+  tasks_.push_back(task);
+  return static_cast<int>(tasks_.size()) - 1;
+}
+
+void TaskGraph::AddDependency(int before, int after) {
+  tasks_[before].successors.push_back(after);
+  tasks_[after].num_dependencies++;
+}
+
+void TaskGraph::Run(ThreadPool& pool) {
+  if (pool.InsideTask()) {
+    // every loop of the tasks would run inline on this thread, and a
+    // task waiting on a Barrier of the pool would never return
+    throw std::logic_error("TaskGraph::Run called from a task of its pool");
+  }
+  const int n = GetNumTasks();
+  waiting_for_.reset(new std::atomic<int>[n]);
+  ready_serial_.clear();
+  ready_parallel_.clear();
+  in_flight_ = 0;
+  for (int i = 0; i < n; i++) {
+    waiting_for_[i] = tasks_[i].num_dependencies;
+    if (tasks_[i].num_dependencies == 0) {
+      (tasks_[i].kind == Kind::Serial ? ready_serial_ : ready_parallel_)
+          .push_back(i);
+    }
+  }
+
+  start_ = NowMs();
+  while (!ready_serial_.empty() || !ready_parallel_.empty()) {
+    if (!ready_serial_.empty()) {
+      RunSerialTasks(pool);
+    }
+    // Parallel tasks only run while no serial task does, so that they
+    // have the whole pool.
+    while (!ready_parallel_.empty() && ready_serial_.empty()) {
+      int task = ready_parallel_.back();
+      ready_parallel_.pop_back();
+      Execute(task);
+    }
+  }
+  for (int i = 0; i < n; i++) {
+    if (waiting_for_[i] != 0) {
+      throw std::runtime_error("TaskGraph has a dependency cycle at " +
+                               tasks_[i].name);
+    }
+  }
+  BuildReport();
+}
+
+void TaskGraph::RunSerialTasks(ThreadPool& pool) {
+  pool.RunOnAll([&](int) {
+    std::unique_lock<std::mutex> lock(ready_mutex_);
+    while (true) {
+      if (!ready_serial_.empty()) {
+        int task = ready_serial_.back();
+        ready_serial_.pop_back();
+        in_flight_++;
+        lock.unlock();
+        Execute(task);
+        lock.lock();
+        if (--in_flight_ == 0) {
+          // the sleepers may have nothing left to wait for
+          ready_cv_.notify_all();
+        }
+      } else if (in_flight_ == 0) {
+        return;
+      } else {
+        // a running task may still release more work
+        ready_cv_.wait(lock);
+      }
+    }
+  });
+}
+
+void TaskGraph::Execute(int task) {
+  Task& t = tasks_[task];
+  t.start_ms = NowMs() - start_;
+  t.work();
+  t.end_ms = NowMs() - start_;
+  int released_serial = 0;
+  for (int next : t.successors) {
+    if (waiting_for_[next].fetch_sub(1) == 1) {
+      std::lock_guard<std::mutex> lock(ready_mutex_);
+      if (tasks_[next].kind == Kind::Serial) {
+        ready_serial_.push_back(next);
+        released_serial++;
+      } else {
+        ready_parallel_.push_back(next);
+      }
+    }
+  }
+  if (released_serial > 1) {
+    ready_cv_.notify_all();
+  } else if (released_serial == 1) {
+    ready_cv_.notify_one();
+  }
+}
+
+void TaskGraph::BuildReport() {
+  const int n = GetNumTasks();
+  // Tasks only start after their dependencies end, so sorting by start
+  // time gives a topological order.
+  std::vector<int> order(n);
+  for (int i = 0; i < n; i++) {
+    order[i] = i;
+  }
+  std::sort(order.begin(), order.end(), [&](int a, int b) {
+    if (tasks_[a].start_ms != tasks_[b].start_ms) {
+      return tasks_[a].start_ms < tasks_[b].start_ms;
+    }
+    if (tasks_[a].end_ms != tasks_[b].end_ms) {
+      return tasks_[a].end_ms < tasks_[b].end_ms;
+    }
+    return a < b;
+  });
+
+  // Longest chain ending at each task, and the task before it on the
+  // chain. Before a task is visited, finish holds its longest incoming
+  // chain.
+  std::vector<double> finish(n, 0.0);
+  std::vector<int> previous(n, -1);
+  report_ = TaskGraphReport();
+  int last = -1;
+  for (int task : order) {
+    const double duration = tasks_[task].end_ms - tasks_[task].start_ms;
+    finish[task] += duration;
+    report_.work_ms += duration;
+    report_.wall_ms = std::max(report_.wall_ms, tasks_[task].end_ms);
+    if (last < 0 || finish[task] > finish[last]) {
+      last = task;
+    }
+    for (int next : tasks_[task].successors) {
+      if (previous[next] < 0 || finish[task] > finish[next]) {
+        finish[next] = finish[task];
+        previous[next] = task;
+      }
+    }
+  }
+  if (last >= 0) {
+    report_.critical_path_ms = finish[last];
+  }
+  for (int task = last; task >= 0; task = previous[task]) {
+    report_.critical_path.push_back(tasks_[task].name);
+  }
+  std::reverse(report_.critical_path.begin(), report_.critical_path.end());
+}
+}  // namespace GLOO
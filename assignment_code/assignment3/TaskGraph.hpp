@@ -0,0 +1,91 @@
+#ifndef TASK_GRAPH_H_
+#define TASK_GRAPH_H_
+
+#include "ThreadPool.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace GLOO {
+// Timing of one TaskGraph::Run.
+struct TaskGraphReport {
+  // time from start to finish
+  double wall_ms = 0.0;
+  // sum of the task durations
+  double work_ms = 0.0;
+  // longest chain of dependent tasks, by measured duration: no schedule on
+  // any number of threads finishes sooner
+  double critical_path_ms = 0.0;
+  // the tasks on that chain, first to last
+  std::vector<std::string> critical_path;
+};
+
+// A dependency graph of tasks, run on a ThreadPool. Serial tasks run one
+// per pool thread, next to each other, as soon as their dependencies are
+// done; any parallel loop they start runs inline. Parallel tasks run one
+// at a time on the calling thread with the whole pool at their disposal,
+// for work such as a global linear solve.
+class TaskGraph {
+ public:
+  enum class Kind {
+    Serial,
+    Parallel,
+  };
+
+  // Returns the id of the new task.
+  int AddTask(const std::string& name, Kind kind,
+              const std::function<void()>& work);
+  // after does not start before before is done.
+  void AddDependency(int before, int after);
+
+  int GetNumTasks() const {
+    return static_cast<int>(tasks_.size());
+  }
+
+  // Runs every task once and fills in the report. May be called again to
+  // rerun the same tasks. Throws std::logic_error when called from a task
+  // of pool.
+  void Run(ThreadPool& pool);
+
+  const TaskGraphReport& GetLastReport() const {
+    return report_;
+  }
+
+ private:
+  struct Task {
+    std::string name;
+    Kind kind;
+    std::function<void()> work;
+    std::vector<int> successors;
+    int num_dependencies = 0;
+    double start_ms = 0.0;
+    double end_ms = 0.0;
+  };
+
+  // Runs ready serial tasks on every pool thread until none are left or
+  // running. A thread with nothing to run sleeps on ready_cv_ until a
+  // task releases more work or the last running one ends.
+  void RunSerialTasks(ThreadPool& pool);
+  // Runs task and releases its successors.
+  void Execute(int task);
+  void BuildReport();
+
+  std::vector<Task> tasks_;
+
+  // state of the current Run
+  std::unique_ptr<std::atomic<int>[]> waiting_for_;
+  std::mutex ready_mutex_;
+  std::condition_variable ready_cv_;
+  std::vector<int> ready_serial_;
+  std::vector<int> ready_parallel_;
+  int in_flight_;
+  double start_;
+
+  TaskGraphReport report_;
+};
+}  // namespace GLOO
+
+#endif
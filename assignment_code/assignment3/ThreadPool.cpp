@@ -0,0 +1,233 @@
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace GLOO {
+namespace {
+// With the default grain, each thread starts with about this many tasks,
+// which leaves room for stealing without making the tasks tiny.
+const int kTasksPerThread = 4;
+
+// The pool whose task the current thread is running, and its index there.
+thread_local const ThreadPool* current_pool = nullptr;
+thread_local int current_thread = 0;
+
+void PinToCore(std::thread::native_handle_type handle, int core) {
+#ifdef __linux__
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  CPU_SET(core, &cpus);
+  pthread_setaffinity_np(handle, sizeof(cpus), &cpus);
+#else
+  (void)handle;
+  (void)core;
+#endif
+}
+}  // namespace
+
+ThreadPool::ThreadPool(int num_threads, bool pin_threads, int grain_size)
+    : num_threads_(num_threads),
+      grain_size_(std::max(grain_size, 0)),
+      task_(nullptr),
+      generation_(0),
+      pending_(0),
+      stop_(false) {
+  const int cores = static_cast<int>(std::thread::hardware_concurrency());
+  if (num_threads_ <= 0) {
+    num_threads_ = cores;
+  }
+  if (num_threads_ <= 0) {
+    num_threads_ = 1;
+  }
+  deques_.reset(new TaskDeque[num_threads_]);
+  partial_sums_.assign(num_threads_, 0.0);
+  // thread 0 is the calling thread
+  for (int i = 1; i < num_threads_; i++) {
+    workers_.emplace_back(&ThreadPool::WorkerLoop, this, i);
+  }
+  // the calling thread belongs to the application, so only the workers
+  // are pinned; core 0 is left to it
+  if (pin_threads && cores > 0) {
+    for (int i = 1; i < num_threads_; i++) {
+      PinToCore(workers_[i - 1].native_handle(), i % cores);
+    }
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  start_cv_.notify_all();
+  for (auto& worker : workers_) {
+    worker.join();
+  }
+}
+
+void ThreadPool::ParallelFor(int begin, int end,
+                             const std::function<void(int, int)>& body,
+                             int grain) {
+  ParallelForChunks(begin, end, [&](int, int task_begin, int task_end) {
+    body(task_begin, task_end);
+  }, grain);
+}
+
+void ThreadPool::ParallelForChunks(
+    int begin, int end, const std::function<void(int, int, int)>& body,
+    int grain) {
+  const int n = end - begin;
+  if (n <= 0) {
+    return;
+  }
+  if (InsideTask()) {
+    body(current_thread, begin, end);
+    return;
+  }
+  if (grain <= 0) {
+    grain = grain_size_;
+  }
+  if (grain <= 0) {
+    grain = std::max(1, n / (num_threads_ * kTasksPerThread));
+  }
+  const int tasks = (n + grain - 1) / grain;
+  if (tasks == 1 || num_threads_ == 1) {
+    body(0, begin, end);
+    return;
+  }
+
+  // contiguous starting shares, like a static schedule
+  for (int i = 0; i < num_threads_; i++) {
+    TaskDeque& deque = deques_[i];
+    std::lock_guard<std::mutex> lock(deque.mutex);
+    deque.front = static_cast<int>((long long)tasks * i / num_threads_);
+    deque.back = static_cast<int>((long long)tasks * (i + 1) / num_threads_);
+  }
+  std::function<void(int)> run = [&](int thread) {
+    for (int task = NextTask(thread); task >= 0; task = NextTask(thread)) {
+      int task_begin = begin + task * grain;
+      body(thread, task_begin, std::min(end, task_begin + grain));
+    }
+  };
+  RunOnAll(run);
+}
+
+int ThreadPool::NextTask(int thread) {
+  TaskDeque& own = deques_[thread];
+  {
+    std::lock_guard<std::mutex> lock(own.mutex);
+    if (own.front < own.back) {
+      return own.front++;
+    }
+  }
+  for (int i = 1; i < num_threads_; i++) {
+    TaskDeque& victim = deques_[(thread + i) % num_threads_];
+    int stolen_front;
+    int stolen_back;
+    {
+      std::lock_guard<std::mutex> lock(victim.mutex);
+      int left = victim.back - victim.front;
+      if (left <= 0) {
+        continue;
+      }
+      stolen_back = victim.back;
+      stolen_front = victim.back - (left + 1) / 2;
+      victim.back = stolen_front;
+    }
+    // run the first stolen task now and queue the rest where others can
+    // steal them in turn
+    std::lock_guard<std::mutex> lock(own.mutex);
+    own.front = stolen_front + 1;
+    own.back = stolen_back;
+    return stolen_front;
+  }
+  return -1;
+}
+
+double ThreadPool::ParallelSum(int begin, int end,
+                               const std::function<double(int, int)>& body) {
+  const int n = end - begin;
+  if (n <= 0) {
+    return 0.0;
+  }
+  if (InsideTask()) {
+    return body(begin, end);
+  }
+  const int chunks = num_threads_;
+  std::function<void(int)> task = [&](int chunk) {
+    int chunk_begin = begin + static_cast<int>((long long)n * chunk / chunks);
+    int chunk_end = begin + static_cast<int>((long long)n * (chunk + 1) / chunks);
+    partial_sums_[chunk] =
+        chunk_begin < chunk_end ? body(chunk_begin, chunk_end) : 0.0;
+  };
+  RunOnAll(task);
+  double sum = 0.0;
+  for (int i = 0; i < chunks; i++) {
+    sum += partial_sums_[i];
+  }
+  return sum;
+}
+
+bool ThreadPool::InsideTask() const {
+  return current_pool == this;
+}
+
+void ThreadPool::RunOnAll(const std::function<void(int)>& task) {
+  if (InsideTask()) {
+    for (int i = 0; i < num_threads_; i++) {
+      task(i);
+    }
+    return;
+  }
+  current_pool = this;
+  current_thread = 0;
+  if (workers_.empty()) {
+    task(0);
+    current_pool = nullptr;
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    task_ = &task;
+    pending_ = static_cast<int>(workers_.size());
+    generation_++;
+  }
+  start_cv_.notify_all();
+  task(0);
+  current_pool = nullptr;
+  std::unique_lock<std::mutex> lock(mutex_);
+  done_cv_.wait(lock, [this] { return pending_ == 0; });
+  task_ = nullptr;
+}
+
+void ThreadPool::WorkerLoop(int thread) {
+  current_pool = this;
+  current_thread = thread;
+  unsigned seen = 0;
+  while (true) {
+    const std::function<void(int)>* task;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      start_cv_.wait(lock, [&] { return stop_ || generation_ != seen; });
+      if (stop_) {
+        return;
+      }
+      seen = generation_;
+      task = task_;
+    }
+    (*task)(thread);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      pending_--;
+      if (pending_ == 0) {
+        done_cv_.notify_one();
+      }
+    }
+  }
+}
+}  // namespace GLOO
@@ -0,0 +1,132 @@
+#ifndef THREAD_POOL_H_
+#define THREAD_POOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace GLOO {
+// Persistent worker threads for data-parallel grid loops. The threads are
+// created once and sleep between calls; the calling thread takes part in
+// every loop as thread 0.
+//
+// Parallel loops are split into tasks of a few rows. Every thread starts
+// on its own contiguous share of the tasks, kept in a per-thread deque
+// that it takes from the front; a thread that runs out steals the back
+// half of another thread's deque. Uneven rows (clamped back-traces,
+// obstacle cells, a core busy with the window) are balanced without
+// giving up locality in the common case.
+class ThreadPool {
+ public:
+  // num_threads <= 0 uses one thread per hardware core. pin_threads binds
+  // worker thread i to core i where the platform allows it; the calling
+  // thread keeps its affinity. grain_size is the
+  // default number of rows per task; 0 picks one from the loop size.
+  explicit ThreadPool(int num_threads, bool pin_threads = false,
+                      int grain_size = 0);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  int GetNumThreads() const {
+    return num_threads_;
+  }
+
+  // Runs body(task_begin, task_end) over tasks covering [begin, end) and
+  // returns when all are done. grain is the number of rows per task;
+  // 0 uses the pool's default. Loops with a single task run inline on the
+  // calling thread without waking the workers.
+  void ParallelFor(int begin, int end,
+                   const std::function<void(int, int)>& body, int grain = 0);
+
+  // Like ParallelFor, and also passes the index of the thread running the
+  // task, in [0, GetNumThreads()), so tasks can use per-thread scratch
+  // space. A thread may run several tasks.
+  void ParallelForChunks(int begin, int end,
+                         const std::function<void(int, int, int)>& body,
+                         int grain = 0);
+
+  // Splits [begin, end) into one contiguous chunk per thread and adds up
+  // the values returned by the chunks. The chunks are fixed and summed in
+  // order, so the result only depends on the thread count.
+  double ParallelSum(int begin, int end,
+                     const std::function<double(int, int)>& body);
+
+  // Runs task(thread) once on each pool thread, thread in
+  // [0, GetNumThreads()), all at the same time. The tasks may synchronize
+  // with a Barrier of GetNumThreads() threads.
+  void RunOnAll(const std::function<void(int)>& task);
+
+  // True on a pool thread while it runs a task of this pool. Loops started
+  // from inside a task run inline on that thread: ParallelFor and
+  // ParallelSum as a single task, RunOnAll one thread index after the
+  // other, so nested RunOnAll tasks must not wait on a Barrier.
+  bool InsideTask() const;
+
+ private:
+  // Task indices [front, back) still queued on one thread. Padded so that
+  // neighbouring deques do not share a cache line.
+  struct TaskDeque {
+    std::mutex mutex;
+    int front = 0;
+    int back = 0;
+    char padding[64];
+  };
+
+  void WorkerLoop(int thread);
+  // Takes a task from thread's own deque, or steals some. Returns -1 when
+  // every deque is empty.
+  int NextTask(int thread);
+
+  int num_threads_;
+  int grain_size_;
+  std::vector<std::thread> workers_;
+  std::mutex mutex_;
+  std::condition_variable start_cv_;
+  std::condition_variable done_cv_;
+  const std::function<void(int)>* task_;
+  unsigned generation_;
+  int pending_;
+  bool stop_;
+  std::unique_ptr<TaskDeque[]> deques_;
+  std::vector<double> partial_sums_;
+};
+
+// Reusable barrier for the tasks of one RunOnAll call. The phases it
+// separates are short, so waiting threads spin for a while before they
+// start yielding.
+class Barrier {
+ public:
+  explicit Barrier(int count) : count_(count), waiting_(0), generation_(0) {
+  }
+
+  void Wait() {
+    const unsigned generation = generation_.load(std::memory_order_acquire);
+    if (waiting_.fetch_add(1, std::memory_order_acq_rel) + 1 == count_) {
+      waiting_.store(0, std::memory_order_relaxed);
+      generation_.fetch_add(1, std::memory_order_acq_rel);
+      return;
+    }
+    int spins = 0;
+    while (generation_.load(std::memory_order_acquire) == generation) {
+      if (++spins > kSpinsBeforeYield) {
+        std::this_thread::yield();
+      }
+    }
+  }
+
+ private:
+  static const int kSpinsBeforeYield = 1000;
+
+  const int count_;
+  std::atomic<int> waiting_;
+  std::atomic<unsigned> generation_;
+};
+}  // namespace GLOO
+
+#endif
@@ -0,0 +1,99 @@
+#include "TileMap.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace GLOO {
+TileMap::TileMap(int cells_y, int cells_x, int tile_size)
+    : cells_y_(cells_y),
+      cells_x_(cells_x),
+      tile_size_(tile_size),
+      tiles_y_((cells_y + tile_size - 1) / tile_size),
+      tiles_x_((cells_x + tile_size - 1) / tile_size),
+      flags_(static_cast<size_t>(tiles_y_) * tiles_x_, 0) {
+}
+
+void TileMap::Touch(int y, int x) {
+  int tile = (y / tile_size_) * tiles_x_ + x / tile_size_;
+  if ((flags_[tile] & (kActive | kTouched)) == 0) {
+    flags_[tile] |= kTouched;
+    touched_.push_back(tile);
+  }
+}
+
+template <typename T>
+void TileMap::Update(ThreadPool& pool, const BasicField2D<T>* const* fields,
+                     int count, float threshold, int dilation) {
+  // Inactive tiles are kept at zero, so only these can hold a value.
+  std::vector<int> candidates(active_);
+  candidates.insert(candidates.end(), touched_.begin(), touched_.end());
+  for (int tile : touched_) {
+    flags_[tile] &= ~kTouched;
+  }
+  touched_.clear();
+
+  std::vector<unsigned char> occupied(candidates.size(), 0);
+  pool.ParallelFor(0, static_cast<int>(candidates.size()), [&](int t0, int t1) {
+    for (int t = t0; t < t1; t++) {
+      TileBounds b = GetBounds(candidates[t]);
+      for (int f = 0; f < count && !occupied[t]; f++) {
+        const BasicField2D<T>& field = *fields[f];
+        for (int y = b.y0; y < b.y1 && !occupied[t]; y++) {
+          for (int x = b.x0; x < b.x1; x++) {
+            if (std::fabs(field[y * cells_x_ + x]) > threshold) {
+              occupied[t] = 1;
+              break;
+            }
+          }
+        }
+      }
+    }
+  }, 1);
+
+  std::vector<int> next;
+  for (size_t t = 0; t < candidates.size(); t++) {
+    if (!occupied[t]) {
+      continue;
+    }
+    const int ty = candidates[t] / tiles_x_;
+    const int tx = candidates[t] % tiles_x_;
+    for (int y = std::max(0, ty - dilation); y <= std::min(tiles_y_ - 1, ty + dilation); y++) {
+      for (int x = std::max(0, tx - dilation); x <= std::min(tiles_x_ - 1, tx + dilation); x++) {
+        int tile = y * tiles_x_ + x;
+        if ((flags_[tile] & kNext) == 0) {
+          flags_[tile] |= kNext;
+          next.push_back(tile);
+        }
+      }
+    }
+  }
+  std::sort(next.begin(), next.end());
+
+  deactivated_.clear();
+  for (int tile : active_) {
+    if ((flags_[tile] & kNext) == 0) {
+      deactivated_.push_back(tile);
+    }
+    flags_[tile] &= ~kActive;
+  }
+  for (int tile : next) {
+    flags_[tile] = (flags_[tile] & ~kNext) | kActive;
+  }
+  active_.swap(next);
+}
+
+template void TileMap::Update<float>(ThreadPool&, const Field2D* const*, int,
+                                     float, int);
+template void TileMap::Update<double>(ThreadPool&,
+                                      const BasicField2D<double>* const*,
+                                      int, float, int);
+
+TileBounds TileMap::GetBounds(int tile) const {
+  TileBounds bounds;
+  bounds.y0 = (tile / tiles_x_) * tile_size_;
+  bounds.y1 = std::min(bounds.y0 + tile_size_, cells_y_);
+  bounds.x0 = (tile % tiles_x_) * tile_size_;
+  bounds.x1 = std::min(bounds.x0 + tile_size_, cells_x_);
+  return bounds;
+}
+}  // namespace GLOO
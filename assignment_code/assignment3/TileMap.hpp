@@ -0,0 +1,81 @@
+#ifndef TILE_MAP_H_
+#define TILE_MAP_H_
+
+#include "Field2D.hpp"
+#include "ThreadPool.hpp"
+#include <vector>
+
+namespace GLOO {
+// Cells [y0, y1) x [x0, x1) of one tile.
+struct TileBounds {
+  int y0;
+  int y1;
+  int x0;
+  int x1;
+};
+
+// Occupancy of a grid split into tile_size x tile_size tiles, for Fluid's
+// block-sparse mode. The tiles cover the whole grid, boundary ring
+// included; the last row and column of tiles may be smaller.
+//
+// A tile is active while one of its cells holds a value above the
+// threshold, or while it lies within `dilation` tiles of such a tile, so
+// that smoke moving out of a tile finds its neighbours already active.
+// Update() only scans the active tiles and the ones marked with Touch(),
+// so its cost follows the active area; the bitmap itself is one byte per
+// tile.
+class TileMap {
+ public:
+  TileMap(int cells_y, int cells_x, int tile_size);
+
+  TileMap(const TileMap&) = delete;
+  TileMap& operator=(const TileMap&) = delete;
+
+  // Marks the tile of cell (y, x) for the next Update(), after a value
+  // was written into it from outside.
+  void Touch(int y, int x);
+
+  // Recomputes the active tiles from count fields. The tiles that were
+  // active before and no longer are can then be read from
+  // GetDeactivated(). Instantiated for float and double fields.
+  template <typename T>
+  void Update(ThreadPool& pool, const BasicField2D<T>* const* fields,
+              int count, float threshold, int dilation);
+
+  // Active tiles in row-major order.
+  const std::vector<int>& GetActive() const {
+    return active_;
+  }
+
+  const std::vector<int>& GetDeactivated() const {
+    return deactivated_;
+  }
+
+  int GetNumTiles() const {
+    return tiles_y_ * tiles_x_;
+  }
+
+  bool IsActive(int tile) const {
+    return (flags_[tile] & kActive) != 0;
+  }
+
+  TileBounds GetBounds(int tile) const;
+
+ private:
+  static const unsigned char kActive = 1;
+  static const unsigned char kTouched = 2;
+  static const unsigned char kNext = 4;
+
+  int cells_y_;
+  int cells_x_;
+  int tile_size_;
+  int tiles_y_;
+  int tiles_x_;
+  std::vector<unsigned char> flags_;
+  std::vector<int> active_;
+  std::vector<int> touched_;
+  std::vector<int> deactivated_;
+};
+}  // namespace GLOO
+
+#endif
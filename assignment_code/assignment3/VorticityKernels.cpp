@@ -0,0 +1,190 @@
+#include "VorticityKernels.hpp"
+
+#include <cmath>
+
+#ifdef GLOO_SIMD_X86
+#include <immintrin.h>
+#endif
+
+namespace GLOO {
+namespace {
+// keeps k finite where the curl is flat
+const float kTiny = 1e-6f;
+
+template <typename Real>
+void ConfineRowScalar(const Real* up, const Real* curl, const Real* down,
+                      const Real* u_y, const Real* u_x, Real* out_y,
+                      Real* out_x, int n, Real scale) {
+  for (int i = 0; i < n; i++) {
+    Real gx = (std::fabs(curl[i + 1]) - std::fabs(curl[i - 1])) * Real(0.5);
+    Real gy = (std::fabs(down[i]) - std::fabs(up[i])) * Real(0.5);
+    Real k = scale * curl[i] / (std::sqrt(gx * gx + gy * gy) + Real(kTiny));
+    out_y[i] = u_y[i] - k * gx;
+    out_x[i] = u_x[i] + k * gy;
+  }
+}
+
+#ifdef GLOO_SIMD_X86
+// All lanes of the masked AVX-512 square roots, which take an explicit
+// zero source where the unmasked ones trip -Wmaybe-uninitialized (see
+// AdvectionKernels.cpp).
+const __mmask16 kAll16 = 0xFFFF;
+const __mmask8 kAll8 = 0xFF;
+
+// Finishes cells [i, n) inside a vector kernel, inlined for the same
+// reason as JacobiRowTail.
+template <typename Real>
+__attribute__((always_inline)) inline void ConfineRowTail(
+    const Real* up, const Real* curl, const Real* down, const Real* u_y,
+    const Real* u_x, Real* out_y, Real* out_x, int i, int n, Real scale) {
+  for (; i < n; i++) {
+    Real gx = (std::fabs(curl[i + 1]) - std::fabs(curl[i - 1])) * Real(0.5);
+    Real gy = (std::fabs(down[i]) - std::fabs(up[i])) * Real(0.5);
+    Real k = scale * curl[i] / (std::sqrt(gx * gx + gy * gy) + Real(kTiny));
+    out_y[i] = u_y[i] - k * gx;
+    out_x[i] = u_x[i] + k * gy;
+  }
+}
+
+// |x| clears the sign bit with andnot(-0.0, x).
+__attribute__((target("avx2"))) void ConfineRowAvx2(
+    const float* up, const float* curl, const float* down, const float* u_y,
+    const float* u_x, float* out_y, float* out_x, int n, float scale) {
+  const __m256 sign = _mm256_set1_ps(-0.0f);
+  const __m256 half = _mm256_set1_ps(0.5f);
+  const __m256 tiny = _mm256_set1_ps(kTiny);
+  const __m256 vscale = _mm256_set1_ps(scale);
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256 gx = _mm256_mul_ps(
+        _mm256_sub_ps(_mm256_andnot_ps(sign, _mm256_loadu_ps(curl + i + 1)),
+                      _mm256_andnot_ps(sign, _mm256_loadu_ps(curl + i - 1))),
+        half);
+    __m256 gy = _mm256_mul_ps(
+        _mm256_sub_ps(_mm256_andnot_ps(sign, _mm256_loadu_ps(down + i)),
+                      _mm256_andnot_ps(sign, _mm256_loadu_ps(up + i))),
+        half);
+    __m256 norm = _mm256_add_ps(
+        _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(gx, gx), _mm256_mul_ps(gy, gy))), tiny);
+    __m256 k = _mm256_div_ps(_mm256_mul_ps(vscale, _mm256_loadu_ps(curl + i)), norm);
+    _mm256_storeu_ps(out_y + i, _mm256_sub_ps(_mm256_loadu_ps(u_y + i), _mm256_mul_ps(k, gx)));
+    _mm256_storeu_ps(out_x + i, _mm256_add_ps(_mm256_loadu_ps(u_x + i), _mm256_mul_ps(k, gy)));
+  }
+  ConfineRowTail(up, curl, down, u_y, u_x, out_y, out_x, i, n, scale);
+}
+
+__attribute__((target("avx512f"))) void ConfineRowAvx512(
+    const float* up, const float* curl, const float* down, const float* u_y,
+    const float* u_x, float* out_y, float* out_x, int n, float scale) {
+  const __m512 half = _mm512_set1_ps(0.5f);
+  const __m512 tiny = _mm512_set1_ps(kTiny);
+  const __m512 vscale = _mm512_set1_ps(scale);
+  int i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m512 gx = _mm512_mul_ps(
+        _mm512_sub_ps(_mm512_abs_ps(_mm512_loadu_ps(curl + i + 1)),
+                      _mm512_abs_ps(_mm512_loadu_ps(curl + i - 1))),
+        half);
+    __m512 gy = _mm512_mul_ps(
+        _mm512_sub_ps(_mm512_abs_ps(_mm512_loadu_ps(down + i)),
+                      _mm512_abs_ps(_mm512_loadu_ps(up + i))),
+        half);
+    __m512 norm = _mm512_add_ps(
+        _mm512_maskz_sqrt_ps(kAll16,
+                             _mm512_add_ps(_mm512_mul_ps(gx, gx), _mm512_mul_ps(gy, gy))),
+        tiny);
+    __m512 k = _mm512_div_ps(_mm512_mul_ps(vscale, _mm512_loadu_ps(curl + i)), norm);
+    _mm512_storeu_ps(out_y + i, _mm512_sub_ps(_mm512_loadu_ps(u_y + i), _mm512_mul_ps(k, gx)));
+    _mm512_storeu_ps(out_x + i, _mm512_add_ps(_mm512_loadu_ps(u_x + i), _mm512_mul_ps(k, gy)));
+  }
+  ConfineRowTail(up, curl, down, u_y, u_x, out_y, out_x, i, n, scale);
+}
+
+__attribute__((target("avx2"))) void ConfineRowAvx2(
+    const double* up, const double* curl, const double* down, const double* u_y,
+    const double* u_x, double* out_y, double* out_x, int n, double scale) {
+  const __m256d sign = _mm256_set1_pd(-0.0);
+  const __m256d half = _mm256_set1_pd(0.5);
+  const __m256d tiny = _mm256_set1_pd(kTiny);
+  const __m256d vscale = _mm256_set1_pd(scale);
+  int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m256d gx = _mm256_mul_pd(
+        _mm256_sub_pd(_mm256_andnot_pd(sign, _mm256_loadu_pd(curl + i + 1)),
+                      _mm256_andnot_pd(sign, _mm256_loadu_pd(curl + i - 1))),
+        half);
+    __m256d gy = _mm256_mul_pd(
+        _mm256_sub_pd(_mm256_andnot_pd(sign, _mm256_loadu_pd(down + i)),
+                      _mm256_andnot_pd(sign, _mm256_loadu_pd(up + i))),
+        half);
+    __m256d norm = _mm256_add_pd(
+        _mm256_sqrt_pd(_mm256_add_pd(_mm256_mul_pd(gx, gx), _mm256_mul_pd(gy, gy))), tiny);
+    __m256d k = _mm256_div_pd(_mm256_mul_pd(vscale, _mm256_loadu_pd(curl + i)), norm);
+    _mm256_storeu_pd(out_y + i, _mm256_sub_pd(_mm256_loadu_pd(u_y + i), _mm256_mul_pd(k, gx)));
+    _mm256_storeu_pd(out_x + i, _mm256_add_pd(_mm256_loadu_pd(u_x + i), _mm256_mul_pd(k, gy)));
+  }
+  ConfineRowTail(up, curl, down, u_y, u_x, out_y, out_x, i, n, scale);
+}
+
+__attribute__((target("avx512f"))) void ConfineRowAvx512(
+    const double* up, const double* curl, const double* down, const double* u_y,
+    const double* u_x, double* out_y, double* out_x, int n, double scale) {
+  const __m512d half = _mm512_set1_pd(0.5);
+  const __m512d tiny = _mm512_set1_pd(kTiny);
+  const __m512d vscale = _mm512_set1_pd(scale);
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m512d gx = _mm512_mul_pd(
+        _mm512_sub_pd(_mm512_abs_pd(_mm512_loadu_pd(curl + i + 1)),
+                      _mm512_abs_pd(_mm512_loadu_pd(curl + i - 1))),
+        half);
+    __m512d gy = _mm512_mul_pd(
+        _mm512_sub_pd(_mm512_abs_pd(_mm512_loadu_pd(down + i)),
+                      _mm512_abs_pd(_mm512_loadu_pd(up + i))),
+        half);
+    __m512d norm = _mm512_add_pd(
+        _mm512_maskz_sqrt_pd(kAll8,
+                             _mm512_add_pd(_mm512_mul_pd(gx, gx), _mm512_mul_pd(gy, gy))),
+        tiny);
+    __m512d k = _mm512_div_pd(_mm512_mul_pd(vscale, _mm512_loadu_pd(curl + i)), norm);
+    _mm512_storeu_pd(out_y + i, _mm512_sub_pd(_mm512_loadu_pd(u_y + i), _mm512_mul_pd(k, gx)));
+    _mm512_storeu_pd(out_x + i, _mm512_add_pd(_mm512_loadu_pd(u_x + i), _mm512_mul_pd(k, gy)));
+  }
+  ConfineRowTail(up, curl, down, u_y, u_x, out_y, out_x, i, n, scale);
+}
+#endif
+}  // namespace
+
+// Like the cubic advection kernels there is no SSE version.
+template <>
+ConfineRowKernel GetConfineRowKernel<float>(SimdLevel level) {
+#ifdef GLOO_SIMD_X86
+  switch (ClampSimdLevel(level)) {
+    case SimdLevel::Avx512:
+      return ConfineRowAvx512;
+    case SimdLevel::Avx2:
+      return ConfineRowAvx2;
+    case SimdLevel::Sse42:
+    case SimdLevel::Scalar:
+      break;
+  }
+#endif
+  return ConfineRowScalar<float>;
+}
+
+template <>
+BasicConfineRowKernel<double> GetConfineRowKernel<double>(SimdLevel level) {
+#ifdef GLOO_SIMD_X86
+  switch (ClampSimdLevel(level)) {
+    case SimdLevel::Avx512:
+      return ConfineRowAvx512;
+    case SimdLevel::Avx2:
+      return ConfineRowAvx2;
+    case SimdLevel::Sse42:
+    case SimdLevel::Scalar:
+      break;
+  }
+#endif
+  return ConfineRowScalar<double>;
+}
+}  // namespace GLOO
@@ -0,0 +1,35 @@
+#ifndef VORTICITY_KERNELS_H_
+#define VORTICITY_KERNELS_H_
+
+#include "Simd.hpp"
+
+namespace GLOO {
+// Vorticity confinement on n cells of a row, given the curl w of the row
+// and of the rows above (up) and below (down):
+//
+//   g = (|w[i+1]| - |w[i-1]|, |down[i]| - |up[i]|) / 2   (x, y)
+//   k = scale * w[i] / (|g| + tiny)
+//   out_x[i] = u_x[i] + k * g.y
+//   out_y[i] = u_y[i] - k * g.x
+//
+// which is u + dt * epsilon * (N x w) with N = g / |g| when scale is
+// dt * epsilon. curl[-1] and curl[n] must be readable. The outputs must
+// not alias any input.
+template <typename Real>
+using BasicConfineRowKernel = void (*)(const Real* up, const Real* curl,
+                                       const Real* down, const Real* u_y,
+                                       const Real* u_x, Real* out_y,
+                                       Real* out_x, int n, Real scale);
+typedef BasicConfineRowKernel<float> ConfineRowKernel;
+
+// The kernel for level, or for the widest supported level below it, for
+// float or double rows.
+template <typename Real>
+BasicConfineRowKernel<Real> GetConfineRowKernel(SimdLevel level);
+template <>
+ConfineRowKernel GetConfineRowKernel<float>(SimdLevel level);
+template <>
+BasicConfineRowKernel<double> GetConfineRowKernel<double>(SimdLevel level);
+}  // namespace GLOO
+
+#endif
@@ -1,17 +1,334 @@
 #include <iostream>
 #include <chrono>
 #include <string>
+#include <vector>
 #include <cstdio>
 #include <stdexcept>
 
 #include "SimulationApp.hpp"
+#include "Benchmark.hpp"
+#include "Fluid.hpp"
+#include "Fluid3D.hpp"
 
 using namespace GLOO;
 
+// Usage: assignment3 [--cells N] [--cells-z N] [--cells-y N] [--cells-x N]
+//                    [--pressure gauss-seidel|jacobi|multigrid|pcg|spectral]
+//                    [--diffusion gauss-seidel|jacobi|multigrid|pcg|spectral]
+//                    [--gs-order lexicographic|red-black] [--tolerance T]
+//                    [--max-iter N] [--jacobi-weight W]
+//                    [--jacobi-tile N] [--jacobi-time-block N] [--cycle v|w]
+//                    [--preconditioner jacobi|ic|mic] [--threads N]
+//                    [--pin-threads on|off] [--grain N]
+//                    [--fused-advection on|off] [--task-graph on|off]
+//                    [--graph-tiles N] [--sparse-tile N]
+//                    [--sparse-threshold T] [--sparse-dilation N]
+//                    [--quadtree-levels N] [--quadtree-interval N]
+//                    [--refine-curl T] [--refine-gradient T]
+//                    [--velocity-advection semi-lagrangian|maccormack|bfecc]
+//                    [--density-advection semi-lagrangian|maccormack|bfecc]
+//                    [--sampler bilinear|cubic]
+//                    [--velocity-layout collocated|mac]
+//                    [--walls free-slip|no-slip|periodic]
+//                    [--vorticity EPSILON]
+//                    [--channels dye,temperature,fuel]
+//                    [--obstacles FILE.png]
+//                    [--density-storage float32|float16|bfloat16]
+//                    [--precision float|double]
+//                    [--benchmark advection|storage|precision]
+//
+// --benchmark runs the named benchmark at the given settings and exits
+// without opening a window. --channels takes any of the listed scalars,
+// comma separated; dye adds one channel per colour.
+LinearSolverType ParseSolverType(const std::string& value) {
+  if (value == "gauss-seidel") {
+    return LinearSolverType::GaussSeidel;
+  } else if (value == "jacobi") {
+    return LinearSolverType::Jacobi;
+  } else if (value == "multigrid") {
+    return LinearSolverType::Multigrid;
+  } else if (value == "pcg") {
+    return LinearSolverType::ConjugateGradient;
+  } else if (value == "spectral") {
+    return LinearSolverType::Spectral;
+  }
+  throw std::runtime_error("Unknown linear solver " + value);
+}
+
+AdvectionScheme ParseAdvectionScheme(const std::string& value) {
+  if (value == "semi-lagrangian") {
+    return AdvectionScheme::SemiLagrangian;
+  } else if (value == "maccormack") {
+    return AdvectionScheme::MacCormack;
+  } else if (value == "bfecc") {
+    return AdvectionScheme::Bfecc;
+  }
+  throw std::runtime_error("Unknown advection scheme " + value);
+}
+
+// The value of an on|off switch.
+bool ParseSwitch(const std::string& arg, const std::string& value) {
+  if (value == "on") {
+    return true;
+  } else if (value == "off") {
+    return false;
+  }
+  throw std::runtime_error("Expected on or off for " + arg + ", got " + value);
+}
+
+// The value of a count argument, which must not be negative.
+int ParseCount(const std::string& arg, const std::string& value) {
+  const int count = std::stoi(value);
+  if (count < 0) {
+    throw std::runtime_error("Expected a count of at least 0 for " + arg + ", got " + value);
+  }
+  return count;
+}
+
+// The scalar channels of --channels, appended to channels.
+void ParseChannels(const std::string& value, std::vector<ScalarChannel>& channels) {
+  size_t start = 0;
+  while (start <= value.size()) {
+    size_t end = value.find(',', start);
+    if (end == std::string::npos) {
+      end = value.size();
+    }
+    const std::string name = value.substr(start, end - start);
+    if (name == "dye") {
+      channels.emplace_back("dye_r", 0.f, 0.02f);
+      channels.emplace_back("dye_g", 0.f, 0.02f);
+      channels.emplace_back("dye_b", 0.f, 0.02f);
+    } else if (name == "temperature") {
+      // cools towards the ambient 0 and rises while warmer
+      channels.emplace_back("temperature", 0.f, 0.1f, 1.f);
+    } else if (name == "fuel") {
+      channels.emplace_back("fuel", 0.f, 0.02f);
+    } else {
+      throw std::runtime_error("Unknown channel " + name);
+    }
+    start = end + 1;
+  }
+}
+
+SimulationConfig ParseArguments(int argc, char** argv, std::string& benchmark) {
+  SimulationConfig config;
+  // the default order is lexicographic, which the volumetric mode lacks
+  bool sweep_order_given = false;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (i + 1 >= argc) {
+      throw std::runtime_error("Missing value for argument " + arg);
+    }
+    std::string value = argv[++i];
+    if (arg == "--cells") {
+      config.cells_y = std::stoi(value);
+      config.cells_x = std::stoi(value);
+    } else if (arg == "--cells-z") {
+      config.cells_z = std::stoi(value);
+    } else if (arg == "--cells-y") {
+      config.cells_y = std::stoi(value);
+    } else if (arg == "--cells-x") {
+      config.cells_x = std::stoi(value);
+    } else if (arg == "--pressure") {
+      config.pressure_solver = ParseSolverType(value);
+    } else if (arg == "--diffusion") {
+      config.diffusion_solver = ParseSolverType(value);
+    } else if (arg == "--gs-order") {
+      sweep_order_given = true;
+      if (value == "lexicographic") {
+        config.gauss_seidel_order = SweepOrder::Lexicographic;
+      } else if (value == "red-black") {
+        config.gauss_seidel_order = SweepOrder::RedBlack;
+      } else {
+        throw std::runtime_error("Unknown sweep order " + value);
+      }
+    } else if (arg == "--tolerance") {
+      config.solver_tolerance = std::stof(value);
+    } else if (arg == "--max-iter") {
+      config.solver_max_iter = std::stoi(value);
+    } else if (arg == "--jacobi-weight") {
+      config.jacobi_weight = std::stof(value);
+      // 0 never moves the guess and weights above 1 diverge
+      if (!(config.jacobi_weight > 0.f && config.jacobi_weight <= 1.f)) {
+        throw std::runtime_error("--jacobi-weight must be in (0, 1], got " + value);
+      }
+    } else if (arg == "--jacobi-tile") {
+      config.jacobi_tile_size = std::stoi(value);
+    } else if (arg == "--jacobi-time-block") {
+      config.jacobi_time_block = std::stoi(value);
+    } else if (arg == "--cycle") {
+      if (value == "v") {
+        config.multigrid_cycle = MultigridCycle::V;
+      } else if (value == "w") {
+        config.multigrid_cycle = MultigridCycle::W;
+      } else {
+        throw std::runtime_error("Unknown cycle " + value);
+      }
+    } else if (arg == "--preconditioner") {
+      if (value == "jacobi") {
+        config.pcg_preconditioner = Preconditioner::Jacobi;
+      } else if (value == "ic") {
+        config.pcg_preconditioner = Preconditioner::IncompleteCholesky;
+      } else if (value == "mic") {
+        config.pcg_preconditioner = Preconditioner::ModifiedIncompleteCholesky;
+      } else {
+        throw std::runtime_error("Unknown preconditioner " + value);
+      }
+    } else if (arg == "--threads") {
+      config.num_threads = std::stoi(value);
+    } else if (arg == "--pin-threads") {
+      config.pin_threads = ParseSwitch(arg, value);
+    } else if (arg == "--grain") {
+      config.grain_size = ParseCount(arg, value);
+    } else if (arg == "--fused-advection") {
+      config.fused_advection = ParseSwitch(arg, value);
+    } else if (arg == "--task-graph") {
+      config.task_graph = ParseSwitch(arg, value);
+    } else if (arg == "--graph-tiles") {
+      config.graph_tiles = ParseCount(arg, value);
+    } else if (arg == "--sparse-tile") {
+      config.sparse_tile_size = std::stoi(value);
+    } else if (arg == "--sparse-threshold") {
+      config.sparse_threshold = std::stof(value);
+    } else if (arg == "--sparse-dilation") {
+      config.sparse_dilation = ParseCount(arg, value);
+    } else if (arg == "--quadtree-levels") {
+      config.quadtree_levels = std::stoi(value);
+    } else if (arg == "--quadtree-interval") {
+      config.quadtree_interval = std::stoi(value);
+    } else if (arg == "--refine-curl") {
+      config.refine_curl = std::stof(value);
+    } else if (arg == "--refine-gradient") {
+      config.refine_density_gradient = std::stof(value);
+    } else if (arg == "--velocity-advection") {
+      config.velocity_advection = ParseAdvectionScheme(value);
+    } else if (arg == "--density-advection") {
+      config.density_advection = ParseAdvectionScheme(value);
+    } else if (arg == "--benchmark") {
+      benchmark = value;
+    } else if (arg == "--velocity-layout") {
+      if (value == "collocated") {
+        config.velocity_layout = VelocityLayout::Collocated;
+      } else if (value == "mac") {
+        config.velocity_layout = VelocityLayout::Staggered;
+      } else {
+        throw std::runtime_error("Unknown velocity layout " + value);
+      }
+    } else if (arg == "--walls") {
+      if (value == "free-slip") {
+        config.walls = WallCondition::FreeSlip;
+      } else if (value == "no-slip") {
+        config.walls = WallCondition::NoSlip;
+      } else if (value == "periodic") {
+        config.walls = WallCondition::Periodic;
+      } else {
+        throw std::runtime_error("Unknown walls " + value);
+      }
+    } else if (arg == "--vorticity") {
+      config.vorticity_confinement = std::stof(value);
+    } else if (arg == "--channels") {
+      ParseChannels(value, config.scalar_channels);
+    } else if (arg == "--obstacles") {
+      config.obstacle_image = value;
+    } else if (arg == "--sampler") {
+      if (value == "bilinear") {
+        config.advection_sampler = AdvectionSampler::Bilinear;
+      } else if (value == "cubic") {
+        config.advection_sampler = AdvectionSampler::Cubic;
+      } else {
+        throw std::runtime_error("Unknown sampler " + value);
+      }
+    } else if (arg == "--density-storage") {
+      if (value == "float32") {
+        config.density_storage = ScalarStorage::Float32;
+      } else if (value == "float16") {
+        config.density_storage = ScalarStorage::Float16;
+      } else if (value == "bfloat16") {
+        config.density_storage = ScalarStorage::BFloat16;
+      } else {
+        throw std::runtime_error("Unknown storage " + value);
+      }
+    } else if (arg == "--precision") {
+      if (value == "float") {
+        config.precision = Precision::Float;
+      } else if (value == "double") {
+        config.precision = Precision::Double;
+      } else {
+        throw std::runtime_error("Unknown precision " + value);
+      }
+    } else {
+      throw std::runtime_error("Unknown argument " + arg);
+    }
+  }
+  if (config.cells_y < 3 || config.cells_x < 3) {
+    throw std::runtime_error("The grid needs at least 3 cells per side.");
+  }
+  if (config.cells_z < 1 || config.cells_z == 2) {
+    throw std::runtime_error("--cells-z must be 1 (2D) or at least 3.");
+  }
+  if (config.quadtree_levels > 0 && config.cells_z > 1) {
+    throw std::runtime_error("The quadtree mode is 2D only.");
+  }
+  if (config.cells_z > 1) {
+    CheckFluid3DConfig(config);
+    // the default order is lexicographic, so only an explicit one is wrong
+    if (sweep_order_given && config.gauss_seidel_order != SweepOrder::RedBlack) {
+      throw std::runtime_error("The volumetric Gauss-Seidel solver only sweeps red-black.");
+    }
+  } else if (config.quadtree_levels > 0) {
+    // QuadtreeFluid solves its leaves with its own conjugate gradients and
+    // otherwise runs the same plain step as Fluid3D.
+    if (config.pressure_solver != LinearSolverType::GaussSeidel ||
+        config.diffusion_solver != LinearSolverType::GaussSeidel || sweep_order_given) {
+      throw std::runtime_error("The quadtree mode has its own leaf solver; drop --pressure, "
+                               "--diffusion and --gs-order.");
+    }
+    if (config.velocity_layout != VelocityLayout::Collocated || config.fused_advection ||
+        config.task_graph) {
+      throw std::runtime_error("The quadtree mode needs the collocated layout, unfused "
+                               "advection and the sequential step.");
+    }
+    if (config.velocity_advection != AdvectionScheme::SemiLagrangian ||
+        config.density_advection != AdvectionScheme::SemiLagrangian ||
+        config.advection_sampler != AdvectionSampler::Bilinear) {
+      throw std::runtime_error("The quadtree mode advects semi-Lagrangian with the bilinear sampler.");
+    }
+    if (config.walls != WallCondition::FreeSlip) {
+      throw std::runtime_error("The quadtree mode has free-slip walls only.");
+    }
+    if (config.sparse_tile_size > 0 || config.density_storage != ScalarStorage::Float32 ||
+        config.precision != Precision::Float) {
+      throw std::runtime_error("The quadtree mode runs dense and in float.");
+    }
+    if (!config.obstacle_image.empty() || !config.scalar_channels.empty() ||
+        config.vorticity_confinement > 0.f) {
+      throw std::runtime_error("The quadtree mode has no obstacles, scalar channels or vorticity "
+                               "confinement.");
+    }
+  } else {
+    CheckFluidConfig(config, !config.obstacle_image.empty());
+  }
+  return config;
+}
+
 int main(int argc, char** argv) {
+  std::string benchmark;
+  SimulationConfig config = ParseArguments(argc, argv, benchmark);
+  if (benchmark == "advection") {
+    RunAdvectionBenchmark(config, std::cout);
+    return 0;
+  } else if (benchmark == "storage") {
+    RunStorageBenchmark(config, std::cout);
+    return 0;
+  } else if (benchmark == "precision") {
+    RunPrecisionBenchmark(config, std::cout);
+    return 0;
+  } else if (!benchmark.empty()) {
+    throw std::runtime_error("Unknown benchmark " + benchmark);
+  }
 
   std::unique_ptr<SimulationApp> app = make_unique<SimulationApp>(
-      "Assignment3", glm::ivec2(1440, 900));
+      "Assignment3", glm::ivec2(1440, 900), config);
 
   app->SetupScene();
 